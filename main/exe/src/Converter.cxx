@@ -6,6 +6,7 @@
 #include "eudaq/Logger.hh"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace eudaq;
 unsigned dbg = 0; 
@@ -42,6 +43,8 @@ int main(int, char ** argv) {
   eudaq::Option<std::string> ipat(op, "i", "inpattern", "../data/run$6R.raw", "string", "Input filename pattern");
   eudaq::Option<std::string> opat(op, "o", "outpattern", "test$6R$X", "string", "Output filename pattern");
   eudaq::OptionFlag sync(op, "s", "synctlu", "Resynchronize subevents based on TLU event number");
+  eudaq::Option<unsigned> batch(op, "b", "batch", 64U, "events",
+      "Number of events passed to the writer at once, converted in parallel by writers that convert them");
   eudaq::Option<std::string> level(op, "l", "log-level", "INFO", "level",
       "The minimum level for displaying log messages locally");
   op.ExtraHelpText("Available output types are: " + to_string(eudaq::FileWriterFactory::GetTypes(), ", "));
@@ -54,13 +57,38 @@ int main(int, char ** argv) {
       counted_ptr<eudaq::FileWriter> writer(FileWriterFactory::Create(type.Value()));
       writer->SetFilePattern(opat.Value());
       writer->StartRun(reader.RunNumber());
+      if (!numbers.empty() && reader.HasIndex() && !sync.IsSet()) {
+        // go straight to the requested events, BORE first and EORE last
+        writer->WriteEvent(reader.GetDetectorEvent());
+        for (size_t j = 0; j < numbers.size(); ++j) {
+          if (numbers[j] == (unsigned)-1) continue;
+          if (reader.GotoEvent(numbers[j]) && !reader.GetDetectorEvent().IsBORE() && !reader.GetDetectorEvent().IsEORE()) {
+            writer->WriteEvent(reader.GetDetectorEvent());
+          }
+        }
+        if (reader.GotoEvent((unsigned)-1) && reader.GetDetectorEvent().IsEORE()) {
+          writer->WriteEvent(reader.GetDetectorEvent());
+        }
+        continue;
+      }
+      // the reader moves on to the next event, so the batch keeps the events alive
+      std::vector<EventPtr<DetectorEvent> > events;
+      std::vector<const DetectorEvent *> pending;
+      const size_t batchsize = std::max(batch.Value(), 1U);
       do {
         if (reader.GetDetectorEvent().IsBORE() || reader.GetDetectorEvent().IsEORE() || numbers.empty() ||
             std::find(numbers.begin(), numbers.end(), reader.GetDetectorEvent().GetEventNumber()) != numbers.end()) {
-          writer->WriteEvent(reader.GetDetectorEvent());
+          events.push_back(reader.GetDetectorEventPtr());
+          pending.push_back(events.back().get());
+          if (pending.size() >= batchsize) {
+            writer->WriteEvents(pending);
+            events.clear();
+            pending.clear();
+          }
           if(dbg>0)std::cout<< "writing one more event" << std::endl;
         }
       } while (reader.NextEvent());
+      if (!pending.empty()) writer->WriteEvents(pending);
       if(dbg>0)std::cout<< "no more events to read" << std::endl;
     }
   } catch (...) {
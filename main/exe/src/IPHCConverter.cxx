@@ -113,7 +113,7 @@ int main(int, char ** argv) {
       writer->StartRun(runnumber);
       {
         DetectorEvent dev(runnumber, 0, NOTIMESTAMP);
-        counted_ptr<Event> rev(new RawDataEvent(RawDataEvent::BORE("EUDRB", runnumber)));
+        EventPtr<Event> rev(new RawDataEvent(RawDataEvent::BORE("EUDRB", runnumber)));
         rev->SetTag("VERSION", "3");
         rev->SetTag("DET", asicname(conf.AsicName));
         rev->SetTag("MODE", "ZS2");
@@ -146,7 +146,7 @@ int main(int, char ** argv) {
         for (int ev = 0; ev < nevents; ++ev) {
           eudaq::DetectorEvent dev(runnumber, eventnumber, NOTIMESTAMP);
           RawDataEvent * rev = new RawDataEvent("EUDRB", runnumber, eventnumber);
-          counted_ptr<Event> ev1(rev);
+          EventPtr<Event> ev1(rev);
           for (int brd = 0; brd < conf.AsicNb; ++brd) {
             MI26__TZsFFrameRaw data;
             if (!fread((void*)&data, sizeof data, 1, f)) {
@@ -199,7 +199,7 @@ int main(int, char ** argv) {
       }
       {
         DetectorEvent dev(runnumber, eventnumber, NOTIMESTAMP);
-        counted_ptr<Event> rev(new RawDataEvent(RawDataEvent::EORE("EUDRB", runnumber, eventnumber)));
+        EventPtr<Event> rev(new RawDataEvent(RawDataEvent::EORE("EUDRB", runnumber, eventnumber)));
         dev.AddEvent(rev);
         dev.SetTag("STOPTIME", decodetime(res.StopDate, res.StopTime));
         writer->WriteEvent(dev);
@@ -14,6 +14,7 @@ using eudaq::from_string;
 using eudaq::lcase;
 using eudaq::Event;
 using eudaq::DetectorEvent;
+using eudaq::EventPtr;
 using eudaq::EUDRBEvent;
 using eudaq::TLUEvent;
 
@@ -188,7 +189,7 @@ class RunInfo {
     void GetEORE() {
       try {
         for (;;) {
-          counted_ptr<DetectorEvent> dev = NextEvent();
+          EventPtr<DetectorEvent> dev = NextEvent();
           if (dev->IsEORE()) {
             m_eore = dev;
             break;
@@ -224,21 +225,21 @@ class RunInfo {
       if (result == "") return def;
       return result;
     }
-    counted_ptr<DetectorEvent> NextEvent() {
+    EventPtr<DetectorEvent> NextEvent() {
       Event * ev = eudaq::EventFactory::Create(*m_des);
       DetectorEvent * dev = dynamic_cast<DetectorEvent *>(ev);
       if (!dev) {
         delete ev;
         EUDAQ_THROW("Bad data file");
       }
-      return counted_ptr<DetectorEvent>(dev);
+      return EventPtr<DetectorEvent>(dev);
     }
     std::vector<std::string> m_fields;
     std::string m_sep;
     std::ofstream * m_file;
     std::ostream & m_out;
     counted_ptr<eudaq::FileDeserializer> m_des;
-    counted_ptr<DetectorEvent> m_bore, m_eore;
+    EventPtr<DetectorEvent> m_bore, m_eore;
     counted_ptr<eudaq::Configuration> m_config;
     //  counted_ptr<eudaq::EUDRBDecoder> m_dec;
     counted_ptr<std::vector<eudaq::LogMessage> > m_log;
@@ -0,0 +1,212 @@
+#include "eudaq/M26Decoder.hh"
+#include "eudaq/StandardEvent.hh"
+#include "eudaq/OptionParser.hh"
+#include "eudaq/Utils.hh"
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+using eudaq::StandardPlane;
+using eudaq::M26Hits;
+
+typedef std::vector<unsigned short> words_t;
+
+// Bit 15 of a line header is set by the sensor when it has overflowed, and must be ignored
+static unsigned short Header(unsigned row, unsigned numstates, bool overflow = false) {
+  return static_cast<unsigned short>(overflow << 15 | row << 4 | numstates);
+}
+static unsigned short State(unsigned column, unsigned extra) { return static_cast<unsigned short>(column << 2 | extra); }
+
+struct Pixel {
+  unsigned x, y;
+  bool pivot;
+};
+
+/// A frame with the hits it must decode to, or with none given to be checked against the reference only
+struct Frame {
+  std::string name;
+  unsigned pivotrow;
+  words_t words;
+  std::vector<Pixel> expected;
+  bool golden;
+};
+
+// The frames as they come from the NI system: 32 bit words, each holding two 16 bit words, low half first
+static std::vector<unsigned char> FrameBytes(const words_t & words) {
+  std::vector<unsigned char> bytes(2 * (words.size() + words.size() % 2));
+  for (size_t i = 0; i < words.size(); ++i) {
+    bytes[2 * i] = static_cast<unsigned char>(words[i] & 0xff);
+    bytes[2 * i + 1] = static_cast<unsigned char>(words[i] >> 8);
+  }
+  return bytes;
+}
+
+/** The decoder the NIConverterPlugin used before DecodeM26, kept as the
+ *  reference: it pushes every pixel into the plane one by one.
+ */
+static void DecodeReference(StandardPlane & plane, size_t len, const unsigned char * it, int frame) {
+  std::vector<unsigned short> vec;
+  for (size_t i = 0; i < len; ++i) {
+    unsigned v = eudaq::getlittleendian<unsigned>(it + 4 * i);
+    vec.push_back(v & 0xffff);
+    vec.push_back(v >> 16);
+  }
+  for (size_t i = 0; i < vec.size(); ++i) {
+    if (i == vec.size() - 1) break;
+    unsigned numstates = vec[i] & 0xf;
+    unsigned row = vec[i]>>4 & 0x7ff;
+    if (numstates+1 > vec.size()-i) {
+      // Ignoring bad line
+      break;
+    }
+    bool pivot = (row >= (plane.PivotPixel() / 16));
+    for (unsigned s = 0; s < numstates; ++s) {
+      unsigned v = vec.at(++i);
+      unsigned column = v>>2 & 0x7ff;
+      unsigned num = v & 3;
+      for (unsigned j = 0; j < num+1; ++j) {
+        plane.PushPixel(column+j, row, 1, pivot, frame);
+      }
+    }
+  }
+}
+
+static void AddGolden(std::vector<Frame> & frames, const std::string & name, unsigned pivotrow,
+    const unsigned short * words, size_t nwords, const Pixel * pixels, size_t npixels) {
+  Frame f = { name, pivotrow, words_t(words, words + nwords), std::vector<Pixel>(pixels, pixels + npixels), true };
+  frames.push_back(f);
+}
+
+static void AddChecked(std::vector<Frame> & frames, const std::string & name, unsigned pivotrow, const words_t & words) {
+  Frame f = { name, pivotrow, words, std::vector<Pixel>(), false };
+  frames.push_back(f);
+}
+
+// A frame of lines with random states, of which some cover several pixels;
+// the last line may claim more states than are left, as in a corrupt frame
+static words_t RandomFrame(unsigned & seed, unsigned lines, unsigned multi, bool badend) {
+  words_t words;
+  unsigned row = 0;
+  for (unsigned l = 0; l < lines && row < 576; ++l) {
+    seed = seed * 1103515245 + 12345;
+    row += 1 + (seed >> 16) % 4;
+    const unsigned numstates = 1 + (seed >> 8) % 15;
+    words.push_back(Header(row % 576, numstates, seed & 1));
+    unsigned column = 0;
+    for (unsigned s = 0; s < numstates; ++s) {
+      seed = seed * 1103515245 + 12345;
+      column += 1 + (seed >> 16) % 60;
+      const unsigned extra = (seed >> 8) % 100 < multi ? (seed >> 4) % 4 : 0;
+      words.push_back(State(column % 1148, extra));
+    }
+  }
+  if (badend) words.push_back(Header(575, 15));
+  return words;
+}
+
+static std::vector<Frame> Frames() {
+  std::vector<Frame> frames;
+  {
+    const unsigned short words[] = { Header(10, 2), State(5, 0), State(100, 0), Header(300, 1), State(1151, 0) };
+    const Pixel pixels[] = { { 5, 10, false }, { 100, 10, false }, { 1151, 300, true } };
+    AddGolden(frames, "single pixels", 200, words, 5, pixels, 3);
+  }
+  {
+    const unsigned short words[] = { Header(20, 2), State(7, 3), State(50, 1), Header(21, 1, true), State(0, 2) };
+    const Pixel pixels[] = { { 7, 20, false }, { 8, 20, false }, { 9, 20, false }, { 10, 20, false },
+      { 50, 20, false }, { 51, 20, false }, { 0, 21, true }, { 1, 21, true }, { 2, 21, true } };
+    AddGolden(frames, "multi-pixel states", 21, words, 5, pixels, 9);
+  }
+  {
+    const unsigned short words[] = { Header(5, 1), State(3, 0), Header(6, 15), State(9, 0), State(11, 0), 0 };
+    const Pixel pixels[] = { { 3, 5, false } };
+    AddGolden(frames, "bad line", 0x7ff, words, 6, pixels, 1);
+  }
+  {
+    const unsigned short words[] = { Header(40, 0), Header(41, 1), State(60, 0) };
+    const Pixel pixels[] = { { 60, 41, true } };
+    AddGolden(frames, "empty line", 0, words, 3, pixels, 1);
+  }
+  {
+    // seventeen single pixel states, then a group of sixteen with one covering four pixels
+    words_t words;
+    words.push_back(Header(100, 15));
+    for (unsigned s = 0; s < 15; ++s) words.push_back(State(10 * s, 0));
+    words.push_back(Header(101, 15));
+    for (unsigned s = 0; s < 15; ++s) words.push_back(State(10 * s, s == 7 ? 3 : 0));
+    words.push_back(Header(102, 3));
+    for (unsigned s = 0; s < 3; ++s) words.push_back(State(500 + 10 * s, 0));
+    AddChecked(frames, "groups of sixteen", 101, words);
+  }
+  unsigned seed = 1;
+  for (unsigned i = 0; i < 100; ++i) {
+    AddChecked(frames, "random " + eudaq::to_string(i), (i * 37) % 600,
+        RandomFrame(seed, 1 + i % 60, i % 3 == 0 ? 0 : i % 50, i % 7 == 0));
+  }
+  return frames;
+}
+
+static bool Compare(const std::string & what, const Frame & frame, const M26Hits & hits, size_t n, const StandardPlane & ref) {
+  if (n != ref.HitPixels(0)) {
+    std::cout << "  " << frame.name << ": " << what << " gives " << n << " pixels instead of " << ref.HitPixels(0) << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (hits.x[i] != ref.GetX(i, 0) || hits.y[i] != ref.GetY(i, 0) || (hits.pivot[i] != 0) != ref.GetPivot(i, 0)) {
+      std::cout << "  " << frame.name << ": " << what << " differs from the reference at pixel " << i << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool TestFrame(const Frame & frame, bool avx2) {
+  std::vector<unsigned char> bytes = FrameBytes(frame.words);
+  const size_t nwords = bytes.size() / 2;
+  StandardPlane ref(0, "NI", "MIMOSA26");
+  ref.SetSizeZS(1152, 576, 0, 2, StandardPlane::FLAG_WITHPIVOT | StandardPlane::FLAG_DIFFCOORDS);
+  ref.SetPivotPixel(frame.pivotrow * 16);
+  DecodeReference(ref, nwords / 2, &bytes[0], 0);
+
+  bool ok = true;
+  if (frame.golden) {
+    bool same = ref.HitPixels(0) == frame.expected.size();
+    for (size_t i = 0; same && i < frame.expected.size(); ++i) {
+      const Pixel & p = frame.expected[i];
+      same = ref.GetX(i, 0) == p.x && ref.GetY(i, 0) == p.y && ref.GetPivot(i, 0) == p.pivot;
+    }
+    if (!same) std::cout << "  " << frame.name << ": the reference does not give the expected pixels" << std::endl;
+    ok = same;
+  }
+  M26Hits hits;
+  hits.Reserve(nwords);
+  ok = Compare("DecodeM26Scalar", frame, hits, eudaq::DecodeM26Scalar(&bytes[0], nwords, frame.pivotrow, hits), ref) && ok;
+#ifdef EUDAQ_TARGET_AVX2
+  if (avx2) {
+    ok = Compare("DecodeM26AVX2", frame, hits, eudaq::DecodeM26AVX2(&bytes[0], nwords, frame.pivotrow, hits), ref) && ok;
+  }
+#endif
+  ok = Compare("DecodeM26", frame, hits, eudaq::DecodeM26(&bytes[0], nwords, frame.pivotrow, hits), ref) && ok;
+  return ok;
+}
+
+int main(int /*argc*/, const char ** argv) {
+  eudaq::OptionParser op("EUDAQ NI Decoder Test", "1.0", "Checks the Mimosa26 decoders against known frames and the original decoder");
+  eudaq::OptionFlag noavx2(op, "s", "scalar-only", "Do not test the AVX2 decoder, even if the processor has AVX2");
+  try {
+    op.Parse(argv);
+    const bool avx2 = eudaq::CpuHasAVX2() && !noavx2.Value();
+    std::cout << "AVX2 decoder: " << (avx2 ? "tested" : "not available") << std::endl;
+    const std::vector<Frame> frames = Frames();
+    unsigned failed = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+      if (!TestFrame(frames[i], avx2)) ++failed;
+    }
+    std::cout << frames.size() - failed << "/" << frames.size() << " frames decoded correctly" << std::endl;
+    std::cout << (failed ? "FAILED" : "OK") << std::endl;
+    return failed ? 1 : 0;
+  } catch (...) {
+    return op.HandleMainException();
+  }
+}
@@ -68,7 +68,7 @@ bool DoEvent(unsigned /*ndata*/, const eudaq::DetectorEvent & dev, bool do_proce
             for (unsigned block = 0; block < rev->NumBlocks(); ++block) {
 
               std::cout << "#### Producer " << num << ", block " << block << " (ID " << rev->GetID(block) << ") ####" << std::endl;
-              const std::vector<unsigned char> & data = rev->GetBlock(block);
+              const eudaq::ByteView data = rev->GetBlockView(block);
 
               for (size_t i = 0; i+3 < data.size(); i += 4) {
 
@@ -127,6 +127,7 @@ int main(int /*argc*/, char ** argv) {
   eudaq::OptionFlag do_dump(op, "u", "dump", "Dump raw data for displayed events");
   eudaq::OptionFlag do_zs(op, "z", "zsdump", "Print pixels for zs events");
   eudaq::OptionFlag sync(op, "s", "synctlu", "Resynchronize subevents based on TLU event number");
+  eudaq::OptionFlag do_index(op, "x", "index", "Write an index alongside each file, for files written without one");
   eudaq::OptionFlag do_event_to_ttree(op, "r", "event-to-ttree", "Convert a file into a TTree .root format");
   eudaq::Option<std::string> level(op, "l", "log-level", "INFO", "level",
       "The minimum level for displaying log messages locally");
@@ -139,7 +140,7 @@ int main(int /*argc*/, char ** argv) {
 
     bool showlast = std::find(displaynumbers.begin(), displaynumbers.end(), (unsigned)-1) != displaynumbers.end();
 
-    counted_ptr<eudaq::Event> lastevent;
+    eudaq::EventPtr<eudaq::Event> lastevent;
 
     if (do_event_to_ttree.IsSet()) throw eudaq::MessageException("The -r option is deprecated: use \"./Converter.exe -t root\" instead.");
 
@@ -147,6 +148,10 @@ int main(int /*argc*/, char ** argv) {
 
       eudaq::FileReader reader(op.GetArg(i), ipat.Value(), sync.IsSet());
       EUDAQ_INFO("Reading: " + reader.Filename());
+      if (do_index.IsSet()) {
+        reader.BuildIndex();
+        EUDAQ_INFO("Written index: " + eudaq::FileIndex::Filename(reader.Filename()));
+      }
 
       //    cout << i << " " << reader.Filename()  << endl;
 
@@ -188,7 +193,7 @@ int main(int /*argc*/, char ** argv) {
             bool dump = (do_dump.IsSet());
             shown = DoEvent(ndata, *dev, proc, show, do_zs.IsSet(), dump);
             if (showlast && !shown) {
-              lastevent = counted_ptr<eudaq::Event>(new eudaq::DetectorEvent(*dev));
+              lastevent = eudaq::EventPtr<eudaq::Event>(new eudaq::DetectorEvent(*dev));
             }
           } else if (const StandardEvent * sev = dynamic_cast<const StandardEvent *>(&ev)) {
             bool show = std::find(displaynumbers.begin(), displaynumbers.end(), ndata) != displaynumbers.end();
@@ -196,7 +201,7 @@ int main(int /*argc*/, char ** argv) {
               std::cout << *sev << std::endl;
               shown = true;
             } else {
-              if (showlast) lastevent = counted_ptr<eudaq::Event>(new eudaq::StandardEvent(*sev));
+              if (showlast) lastevent = eudaq::EventPtr<eudaq::Event>(new eudaq::StandardEvent(*sev));
             }
           }
         }
@@ -0,0 +1,152 @@
+#include "eudaq/BufferSerializer.hh"
+#include "eudaq/StandardEvent.hh"
+#include "eudaq/CompactPlane.hh"
+#include "eudaq/RawDataEvent.hh"
+#include "eudaq/OptionParser.hh"
+#include "eudaq/Timer.hh"
+#include "eudaq/Utils.hh"
+
+#include <iostream>
+#include <cstdlib>
+
+using eudaq::StandardEvent;
+using eudaq::StandardPlane;
+using eudaq::RawDataEvent;
+
+// A telescope-like event: zero suppressed Mimosa26 planes with some hits each
+StandardEvent MakeStandardEvent(unsigned planes, unsigned hits) {
+  StandardEvent ev(1, 1);
+  for (unsigned p = 0; p < planes; ++p) {
+    StandardPlane & plane = ev.NewPlane(p, "NI", "MIMOSA26");
+    plane.SetSizeZS(1152, 576, 0, 2, StandardPlane::FLAG_WITHPIVOT | StandardPlane::FLAG_DIFFCOORDS);
+    for (unsigned i = 0; i < hits; ++i) {
+      plane.PushPixel(std::rand() % 1152, std::rand() % 576, 1, i < hits / 2, i % 2);
+    }
+  }
+  return ev;
+}
+
+// A raw event with one block of the given size per board
+RawDataEvent MakeRawEvent(unsigned boards, unsigned bytes) {
+  RawDataEvent ev("EUDRB", 1, 1);
+  std::vector<unsigned char> data(bytes);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<unsigned char>(std::rand());
+  for (unsigned b = 0; b < boards; ++b) {
+    ev.AddBlock(b, data);
+  }
+  return ev;
+}
+
+// Serializes ev and reads it back n times, and checks that the copy serializes to the same bytes
+void RoundTrip(const std::string & name, const eudaq::Event & ev, unsigned n) {
+  eudaq::BufferSerializer ref;
+  ev.Serialize(ref);
+  eudaq::Timer ser_timer;
+  for (unsigned i = 0; i < n; ++i) {
+    eudaq::BufferSerializer ser;
+    ev.Serialize(ser);
+  }
+  ser_timer.Stop();
+  eudaq::Timer des_timer;
+  for (unsigned i = 0; i < n; ++i) {
+    eudaq::BufferDeserializer des(&ref[0], ref.size());
+    delete eudaq::EventFactory::Create(des);
+  }
+  des_timer.Stop();
+
+  eudaq::BufferDeserializer des(&ref[0], ref.size());
+  eudaq::Event * copy = eudaq::EventFactory::Create(des);
+  eudaq::BufferSerializer out;
+  copy->Serialize(out);
+  delete copy;
+  bool same = out.size() == ref.size();
+  for (size_t i = 0; same && i < ref.size(); ++i) {
+    same = out[i] == ref[i];
+  }
+
+  const double mb = ref.size() * double(n) / 1e6;
+  std::cout << name << ": " << ref.size() << " bytes, "
+    << "serialize " << ser_timer.uSeconds() / n << " us (" << mb / ser_timer.Seconds() << " MB/s), "
+    << "deserialize " << des_timer.uSeconds() / n << " us (" << mb / des_timer.Seconds() << " MB/s)"
+    << (same ? "" : ", ROUND TRIP DIFFERS") << std::endl;
+  if (!same) EUDAQ_THROW(name + " does not serialize to the same bytes after a round trip");
+}
+
+// Writes a compact plane with two frames of two hits, optionally corrupting one part of it
+std::vector<unsigned char> MakeCompactPlane(int corrupt) {
+  std::vector<unsigned> pixoffsets(3), coordoffsets(3);
+  pixoffsets[1] = coordoffsets[1] = 2;
+  pixoffsets[2] = coordoffsets[2] = 4;
+  std::vector<unsigned short> x(4, 1), y(4, 2);
+  std::vector<short> charge(4, 3);
+  std::vector<unsigned> pivot(1, 5), mat;
+  switch (corrupt) {
+    case 1: charge.pop_back(); break; // fewer charges than the offsets say
+    case 2: pixoffsets[1] = 5; break; // offsets go backwards
+    case 3: coordoffsets[1] = 5; break;
+    case 4: pivot.clear(); break; // missing pivot bits
+    case 5: y.pop_back(); break;
+  }
+  eudaq::BufferSerializer ser;
+  ser.write(std::string("NI"));
+  ser.write(std::string("MIMOSA26"));
+  ser.write(0U); // id
+  ser.write(0U); // tlu event
+  ser.write(1152U);
+  ser.write(576U);
+  ser.write((unsigned)StandardPlane::FLAG_ZS);
+  ser.write(0U); // pivot pixel
+  ser.write(pixoffsets);
+  ser.write(coordoffsets);
+  ser.write(x);
+  ser.write(y);
+  ser.write((unsigned)eudaq::CompactPlane::CHARGE_SHORT);
+  ser.write(charge);
+  ser.write(1U); // has pivot
+  ser.write(pivot);
+  ser.write(mat);
+  return std::vector<unsigned char>(&ser[0], &ser[0] + ser.size());
+}
+
+// Checks that a compact plane is read, and that each kind of inconsistency in one is rejected
+void CheckCompactPlane() {
+  for (int corrupt = 0; corrupt <= 5; ++corrupt) {
+    std::vector<unsigned char> data = MakeCompactPlane(corrupt);
+    eudaq::BufferDeserializer des(&data[0], data.size());
+    bool rejected = false;
+    try {
+      eudaq::CompactPlane plane(des);
+      StandardPlane sp;
+      plane.ToStandardPlane(sp);
+    } catch (const eudaq::Exception &) {
+      rejected = true;
+    }
+    if (rejected != (corrupt != 0)) {
+      EUDAQ_THROW("Compact plane with corruption " + eudaq::to_string(corrupt) + (rejected ? " rejected" : " accepted"));
+    }
+  }
+  std::cout << "CompactPlane: inconsistent planes rejected" << std::endl;
+}
+
+int main(int /*argc*/, const char ** argv) {
+  eudaq::OptionParser op("EUDAQ Serializer Test", "1.0", "Times serializing and deserializing StandardEvents and RawDataEvents");
+  eudaq::Option<unsigned> iter(op, "n", "iterations", 1000, "events",
+      "The number of round trips to time");
+  eudaq::Option<unsigned> planes(op, "p", "planes", 6, "planes",
+      "The number of planes in each StandardEvent");
+  eudaq::Option<unsigned> hits(op, "x", "hits", 1000, "pixels",
+      "The number of hit pixels per plane");
+  eudaq::Option<unsigned> boards(op, "b", "boards", 6, "blocks",
+      "The number of blocks in each RawDataEvent");
+  eudaq::Option<unsigned> bytes(op, "s", "block-size", 64*1024, "bytes",
+      "The size of each RawDataEvent block");
+  try {
+    op.Parse(argv);
+    CheckCompactPlane();
+    RoundTrip("StandardEvent", MakeStandardEvent(planes.Value(), hits.Value()), iter.Value());
+    RoundTrip("RawDataEvent", MakeRawEvent(boards.Value(), bytes.Value()), iter.Value());
+  } catch (...) {
+    return op.HandleMainException();
+  }
+  return 0;
+}
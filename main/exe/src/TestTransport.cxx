@@ -0,0 +1,163 @@
+#include "eudaq/TransportFactory.hh"
+#include "eudaq/EudaqThread.hh"
+#include "eudaq/OptionParser.hh"
+#include "eudaq/Timer.hh"
+#include "eudaq/Utils.hh"
+#include "eudaq/Platform.hh"
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+using eudaq::TransportEvent;
+using eudaq::ConnectionInfo;
+
+// Every fourth packet is large, the others small, so that small packets
+// end up both behind and in front of partially sent large ones
+static size_t PacketSize(unsigned i, size_t small, size_t large) {
+  return i % 4 == 3 ? large : small;
+}
+
+static unsigned char PacketByte(unsigned i, size_t pos) {
+  return static_cast<unsigned char>(i * 31 + pos * 7 + (pos >> 16));
+}
+
+static std::string MakePacket(unsigned i, size_t small, size_t large) {
+  std::string packet(PacketSize(i, small, large), '\0');
+  for (size_t pos = 0; pos < packet.size(); ++pos) {
+    packet[pos] = static_cast<char>(PacketByte(i, pos));
+  }
+  return packet;
+}
+
+// Checks that the packets arrive complete and in order
+class Receiver {
+  public:
+    Receiver(size_t small, size_t large) : conn(0), received(0), errors(0), m_small(small), m_large(large) {}
+    void OnEvent(TransportEvent & ev) {
+      if (ev.etype == TransportEvent::CONNECT) {
+        ev.id.SetState(1);
+        conn = ev.id.Clone();
+      } else if (ev.etype == TransportEvent::RECEIVE) {
+        if (ev.packet.size() != PacketSize(received, m_small, m_large)) {
+          std::cout << "Packet " << received << " has " << ev.packet.size() << " bytes instead of "
+            << PacketSize(received, m_small, m_large) << std::endl;
+          ++errors;
+        } else {
+          for (size_t pos = 0; pos < ev.packet.size(); ++pos) {
+            if (static_cast<unsigned char>(ev.packet[pos]) != PacketByte(received, pos)) {
+              std::cout << "Packet " << received << " differs at byte " << pos << std::endl;
+              ++errors;
+              break;
+            }
+          }
+        }
+        ++received;
+      }
+    }
+    ConnectionInfo * conn;
+    unsigned received, errors;
+  private:
+    size_t m_small, m_large;
+};
+
+struct SendJob {
+  eudaq::TransportBase * transport;
+  const ConnectionInfo * to;
+  unsigned count;
+  size_t small, large;
+  std::string error;
+};
+
+static void * SendPackets(void * arg) {
+  SendJob & job = *static_cast<SendJob *>(arg);
+  try {
+    for (unsigned i = 0; i < job.count; ++i) {
+      job.transport->SendPacket(MakePacket(i, job.small, job.large), *job.to);
+    }
+    // as DataSender does at the end of a run, as nothing may send the rest of the queue otherwise
+    job.transport->Flush();
+  } catch (const std::exception & e) {
+    job.error = e.what();
+  }
+  return 0;
+}
+
+// Sends count packets from one side while the other side processes its events
+static bool Transfer(const std::string & direction, eudaq::TransportBase & from, const ConnectionInfo & to,
+    eudaq::TransportBase & dest, Receiver & receiver, unsigned count, size_t small, size_t large, int timeout) {
+  SendJob job = { &from, &to, count, small, large, "" };
+  eudaq::Timer timer;
+  eudaq::eudaqThread sender(SendPackets, &job);
+  while (receiver.received < count && timer.Seconds() < timeout) {
+    dest.Process(100);
+  }
+  sender.join();
+  timer.Stop();
+  std::cout << "  " << direction << ": " << receiver.received << "/" << count << " packets, "
+    << receiver.errors << " bad, " << timer.mSeconds() << " ms" << std::endl;
+  if (job.error != "") std::cout << "  Error sending: " << job.error << std::endl;
+  return receiver.received == count && receiver.errors == 0 && job.error == "";
+}
+
+static bool TestTransport(const std::string & proto, unsigned port, unsigned count, size_t small, size_t large, int timeout) {
+  std::cout << proto << ":" << std::endl;
+  const std::string addr = eudaq::to_string(port);
+  eudaq::TransportServer * server = eudaq::TransportFactory::CreateServer(proto + "://" + addr);
+  Receiver atserver(small, large), atclient(small, large);
+  server->SetCallback(eudaq::TransportCallback(&atserver, &Receiver::OnEvent));
+  // shared memory is named rather than addressed
+  const std::string clientaddr = proto == "shm" ? proto + "://" + addr : proto + "://localhost:" + addr;
+  eudaq::TransportClient * client = eudaq::TransportFactory::CreateClient(clientaddr);
+  client->SetCallback(eudaq::TransportCallback(&atclient, &Receiver::OnEvent));
+  eudaq::Timer timer;
+  while (!atserver.conn && timer.Seconds() < timeout) {
+    server->Process(100);
+  }
+  bool ok = atserver.conn != 0;
+  if (ok) {
+    ok = Transfer("client to server", *client, ConnectionInfo::ALL, *server, atserver, count, small, large, timeout);
+    ok = Transfer("server to client", *server, *atserver.conn, *client, atclient, count, small, large, timeout) && ok;
+  } else {
+    std::cout << "  No connection" << std::endl;
+  }
+  delete client;
+  delete server;
+  delete atserver.conn;
+  return ok;
+}
+
+#if EUDAQ_PLATFORM_IS(LINUX)
+static const char * DEFAULT_TRANSPORTS = "tcp,epoll,shm";
+#else
+static const char * DEFAULT_TRANSPORTS = "tcp,epoll";
+#endif
+
+int main(int /*argc*/, const char ** argv) {
+  eudaq::OptionParser op("EUDAQ Transport Test", "1.0", "Sends a mix of small and large packets both ways over a transport");
+  eudaq::Option<std::string> protos(op, "t", "transports", DEFAULT_TRANSPORTS, "names",
+      "The transports to test, separated by commas");
+  eudaq::Option<unsigned> port(op, "p", "port", 44099, "port",
+      "The port to listen on");
+  eudaq::Option<unsigned> count(op, "n", "packets", 200, "packets",
+      "The number of packets to send each way");
+  eudaq::Option<unsigned> small(op, "s", "small", 100, "bytes",
+      "The size of the small packets");
+  eudaq::Option<unsigned> large(op, "l", "large", 8*1024*1024, "bytes",
+      "The size of the large packets");
+  eudaq::Option<int> timeout(op, "w", "timeout", 60, "seconds",
+      "How long to wait for the packets in each direction");
+  try {
+    op.Parse(argv);
+    std::vector<std::string> names = eudaq::split(protos.Value(), ",");
+    bool ok = true;
+    for (size_t i = 0; i < names.size(); ++i) {
+      ok = TestTransport(eudaq::trim(names[i]), port.Value() + static_cast<unsigned>(i), count.Value(),
+          small.Value(), large.Value(), timeout.Value()) && ok;
+    }
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+  } catch (...) {
+    return op.HandleMainException();
+  }
+}
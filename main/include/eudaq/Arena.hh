@@ -0,0 +1,111 @@
+#ifndef EUDAQ_INCLUDED_Arena
+#define EUDAQ_INCLUDED_Arena
+
+/**
+ * \file Arena.hh
+ * Memory for the objects of many events, allocated and freed in one piece.
+ */
+
+#include "eudaq/Atomic.hh"
+#include "eudaq/Platform.hh"
+#include <cstddef>
+#include <new>
+
+namespace eudaq {
+
+  /** A block of memory that objects are carved from one after the other.
+   *  Nothing is freed on its own: whatever uses the memory holds a reference
+   *  to the arena, and the whole block is freed with the last reference.
+   *  Allocating and releasing are safe from any thread.
+   */
+  class DLLEXPORT Arena {
+    public:
+      /// Creates an arena of the given size, holding one reference for its creator
+      static Arena * Create(size_t bytes);
+      /// Returns 0, and marks the arena as full, if there is not enough room left
+      void * Allocate(size_t bytes);
+      bool Contains(const void * p) const {
+        return static_cast<const char *>(p) >= m_data && static_cast<const char *>(p) < m_data + m_capacity;
+      }
+      bool Full() const { return m_full.load() != 0; }
+      size_t Capacity() const { return m_capacity; }
+      size_t Used() const;
+      void AddRef() { m_refs.fetch_add(1); }
+      void Release();
+    private:
+      Arena(char * data, size_t bytes);
+      ~Arena() {}
+      Arena(const Arena &);
+      Arena & operator = (const Arena &);
+      Atomic<size_t> m_refs;
+      Atomic<size_t> m_used;
+      Atomic<int> m_full;
+      char * const m_data;
+      const size_t m_capacity;
+  };
+
+  /** An STL allocator taking memory from an Arena, or from the heap if it has
+   *  no arena or the arena is full. Containers using it keep the arena alive.
+   */
+  template <typename T>
+    class ArenaAllocator {
+      public:
+        typedef T value_type;
+        typedef T * pointer;
+        typedef const T * const_pointer;
+        typedef T & reference;
+        typedef const T & const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        template <typename U>
+          struct rebind { typedef ArenaAllocator<U> other; };
+
+        ArenaAllocator(Arena * arena = 0) : m_arena(arena) { if (m_arena) m_arena->AddRef(); }
+        ArenaAllocator(const ArenaAllocator & other) : m_arena(other.m_arena) { if (m_arena) m_arena->AddRef(); }
+        template <typename U>
+          ArenaAllocator(const ArenaAllocator<U> & other) : m_arena(other.GetArena()) { if (m_arena) m_arena->AddRef(); }
+        ~ArenaAllocator() { if (m_arena) m_arena->Release(); }
+        ArenaAllocator & operator = (const ArenaAllocator & other) {
+          if (other.m_arena) other.m_arena->AddRef();
+          if (m_arena) m_arena->Release();
+          m_arena = other.m_arena;
+          return *this;
+        }
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+        pointer allocate(size_type n, const void * = 0) {
+          void * p = m_arena ? m_arena->Allocate(n * sizeof (T)) : 0;
+          if (!p) p = ::operator new(n * sizeof (T));
+          return static_cast<pointer>(p);
+        }
+        void deallocate(pointer p, size_type) {
+          // memory from the arena goes back with the whole arena
+          if (!m_arena || !m_arena->Contains(p)) ::operator delete(p);
+        }
+        size_type max_size() const { return size_type(-1) / sizeof (T); }
+        void construct(pointer p, const T & value) { ::new(static_cast<void *>(p)) T(value); }
+        void destroy(pointer p) { p->~T(); }
+        Arena * GetArena() const { return m_arena; }
+      private:
+        Arena * m_arena;
+    };
+
+  template <typename T, typename U>
+    inline bool operator == (const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) {
+      return a.GetArena() == b.GetArena();
+    }
+  template <typename T, typename U>
+    inline bool operator != (const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) {
+      return a.GetArena() != b.GetArena();
+    }
+
+  /** The number of heap allocations the process has made so far.
+   *  They are only counted if the library is built with EUDAQ_COUNT_ALLOCATIONS,
+   *  otherwise this is always 0.
+   */
+  DLLEXPORT unsigned long long HeapAllocations();
+
+}
+
+#endif // EUDAQ_INCLUDED_Arena
@@ -0,0 +1,59 @@
+#ifndef EUDAQ_INCLUDED_Atomic
+#define EUDAQ_INCLUDED_Atomic
+
+/**
+ * \file Atomic.hh
+ * A minimal atomic integer for sharing counters and flags between threads.
+ * It uses std::atomic when C++11 is enabled, and the GCC builtins otherwise.
+ */
+
+#include "eudaq/Platform.hh"
+
+#ifdef CPP11
+# include <atomic>
+#endif
+
+namespace eudaq {
+
+  /** An integer (or pointer) that may be read and written by several threads.
+   *  Loads acquire and stores release, so data written before a store is
+   *  visible to a thread after it has loaded the stored value.
+   */
+  template <typename T>
+    class Atomic {
+      public:
+        explicit Atomic(T value = T()) : m_value(value) {}
+#ifdef CPP11
+        T load() const { return m_value.load(std::memory_order_acquire); }
+        void store(T value) { m_value.store(value, std::memory_order_release); }
+        T exchange(T value) { return m_value.exchange(value); }
+        T fetch_add(T delta) { return m_value.fetch_add(delta); }
+        T fetch_sub(T delta) { return m_value.fetch_sub(delta); }
+        /// Replaces expected by desired, or loads the current value into expected
+        bool compare_exchange(T & expected, T desired) {
+          return m_value.compare_exchange_strong(expected, desired);
+        }
+#else
+        T load() const { return __atomic_load_n(&m_value, __ATOMIC_ACQUIRE); }
+        void store(T value) { __atomic_store_n(&m_value, value, __ATOMIC_RELEASE); }
+        T exchange(T value) { return __atomic_exchange_n(&m_value, value, __ATOMIC_SEQ_CST); }
+        T fetch_add(T delta) { return __atomic_fetch_add(&m_value, delta, __ATOMIC_SEQ_CST); }
+        T fetch_sub(T delta) { return __atomic_fetch_sub(&m_value, delta, __ATOMIC_SEQ_CST); }
+        /// Replaces expected by desired, or loads the current value into expected
+        bool compare_exchange(T & expected, T desired) {
+          return __atomic_compare_exchange_n(&m_value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        }
+#endif
+      private:
+        Atomic(const Atomic &);
+        Atomic & operator = (const Atomic &);
+#ifdef CPP11
+        std::atomic<T> m_value;
+#else
+        T m_value;
+#endif
+    };
+
+}
+
+#endif // EUDAQ_INCLUDED_Atomic
@@ -0,0 +1,83 @@
+#ifndef EUDAQ_INCLUDED_BoundedQueue
+#define EUDAQ_INCLUDED_BoundedQueue
+
+/**
+ * \file BoundedQueue.hh
+ * A fixed size lock-free queue for handing objects from one thread to another.
+ */
+
+#include "eudaq/Atomic.hh"
+#include "eudaq/Utils.hh"
+#include <vector>
+#include <cstddef>
+
+namespace eudaq {
+
+  /** Waits for another thread by spinning briefly, then yielding,
+   *  and finally sleeping a millisecond at a time.
+   */
+  class Backoff {
+    public:
+      Backoff() : m_count(0) {}
+      void operator () () {
+        if (m_count < 64) {
+          ++m_count;
+        } else if (m_count < 256) {
+          ++m_count;
+          mSleep(0);
+        } else {
+          mSleep(1);
+        }
+      }
+      void Reset() { m_count = 0; }
+    private:
+      unsigned m_count;
+  };
+
+  /** A ring buffer with one thread pushing and one thread popping.
+   *  Neither side takes a lock, and a full queue makes the pushing side wait,
+   *  so a slow consumer holds back its producer instead of using more memory.
+   */
+  template <typename T>
+    class BoundedQueue {
+      public:
+        /// The capacity is rounded up to a power of two
+        explicit BoundedQueue(size_t capacity) : m_mask(RoundUp(capacity) - 1), m_data(m_mask + 1), m_head(0), m_tail(0) {}
+        size_t Capacity() const { return m_mask + 1; }
+        /// The number of items in the queue, as seen at some point during the call
+        size_t Size() const { return m_head.load() - m_tail.load(); }
+        bool Empty() const { return Size() == 0; }
+        bool TryPush(const T & item) {
+          size_t head = m_head.load();
+          if (head - m_tail.load() > m_mask) return false;
+          m_data[head & m_mask] = item;
+          m_head.store(head + 1);
+          return true;
+        }
+        void Push(const T & item) {
+          Backoff wait;
+          while (!TryPush(item)) wait();
+        }
+        bool TryPop(T & item) {
+          size_t tail = m_tail.load();
+          if (tail == m_head.load()) return false;
+          item = m_data[tail & m_mask];
+          m_data[tail & m_mask] = T();
+          m_tail.store(tail + 1);
+          return true;
+        }
+      private:
+        static size_t RoundUp(size_t n) {
+          size_t result = 1;
+          while (result < n) result <<= 1;
+          return result;
+        }
+        const size_t m_mask;
+        std::vector<T> m_data;
+        Atomic<size_t> m_head; ///< only changed by the pushing thread
+        Atomic<size_t> m_tail; ///< only changed by the popping thread
+    };
+
+}
+
+#endif // EUDAQ_INCLUDED_BoundedQueue
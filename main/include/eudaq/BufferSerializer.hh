@@ -28,6 +28,27 @@ namespace eudaq {
       size_t m_offset;
   };
 
+  /** A read-only Deserializer over an existing range of memory.
+   *  Reads just advance an offset into the range. If the range is a shared
+   *  ByteView, byte blocks (e.g. RawDataEvent data) are returned as views
+   *  into it rather than copies.
+   */
+  class DLLEXPORT BufferDeserializer : public Deserializer {
+    public:
+      explicit BufferDeserializer(const ByteView & data) : m_data(data), m_offset(0) {}
+      BufferDeserializer(const unsigned char * data, size_t len) : m_data(data, len), m_offset(0) {}
+      virtual bool HasData() { return m_offset < m_data.size(); }
+      virtual bool CanView() const { return m_data.IsShared(); }
+      size_t size() const { return m_data.size(); }
+      size_t Offset() const { return m_offset; }
+      void Seek(size_t offset);
+    private:
+      virtual void Deserialize(unsigned char * data, size_t len);
+      virtual bool View(size_t len, ByteView & view);
+      ByteView m_data;
+      size_t m_offset;
+  };
+
 }
 
 #endif // EUDAQ_INCLUDED_BufferSerializer
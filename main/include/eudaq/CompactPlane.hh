@@ -0,0 +1,78 @@
+#ifndef EUDAQ_INCLUDED_CompactPlane
+#define EUDAQ_INCLUDED_CompactPlane
+
+/**
+ * \file CompactPlane.hh
+ * A compact column based layout for the hits of a StandardPlane.
+ */
+
+#include "eudaq/StandardEvent.hh"
+#include <vector>
+#include <string>
+
+namespace eudaq {
+
+  /** The hits of a StandardPlane, each property in one contiguous column.
+   *  Coordinates are 16 bit integers, charges are 16 bit integers, floats or
+   *  doubles (the smallest that holds every value exactly), and pivot flags
+   *  are single bits. Frames are ranges of the columns given by offsets,
+   *  instead of separate vectors.
+   *
+   *  Conversion from a StandardPlane fails (and leaves the StandardPlane
+   *  layout as the only option) if a coordinate is not an integer in 0-65535.
+   *  StandardPlane::Serialize writes this layout whenever it can, straight
+   *  from the vectors of the StandardPlane (see Write).
+   *
+   *  This is the layout of planes on the wire and in files only: a
+   *  StandardPlane in memory still holds nested vectors of doubles, which is
+   *  what the converters fill and the monitors and writers read.
+   */
+  class DLLEXPORT CompactPlane : public Serializable {
+    public:
+      enum CHARGE { CHARGE_SHORT, CHARGE_FLOAT, CHARGE_DOUBLE };
+      CompactPlane();
+      CompactPlane(Deserializer &);
+      void Serialize(Serializer &) const;
+
+      /// Fills this from a StandardPlane, returns false if it cannot be represented
+      bool Assign(const StandardPlane & plane);
+      /// Fills a StandardPlane, reusing the memory it already has
+      void ToStandardPlane(StandardPlane & plane) const;
+      /// Returns false if a StandardPlane cannot be represented, otherwise the type its charges need
+      static bool Fits(const StandardPlane & plane, CHARGE & chargetype);
+      /** Writes what Assign followed by Serialize would, without building a
+       *  CompactPlane. The plane must fit, with the given charge type.
+       */
+      static void Write(const StandardPlane & plane, CHARGE chargetype, Serializer & ser);
+
+      unsigned NumFrames() const { return m_pixoffsets.size() - 1; }
+      unsigned HitPixels(unsigned frame = 0) const { return m_pixoffsets.at(frame + 1) - m_pixoffsets[frame]; }
+      unsigned X(unsigned index, unsigned frame = 0) const { return m_x.at(CoordIndex(index, frame)); }
+      unsigned Y(unsigned index, unsigned frame = 0) const { return m_y.at(CoordIndex(index, frame)); }
+      bool Pivot(unsigned index, unsigned frame = 0) const;
+      double Charge(unsigned index, unsigned frame = 0) const;
+      CHARGE ChargeType() const { return m_chargetype; }
+      /// The bytes used by the hits
+      size_t HitBytes() const;
+
+    private:
+      size_t CoordIndex(unsigned index, unsigned frame) const;
+      std::string m_type, m_sensor;
+      unsigned m_id, m_tluevent;
+      unsigned m_xsize, m_ysize;
+      unsigned m_flags, m_pivotpixel;
+      std::vector<unsigned> m_pixoffsets; ///< Where each frame starts in the charges, plus the total
+      std::vector<unsigned> m_coordoffsets; ///< Where each frame starts in the coordinates, plus the total
+      std::vector<unsigned short> m_x, m_y;
+      CHARGE m_chargetype;
+      std::vector<short> m_charge16; ///< Only one of the charge columns is used, see m_chargetype
+      std::vector<float> m_chargef;
+      std::vector<double> m_charged;
+      bool m_haspivot;
+      std::vector<unsigned> m_pivot; ///< One bit per coordinate
+      std::vector<unsigned> m_mat;
+  };
+
+}
+
+#endif // EUDAQ_INCLUDED_CompactPlane
@@ -0,0 +1,43 @@
+#ifndef EUDAQ_INCLUDED_Compression
+#define EUDAQ_INCLUDED_Compression
+
+/**
+ * \file Compression.hh
+ * The block compression used by the compressed native file format.
+ */
+
+#include "eudaq/Platform.hh"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace eudaq {
+
+  /** Compresses and decompresses whole blocks with one of the codecs the
+   *  library was built with (zlib, LZ4 and zstd are each optional).
+   *  The codec numbers are stored in files, so they must never change.
+   */
+  class DLLEXPORT Compression {
+    public:
+      enum Codec { CODEC_NONE = 0, CODEC_ZLIB = 1, CODEC_LZ4 = 2, CODEC_ZSTD = 3 };
+
+      static bool Available(unsigned codec);
+      /// The fastest codec available
+      static unsigned Default();
+      /// Looks up a codec by name ("none", "zlib", "lz4" or "zstd"), throws if it is unknown or unavailable
+      static unsigned FromName(const std::string & name);
+      static std::string Name(unsigned codec);
+
+      /** Compresses len bytes into out, replacing its contents.
+       *  A level of 0 picks the codec's default.
+       */
+      static void Compress(unsigned codec, int level, const unsigned char * data, size_t len,
+          std::vector<unsigned char> & out);
+      /// Decompresses into exactly outlen bytes, throws if the data does not match
+      static void Decompress(unsigned codec, const unsigned char * data, size_t len,
+          unsigned char * out, size_t outlen);
+  };
+
+}
+
+#endif // EUDAQ_INCLUDED_Compression
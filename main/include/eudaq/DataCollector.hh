@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <queue>
+#include <functional>
 
 #include "eudaq/TransportServer.hh"
 #include "eudaq/CommandReceiver.hh"
@@ -15,10 +17,41 @@
 #include "eudaq/counted_ptr.hh"
 #include "eudaq/Platform.hh"
 #include "eudaq/EudaqThread.hh"
+#include "eudaq/Atomic.hh"
+#include "eudaq/BoundedQueue.hh"
+#include "eudaq/Mutex.hh"
 namespace eudaq {
 
+  class DetectorEvent;
+  class DataConverterPlugin;
+  class Arena;
+
   /** Implements the functionality of the File Writer application.
    *
+   *  Data passes through a pipeline of threads: the transport thread
+   *  receives packets, a pool of threads deserializes them, one thread
+   *  builds the events (OnConnect, OnDisconnect, OnReceive and OnCompleteEvent
+   *  are called from it) and another writes them to file.
+   *  The stages are linked by bounded lock-free queues, so a slow stage
+   *  makes the earlier ones wait instead of using more and more memory.
+   *  Idle stages sleep until the previous one has made progress.
+   *  Commands that change the configuration or start a run pause the
+   *  builder and the writer between two events while they do so.
+   *
+   *  By default one event from each producer makes up a DetectorEvent.
+   *  With EventBuilding = timestamp in the DataCollector section of the
+   *  configuration, the producer streams are instead merged in time order, and
+   *  all events within TimestampWindow of the earliest one are combined.
+   *  A window is built once every producer has sent something later, except
+   *  producers that have sent nothing for TimestampTimeout seconds, or once
+   *  some producer has TimestampBuffer events waiting.
+   *  With EventBuilding = triggerid, events are combined by the trigger ID
+   *  their plugin reports, whatever order they arrive in. Up to ReorderDepth
+   *  triggers are held back, and a trigger still missing data from some
+   *  producers after ReorderTimeout seconds is built without it, flagged PART.
+   *  At the start of a run nothing is built until every producer has sent a
+   *  trigger, or for ReorderTimeout seconds, and building starts from the
+   *  lowest trigger ID received by then.
    */
   class DLLEXPORT DataCollector : public CommandReceiver {
     public:
@@ -32,33 +65,147 @@ namespace eudaq {
       virtual void OnConfigure(const Configuration & param);
       virtual void OnPrepareRun(unsigned runnumber);
       virtual void OnStopRun();
-      virtual void OnReceive(const ConnectionInfo & id, counted_ptr<Event> ev);
+      virtual void OnReceive(const ConnectionInfo & id, EventPtr<Event> ev);
       virtual void OnCompleteEvent();
       virtual void OnStatus();
       virtual ~DataCollector();
 
       void DataThread();
+      void ShmDataThread();
+      void DecodeThread();
+      void BuildThread();
+      void WriteThread();
     private:
       struct Info {
+        Info() : newest(0), heard(0), plugin(0) {}
         counted_ptr<ConnectionInfo> id;
-        std::list<counted_ptr<Event> > events;
+        std::list<EventPtr<Event> > events;
+        unsigned long long newest; ///< Largest merge key received, when building by timestamp
+        Time heard; ///< When the last event was received
+        DataConverterPlugin * plugin; ///< Looked up from the producer's BORE, or 0
+      };
+
+      /// The events received for one trigger ID, when building by trigger ID
+      struct Pending {
+        Pending() : count(0), first(0) {}
+        std::vector<EventPtr<Event> > parts; ///< Indexed by connection handle
+        size_t count;
+        Time first; ///< When the first part arrived
       };
 
+      /// A part received before the first trigger ID to build was known
+      struct Early {
+        unsigned handle, id;
+        EventPtr<Event> ev;
+      };
+
+      /// A packet or connection change on its way from the transport to the event builder
+      struct Item;
+      /// Keeps the event builder and the writer paused while it exists
+      class Pause;
+
       void DataHandler(TransportEvent & ev);
-      size_t GetInfo(const ConnectionInfo & id);
+      void ShmDataHandler(TransportEvent & ev);
+      /// Handles a connection change or packet from either data server
+      void HandleData(TransportServer & server, TransportEvent & ev);
+      void DataHandlerLocked(TransportServer & server, TransportEvent & ev);
+      /// Returns the handle under which the connection's data is kept in m_buffer
+      unsigned GetInfo(const ConnectionInfo & id);
+      /// Queues a packet (taking over its contents) or connection change, waiting while the pipeline is full
+      void Enqueue(int type, const ConnectionInfo & id, std::string * packet = 0);
+      /// Processes an item in the event building thread
+      void Handle(Item & item);
+      /// Waits until everything received so far has been written
+      void Drain();
+      /// Waits until every event built so far has been written
+      void WaitWritten();
+      /// Clears the buffers of the event builder for a new run
+      void ResetBuffers();
+      /// Allocates an event to build, from the event builder's arena if arenas are in use
+      DetectorEvent * NewEvent(unsigned run, unsigned event, unsigned long long timestamp);
+      /// Completes an event and queues it for writing
+      void Emit(DetectorEvent * ev);
+      /// The trigger ID of an event from a producer, using the plugin found at its BORE
+      static unsigned GetTriggerID(const Info & inf, const Event & ev);
+      /// Timestamp used to merge producer streams, BOREs go first and EOREs last
+      static unsigned long long MergeKey(const Event & ev);
+      /** Builds all events whose timestamp window can no longer change, or whose producers are too slow.
+       *  Returns the seconds until a producer holding back the next window times out, or a negative number if none does.
+       */
+      double BuildByTimestamp();
+      /// Takes the earliest event of all producers
+      EventPtr<Event> PopMerged();
+      void RebuildHeap();
+      /// Holds back a data event until its trigger is complete, when building by trigger ID
+      void Reorder(unsigned handle, EventPtr<Event> ev);
+      /** Builds the triggers that are complete or timed out, or all pending ones if flush is set.
+       *  Returns the seconds until the oldest trigger left times out, or a negative number if none is left.
+       */
+      double BuildByTriggerID(bool flush);
+      /** Once every producer has sent a part, ReorderTimeout seconds after
+       *  the first one, or when flushing, starts building from the lowest
+       *  trigger ID among the parts held back. Returns the seconds left to
+       *  wait, or a negative number once started.
+       */
+      double StartTriggerIDs(bool flush);
+      /// Files a part under its trigger ID, building the oldest triggers if it is too far ahead
+      void PlaceTrigger(unsigned handle, unsigned id, EventPtr<Event> ev);
+      /// Builds the oldest trigger from whatever parts were received
+      void BuildTrigger();
 
       bool m_done, m_listening;
       TransportServer * m_dataserver; ///< Transport for receiving data packets
+      TransportServer * m_shmserver; ///< Shared memory transport for producers on this host, or 0
+      eudaqThread m_shmthread;
+      Mutex m_datalock; ///< Held while handling data from either server, so that items are queued by one at a time
 //       pthread_t m_thread;
 //       pthread_attr_t m_threadattr;
 	  eudaqThread m_thread;
-      std::vector<Info> m_buffer;
+      std::vector<Info> m_buffer; ///< Indexed by connection handle, unused entries have no id
+      std::vector<unsigned> m_producers; ///< Handles of the connected producers in the order they connected
+      std::vector<bool> m_handles; ///< Handles in use, owned by the transport thread
       size_t m_numwaiting; ///< The number of producers with events waiting in the buffer
-      size_t m_itlu; ///< Index of TLU in m_buffer vector, or -1 if no TLU
+      size_t m_itlu; ///< Handle of TLU in m_buffer vector, or -1 if no TLU
       unsigned m_runnumber, m_eventnumber;
       counted_ptr<FileWriter> m_writer;
       Configuration m_config;
       Time m_runstart;
+      enum BuildMode { BUILD_POSITION, BUILD_TIMESTAMP, BUILD_TRIGGERID };
+      BuildMode m_building;
+      unsigned long long m_window;
+      double m_timestamptimeout; ///< Seconds after which a quiet producer no longer holds back building
+      size_t m_streamlimit; ///< Events a producer may have waiting before windows are built without the others
+      /// Merge key and handle of the first event of each producer with events waiting, earliest on top
+      typedef std::priority_queue<std::pair<unsigned long long, unsigned>,
+              std::vector<std::pair<unsigned long long, unsigned> >,
+              std::greater<std::pair<unsigned long long, unsigned> > > heap_t;
+      heap_t m_heap;
+      /// Trigger IDs wrap around at 15 bits, as the TLU only reports that many
+      static const unsigned TRIGGER_IDMASK = 0x7fff;
+      std::vector<Pending> m_reorder; ///< Indexed by trigger ID modulo the depth
+      size_t m_reorderdepth;
+      double m_reordertimeout;
+      unsigned m_nextid; ///< The oldest trigger ID not built yet
+      bool m_havenextid;
+      std::vector<Early> m_early; ///< Parts held back at the start of a run, until m_nextid is known
+      Time m_earlyfirst; ///< When the first of them arrived
+      size_t m_pending; ///< The number of triggers with any parts received
+      size_t m_partial, m_late; ///< Events built incomplete, and parts dropped, this run
+      Atomic<size_t> m_arenasize; ///< Size of the arenas events are allocated from, or 0 to use the heap
+      Arena * m_arena; ///< Where the event builder allocates events, replaced when it fills up
+      unsigned long long m_allocations; ///< HeapAllocations() at the start of the run
+
+      Item * m_items; ///< Ring of items between receiving and event building
+      Atomic<size_t> m_received, m_decoding, m_built; ///< Items queued, taken for decoding and handled
+      Atomic<size_t> m_queued, m_written; ///< Events queued for and done by the writer
+      Atomic<int> m_stop; ///< 1 once nothing more is received, 2 once nothing more is built
+      /// Signalled as items are received, decoded and built, and as events are queued and written
+      EventCount m_onreceived, m_ondecoded, m_onbuilt, m_onqueued, m_onwritten;
+      Mutex m_buildlock; ///< Held by the event builder while it handles an item
+      Mutex m_writelock; ///< Held by the writer while it writes an event
+      BoundedQueue<DetectorEvent *> m_writequeue;
+      std::vector<eudaqThread *> m_decoders;
+      eudaqThread m_builder, m_writerthread;
   };
 
 }
@@ -56,6 +56,12 @@ namespace eudaq{
        */
       virtual bool GetStandardSubEvent(StandardEvent & /*result*/, eudaq::Event const & /*source*/) const { return false; };
 
+      /** Returns true if GetStandardSubEvent may be called from several threads
+       *  at once, i.e. it keeps no state between events. Otherwise the
+       *  PluginManager only lets one thread at a time convert with this plugin.
+       */
+      virtual bool IsThreadSafe() const { return false; }
+
       /** Returns the type of event this plugin can convert to lcio as a pair of Event type id and subtype string.
        */
       virtual t_eventid const & GetEventType() const { return m_eventtype; }
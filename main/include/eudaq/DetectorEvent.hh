@@ -3,7 +3,7 @@
 
 #include <vector>
 #include "eudaq/TLUEvent.hh"
-#include "eudaq/counted_ptr.hh"
+#include "eudaq/Arena.hh"
 
 namespace eudaq {
 
@@ -13,14 +13,16 @@ namespace eudaq {
     EUDAQ_DECLARE_EVENT(DetectorEvent);
     public:
     virtual void Serialize(Serializer &) const;
-    explicit DetectorEvent(unsigned runnumber, unsigned eventnumber, unsigned long long timestamp) :
-      Event(runnumber, eventnumber, timestamp)
+    /// The list of sub-events goes in arena, if given, as for an event allocated from it
+    explicit DetectorEvent(unsigned runnumber, unsigned eventnumber, unsigned long long timestamp, Arena * arena = 0) :
+      Event(runnumber, eventnumber, timestamp), m_events(ArenaAllocator<EventPtr<Event> >(arena))
     {}
     //     explicit DetectorEvent(const TLUEvent & tluev) :
     //       Event(tluev.GetRunNumber(), tluev.GetEventNumber(), tluev.GetTimestamp())
     //       {}
     explicit DetectorEvent(Deserializer&);
-    void AddEvent(counted_ptr<Event> evt);
+    void AddEvent(EventPtr<Event> evt);
+    void Reserve(size_t n) { m_events.reserve(n); }
     virtual void Print(std::ostream &) const;
 
     /// Return "DetectorEvent" as type.
@@ -29,7 +31,7 @@ namespace eudaq {
     size_t NumEvents() const { return m_events.size(); }
     Event * GetEvent(size_t i) { return m_events[i].get(); }
     const Event * GetEvent(size_t i) const { return m_events[i].get(); }
-    counted_ptr<Event> GetEventPtr(size_t i) { return m_events[i]; }
+    EventPtr<Event> GetEventPtr(size_t i) { return m_events[i]; }
     const RawDataEvent & GetRawSubEvent(const std::string & subtype, int n = 0) const;
     template <typename T>
       const T * GetSubEvent(int n = 0) const {
@@ -46,7 +48,7 @@ namespace eudaq {
         return 0;
       }
     private:
-    std::vector<counted_ptr<Event> > m_events;
+    std::vector<EventPtr<Event>, ArenaAllocator<EventPtr<Event> > > m_events;
   };
 
 }
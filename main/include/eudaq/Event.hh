@@ -12,6 +12,8 @@
 #include "eudaq/Exception.hh"
 #include "eudaq/Utils.hh"
 #include "eudaq/Platform.hh"
+#include "eudaq/EventPtr.hh"
+#include "eudaq/TagStore.hh"
 
 
 #define EUDAQ_DECLARE_EVENT(type)           \
@@ -37,14 +39,29 @@ namespace eudaq {
 
   static const unsigned long long NOTIMESTAMP = (unsigned long long)-1;
 
+  class Arena;
+
   class DLLEXPORT Event : public Serializable {
     public:
-      enum Flags { FLAG_BORE=1, FLAG_EORE=2, FLAG_HITS=4, FLAG_FAKE=8, FLAG_SIMU=16, FLAG_ALL=(unsigned)-1 }; // Matches FLAGNAMES in .cc file
+      enum Flags { FLAG_BORE=1, FLAG_EORE=2, FLAG_HITS=4, FLAG_FAKE=8, FLAG_SIMU=16, FLAG_PART=32, FLAG_ALL=(unsigned)-1 }; // Matches FLAGNAMES in .cc file
       Event(unsigned run, unsigned event, unsigned long long timestamp = NOTIMESTAMP, unsigned flags=0)
         : m_flags(flags), m_runnumber(run), m_eventnumber(event), m_timestamp(timestamp) {}
       Event(Deserializer & ds);
       virtual void Serialize(Serializer &) const = 0;
 
+      /** Events may be allocated from an Arena, e.g. new (arena) RawDataEvent(...),
+       *  and are deleted as usual; the arena is freed once all its events are gone.
+       */
+      static void * operator new(size_t size);
+      static void * operator new(size_t size, Arena & arena);
+      static void operator delete(void * p);
+      static void operator delete(void * p, Arena & arena);
+
+      /// For EventPtr, which deletes the event once Release returns true
+      void AddRef() const { m_refs.Acquire(); }
+      bool Release() const { return m_refs.Release(); }
+      size_t RefCount() const { return m_refs.Count(); }
+
       unsigned GetRunNumber() const { return m_runnumber; }
       unsigned GetEventNumber() const { return m_eventnumber; }
       unsigned long long GetTimestamp() const { return m_timestamp; }
@@ -56,23 +73,29 @@ namespace eudaq {
 
       virtual void Print(std::ostream & os) const = 0;
 
+      /// Numbers are stored as they are, and read back as numbers without parsing
       Event & SetTag(const std::string & name, const std::string & val);
       template <typename T>
         Event & SetTag(const std::string & name, const T & val) {
-          return SetTag(name, eudaq::to_string(val));
+          m_tags.Set(name, TagValue(val));
+          return *this;
         }
       std::string GetTag(const std::string & name, const std::string & def = "") const;
       std::string GetTag(const std::string & name, const char * def) const { return GetTag(name, std::string(def)); }
       template <typename T>
         T GetTag(const std::string & name, T def) const {
-          return eudaq::from_string(GetTag(name), def);
+          const TagValue * val = m_tags.Find(name);
+          return val ? val->Get(def) : def;
         }
+      const TagStore & GetTags() const { return m_tags; }
 
       bool IsBORE() const { return GetFlags(FLAG_BORE) != 0; }
       bool IsEORE() const { return GetFlags(FLAG_EORE) != 0; }
       bool HasHits() const { return GetFlags(FLAG_HITS) != 0; }
       bool IsFake() const { return GetFlags(FLAG_FAKE) != 0; }
       bool IsSimulation() const { return GetFlags(FLAG_SIMU) != 0; }
+      /// Data from some producers is missing
+      bool IsPartial() const { return GetFlags(FLAG_PART) != 0; }
 
       static unsigned str2id(const std::string & idstr);
       static std::string id2str(unsigned id);
@@ -81,11 +104,11 @@ namespace eudaq {
       void ClearFlags(unsigned f = FLAG_ALL) { m_flags &= ~f; }
       virtual unsigned get_id() const = 0;
     protected:
-      typedef std::map<std::string, std::string> map_t;
-
       unsigned m_flags, m_runnumber, m_eventnumber;
       unsigned long long m_timestamp;
-      map_t m_tags; ///< Metadata tags in (name=value) pairs of strings
+      TagStore m_tags; ///< Metadata tags, by name
+    private:
+      mutable eudaq::RefCount m_refs;
   };
 
   DLLEXPORT std::ostream &  operator << (std::ostream &, const Event &);
@@ -118,6 +141,7 @@ namespace eudaq {
         EventFactory::Register(T_Evt::eudaq_static_id(), &factory_func);
       }
       static Event * factory_func(Deserializer & ds) {
+        if (Arena * arena = ds.GetArena()) return new (*arena) T_Evt(ds);
         return new T_Evt(ds);
       }
     };
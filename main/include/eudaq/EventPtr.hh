@@ -0,0 +1,97 @@
+#ifndef EUDAQ_INCLUDED_EventPtr
+#define EUDAQ_INCLUDED_EventPtr
+
+/**
+ * \file EventPtr.hh
+ * A thread safe reference counted pointer to an event, keeping the count in the event itself.
+ */
+
+#include "eudaq/Atomic.hh"
+#include <cstddef>
+
+namespace eudaq {
+
+  /** The reference count embedded in every Event.
+   *  A copy of an event is a new object, so it starts with no references,
+   *  and assigning an event leaves the references to it alone.
+   */
+  class RefCount {
+    public:
+      RefCount() : m_count(0) {}
+      RefCount(const RefCount &) : m_count(0) {}
+      RefCount & operator = (const RefCount &) { return *this; }
+      void Acquire() { m_count.fetch_add(1); }
+      /// Returns true when the last reference has gone
+      bool Release() { return m_count.fetch_sub(1) == 1; }
+      size_t Count() const { return m_count.load(); }
+    private:
+      Atomic<size_t> m_count;
+  };
+
+  /** A shared pointer to an event (or anything else with AddRef, Release
+   *  and RefCount methods like Event), deleting it with the last reference.
+   *  The count lives in the event, so no memory is allocated for it, and any
+   *  number of EventPtrs may be made from the same plain pointer. Copies may
+   *  be made and dropped from different threads at once.
+   */
+  template <typename T>
+    class EventPtr {
+      public:
+        typedef T element_type;
+
+        explicit EventPtr(T * p = 0) : m_ptr(p) { if (m_ptr) m_ptr->AddRef(); }
+        EventPtr(const EventPtr & other) : m_ptr(other.m_ptr) { if (m_ptr) m_ptr->AddRef(); }
+        template <typename U>
+          EventPtr(const EventPtr<U> & other) : m_ptr(other.get()) { if (m_ptr) m_ptr->AddRef(); }
+        ~EventPtr() { reset(); }
+
+        EventPtr & operator = (const EventPtr & other) {
+          EventPtr(other).swap(*this);
+          return *this;
+        }
+        template <typename U>
+          EventPtr & operator = (const EventPtr<U> & other) {
+            EventPtr(other).swap(*this);
+            return *this;
+          }
+        EventPtr & operator = (T * p) {
+          EventPtr(p).swap(*this);
+          return *this;
+        }
+#ifdef CPP11
+        /// Takes over the reference without touching the count
+        EventPtr(EventPtr && other) : m_ptr(other.m_ptr) { other.m_ptr = 0; }
+        EventPtr & operator = (EventPtr && other) {
+          EventPtr(static_cast<EventPtr &&>(other)).swap(*this);
+          return *this;
+        }
+#endif
+
+        void swap(EventPtr & other) {
+          T * tmp = m_ptr;
+          m_ptr = other.m_ptr;
+          other.m_ptr = tmp;
+        }
+        void reset(T * p = 0) {
+          if (p) p->AddRef();
+          T * old = m_ptr;
+          m_ptr = p;
+          if (old && old->Release()) delete old;
+        }
+
+        T & operator * () const { return *m_ptr; }
+        T * operator -> () const { return m_ptr; }
+        T * get() const { return m_ptr; }
+        operator bool () const { return m_ptr != 0; }
+        bool unique() const { return !m_ptr || m_ptr->RefCount() == 1; }
+
+      private:
+        T * m_ptr;
+    };
+
+  template <typename T>
+    inline void swap(EventPtr<T> & a, EventPtr<T> & b) { a.swap(b); }
+
+}
+
+#endif // EUDAQ_INCLUDED_EventPtr
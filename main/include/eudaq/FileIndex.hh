@@ -0,0 +1,87 @@
+#ifndef EUDAQ_INCLUDED_FileIndex
+#define EUDAQ_INCLUDED_FileIndex
+
+/**
+ * \file FileIndex.hh
+ * The index written alongside a native data file, for finding events
+ * without reading everything before them.
+ */
+
+#include "eudaq/FileSerializer.hh"
+#include "eudaq/Platform.hh"
+#include <vector>
+#include <string>
+#include <utility>
+
+namespace eudaq {
+
+  class Event;
+  class PluginStreams;
+
+  /** The position of every event in a native data file.
+   *  The index is kept in a file named after the data file with ".idx"
+   *  appended, holding a short header and then one fixed size entry per
+   *  event, in the order the events appear in the data file.
+   */
+  class DLLEXPORT FileIndex {
+    public:
+      struct Entry {
+        Entry(unsigned ev = 0, unsigned trig = 0, unsigned fl = 0, unsigned long long off = 0, unsigned long long len = 0)
+          : eventnumber(ev), triggerid(trig), flags(fl), offset(off), length(len) {}
+        unsigned eventnumber;
+        unsigned triggerid; ///< As reported by the first plugin that knows it, or -1
+        unsigned flags;
+        unsigned long long offset; ///< Where the event starts in the data file
+        unsigned long long length; ///< Bytes the event takes up in the data file
+      };
+      static const size_t npos = (size_t)-1;
+      FileIndex() : m_insorted(true) {}
+
+      static std::string Filename(const std::string & datafile) { return datafile + ".idx"; }
+      /** Describes an event written at offset with the given length.
+       *  The plugins giving its trigger ID are taken from streams if given.
+       */
+      static Entry MakeEntry(const Event & ev, unsigned long long offset, unsigned long long length,
+          const PluginStreams * streams = 0);
+
+      /// Reads the index of a data file, returns false if there is none (or it is unreadable)
+      bool Load(const std::string & datafile);
+      void Clear();
+      void Add(const Entry & entry);
+      size_t Size() const { return m_entries.size(); }
+      const Entry & operator [] (size_t i) const { return m_entries[i]; }
+      /** The position in the file of the first event with this number, or npos, in O(log n).
+       *  If the events are not in order, the entries added since the last call are sorted first.
+       */
+      size_t Find(unsigned eventnumber) const;
+    private:
+      std::vector<Entry> m_entries;
+      /// Event numbers and positions sorted by event number, filled in by Find as the events may not be in order in the file
+      mutable std::vector<std::pair<unsigned, size_t> > m_sorted;
+      bool m_insorted; ///< Whether m_entries are in event number order, then m_sorted is not needed
+  };
+
+  /// Writes the index file for a data file, one entry at a time as the events are written
+  class DLLEXPORT FileIndexWriter {
+    public:
+      FileIndexWriter(const std::string & datafile);
+      ~FileIndexWriter();
+      void Write(const FileIndex::Entry & entry);
+      /// Writes the entry for an event, finding the plugins for its trigger ID once per run
+      FileIndex::Entry Write(const Event & ev, unsigned long long offset, unsigned long long length);
+      /** Describes an event to be written later, as Write does. It only uses the
+       *  plugins, so it may be called from another thread than the other functions.
+       */
+      FileIndex::Entry MakeEntry(const Event & ev, unsigned long long offset, unsigned long long length);
+      void Flush() { m_ser.Flush(); }
+      void Sync() { m_ser.Sync(); }
+    private:
+      FileIndexWriter(const FileIndexWriter &);
+      FileIndexWriter & operator = (const FileIndexWriter &);
+      FileSerializer m_ser;
+      PluginStreams * m_streams; ///< Looked up from the last BORE
+  };
+
+}
+
+#endif // EUDAQ_INCLUDED_FileIndex
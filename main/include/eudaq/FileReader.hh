@@ -2,32 +2,51 @@
 #define EUDAQ_INCLUDED_FileReader
 
 #include "eudaq/FileSerializer.hh"
+#include "eudaq/FileIndex.hh"
 #include "eudaq/DetectorEvent.hh"
 #include "eudaq/StandardEvent.hh"
-#include "eudaq/counted_ptr.hh"
 #include <string>
 
 namespace eudaq {
 
+  /** Reads the events of a native data file in turn.
+   *  If the file has an index (see FileIndex) skipping and GotoEvent jump
+   *  straight to an event, otherwise skipping reads all the events in between.
+   *  Compressed files are decompressed a block at a time on a separate thread,
+   *  ahead of the events being read.
+   */
   class DLLEXPORT FileReader {
     public:
       FileReader(const std::string & filename, const std::string & filepattern = "", bool synctriggerid = false);
       ~FileReader();
       bool NextEvent(size_t skip = 0);
+      /** Reads the event with this event number, or the last event in the file
+       *  for (unsigned)-1. Returns false if the index does not contain it.
+       */
+      bool GotoEvent(unsigned eventnumber);
+      bool HasIndex() const { return m_index.Size() > 0; }
+      /// Reads through the whole file to write its index, for files written without one
+      void BuildIndex();
       std::string Filename() const { return m_filename; }
       unsigned RunNumber() const;
       const eudaq::Event & GetEvent() const;
       const DetectorEvent & Event() const { return GetDetectorEvent(); } // for backward compatibility
       const DetectorEvent & GetDetectorEvent() const;
+      /// The current event, kept alive for as long as the caller needs it
+      EventPtr<DetectorEvent> GetDetectorEventPtr() const;
       const StandardEvent & GetStandardEvent() const;
       void Interrupt() { m_des.Interrupt(); }
       class eventqueue_t;
+      class blockreader_t;
     private:
       std::string m_filename;
       FileDeserializer m_des;
-      counted_ptr<eudaq::Event> m_ev;
+      EventPtr<eudaq::Event> m_ev;
       unsigned m_ver;
       eventqueue_t * m_queue;
+      blockreader_t * m_blocks; ///< Only for compressed files
+      FileIndex m_index;
+      size_t m_pos; ///< Position in the index of the current event, or npos if unknown
   };
 
 }
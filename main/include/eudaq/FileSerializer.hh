@@ -13,6 +13,8 @@ namespace eudaq {
     public:
       FileSerializer(const std::string & fname, bool overwrite = false);
       virtual void Flush();
+      /// Flushes, and waits until the data has reached the disk
+      void Sync();
       unsigned long long FileBytes() const { return m_filebytes; }
       ~FileSerializer();
     private:
@@ -21,27 +23,47 @@ namespace eudaq {
       unsigned long long m_filebytes;
   };
 
+  /** Reads from a file, which may still be growing while it is read.
+   *  Where possible the file is mapped into memory, so nothing is copied
+   *  until it is read, and byte blocks are returned as views into the mapping
+   *  (see CanView). The mapping is extended as the file grows. Otherwise
+   *  (e.g. on Windows) the file is read through a buffer.
+   */
   class DLLEXPORT FileDeserializer : public Deserializer {
     public:
       FileDeserializer(const std::string & fname, bool faileof = false, size_t buffersize = 65536);
+      virtual ~FileDeserializer();
       virtual bool HasData();
+      virtual bool CanView() const { return m_map.get() != 0; }
+      /// The offset in the file of the next byte to be read
+      unsigned long long Position();
+      /// Continues reading at an offset in the file, dropping anything buffered
+      void Seek(unsigned long long offset);
       template <typename T>
         T peek() {
           FillBuffer();
-          BufferSerializer buf(m_start, m_stop);
+          BufferDeserializer buf(m_start, level());
           T result;
           buf.read(result);
           return result;
         }
     private:
       virtual void Deserialize(unsigned char * data, size_t len);
+      virtual bool View(size_t len, ByteView & view);
       size_t FillBuffer(size_t min = 0);
+      /// Extends the mapping to the current end of the file, returns the number of bytes added
+      size_t Remap();
+      /// Waits a little for the file to grow
+      void WaitForData();
       size_t level() const { return m_stop - m_start; }
       typedef unsigned char *ptr_t;
       FILE * m_file;
       bool m_faileof;
       std::vector<unsigned char> m_buf;
-      ptr_t m_start, m_stop;
+      ptr_t m_start, m_stop; ///< The unread data, in m_buf or in the mapping
+      EventPtr<BufferOwner> m_map; ///< The mapping of the file, if it is read that way
+      const unsigned char * m_mapbase;
+      int m_notify; ///< Reports changes to the file while waiting for it to grow, or -1
   };
 
 }
@@ -2,6 +2,7 @@
 #define EUDAQ_INCLUDED_FileWriter
 
 #include "eudaq/DetectorEvent.hh"
+#include "eudaq/Configuration.hh"
 #include <vector>
 #include <string>
 
@@ -10,8 +11,14 @@ namespace eudaq {
   class DLLEXPORT FileWriter {
     public:
       FileWriter();
+      /// Takes any settings for the writer from the configuration, before the first run
+      virtual void Configure(const Configuration &) {}
       virtual void StartRun(unsigned runnumber) = 0;
       virtual void WriteEvent(const DetectorEvent &) = 0;
+      /** Writes several events in order. Writers that convert to
+       *  StandardEvents override this to convert the events in parallel.
+       */
+      virtual void WriteEvents(const std::vector<const DetectorEvent *> & events);
       virtual unsigned long long FileBytes() const = 0;
       void SetFilePattern(const std::string & p) { m_filepattern = p; }
       virtual ~FileWriter() {}
@@ -0,0 +1,63 @@
+#ifndef EUDAQ_INCLUDED_M26Decoder
+#define EUDAQ_INCLUDED_M26Decoder
+
+/**
+ * \file M26Decoder.hh
+ * Decoding of zero suppressed Mimosa26 frames into compact hit arrays.
+ */
+
+#include "eudaq/Platform.hh"
+#include <vector>
+#include <cstddef>
+
+namespace eudaq {
+
+  /** The hits of one Mimosa26 frame, as compact columns.
+   *  It is reused from frame to frame, so it only allocates memory when a
+   *  frame is larger than any before it.
+   */
+  struct M26Hits {
+    std::vector<unsigned short> x, y;
+    std::vector<unsigned char> pivot;
+    std::vector<unsigned short> states, rows; ///< Scratch space for the AVX2 decoder
+    /// Makes room for the hits of a frame of nwords 16 bit words
+    void Reserve(size_t nwords) {
+      // a state gives up to four pixels, and four are always written
+      const size_t maxhits = 4 * nwords + 4;
+      if (x.size() < maxhits) {
+        x.resize(maxhits);
+        y.resize(maxhits);
+        pivot.resize(maxhits);
+      }
+      if (states.size() < nwords + 1) {
+        states.resize(nwords + 1);
+        rows.resize(nwords + 1);
+      }
+    }
+  };
+
+  /** Decodes a zero suppressed Mimosa26 frame of nwords little endian 16 bit
+   *  words into hits, which must have been reserved for nwords. Each line is
+   *  a header word (state count in bits 0-3, row in bits 4-14) followed by
+   *  its states (pixel count - 1 in bits 0-1, first column in bits 2-12).
+   *  Decoding stops at a line with more states than there are words left.
+   *  Pixels in rows from pivotrow on get the pivot flag. Returns the number
+   *  of hits.
+   */
+  size_t DLLEXPORT DecodeM26(const unsigned char * data, size_t nwords, unsigned pivotrow, M26Hits & hits);
+
+  /// As DecodeM26, on any processor
+  size_t DLLEXPORT DecodeM26Scalar(const unsigned char * data, size_t nwords, unsigned pivotrow, M26Hits & hits);
+
+#ifdef EUDAQ_TARGET_AVX2
+  /** As DecodeM26, but the states of all the lines are gathered first, then
+   *  decoded sixteen at a time wherever none of the sixteen covers more than
+   *  one pixel. Only if CpuHasAVX2() is true.
+   */
+  EUDAQ_TARGET_AVX2
+  size_t DLLEXPORT DecodeM26AVX2(const unsigned char * data, size_t nwords, unsigned pivotrow, M26Hits & hits);
+#endif
+
+}
+
+#endif // EUDAQ_INCLUDED_M26Decoder
@@ -26,16 +26,17 @@ namespace eudaq {
       virtual void OnIdle();
 
       virtual void OnEvent(const StandardEvent & /*ev*/ ) {};
-      virtual void OnBadEvent(counted_ptr<Event> /*ev*/) {}
+      virtual void OnBadEvent(EventPtr<Event> /*ev*/) {}
       virtual void OnStartRun(unsigned param);
       virtual void OnStopRun();
 
-      counted_ptr<DetectorEvent> LastBore() const { return m_lastbore; }
+      EventPtr<DetectorEvent> LastBore() const { return m_lastbore; }
     protected:
       unsigned m_run;
       bool m_callstart;
       counted_ptr<FileReader> m_reader;
-      counted_ptr<DetectorEvent> m_lastbore;
+      EventPtr<DetectorEvent> m_lastbore;
+      StandardEvent m_sev; ///< Reused for every event, so its planes keep their memory
       unsigned limit;
       unsigned skip;
       unsigned int skip_events_with_counter;
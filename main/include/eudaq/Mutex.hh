@@ -2,6 +2,7 @@
 #define H_EUDAQ_MUTEX
 
 #include "eudaq/Platform.hh"
+#include "eudaq/Atomic.hh"
 
 namespace eudaq {
 
@@ -28,6 +29,28 @@ namespace eudaq {
       bool m_locked;
   };
 
+  /** Lets a thread sleep until another one has made progress, e.g. in a
+   *  lock-free queue. The waiting thread takes Epoch(), checks whether it can
+   *  go on, and if not calls Wait() with that epoch, which returns as soon as
+   *  Notify() has been called since. Notify() only takes a lock if some thread
+   *  is waiting.
+   */
+  class DLLEXPORT EventCount {
+    public:
+      EventCount();
+      ~EventCount();
+      unsigned Epoch() const { return m_epoch.load(); }
+      /// Waits for a Notify() after epoch was taken, or at most timeout ms if it is not negative
+      void Wait(unsigned epoch, int timeout = -1);
+      void Notify();
+    private:
+      EventCount(const EventCount &);
+      EventCount & operator = (const EventCount &);
+      class Impl;
+      Impl * m_impl;
+      Atomic<unsigned> m_epoch, m_waiters;
+  };
+
   //   class MutexTryLock {
   //   public:
   //     MutexTryLock(Mutex & m);
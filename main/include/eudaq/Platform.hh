@@ -25,6 +25,13 @@
 
 
 
+#endif
+
+// Functions marked EUDAQ_TARGET_AVX2 may use AVX2 instructions whatever the
+// compiler flags, and must only be called if CpuHasAVX2() is true
+#if (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define EUDAQ_TARGET_AVX2 __attribute__((target("avx2")))
 #endif
 
 
@@ -3,12 +3,37 @@
 
 #include "eudaq/DataConverterPlugin.hh"
 #include "eudaq/DetectorEvent.hh"
+#include "eudaq/Mutex.hh"
 
 #include <string>
+#include <vector>
 #include <map>
 
 namespace eudaq {
 
+  /** The converter plugins of the producer streams of a run, one for each
+   *  sub-event of its BORE. They are looked up by event type once, from the
+   *  BORE, so that the events after it are dispatched without comparing any
+   *  type names. Sub-event i of an event is only taken to come from stream i
+   *  if the event is complete, with as many sub-events as the BORE, and the
+   *  run was not built by timestamp; otherwise its plugin is looked up.
+   */
+  class DLLEXPORT PluginStreams {
+    public:
+      PluginStreams() : m_ordered(false) {}
+      explicit PluginStreams(const DetectorEvent & bore) { Reset(bore); }
+      /// Looks up the plugins for the sub-events of a BORE
+      void Reset(const DetectorEvent & bore);
+      /// The plugin for sub-event i of dev, or 0 if there is none
+      DataConverterPlugin * Get(const DetectorEvent & dev, size_t i) const;
+      /// The trigger ID of sub-event i of dev, throws if it has no plugin
+      unsigned GetTriggerID(const DetectorEvent & dev, size_t i) const;
+      size_t Size() const { return m_plugins.size(); }
+    private:
+      std::vector<DataConverterPlugin *> m_plugins;
+      bool m_ordered; ///< False if the sub-events of an event need not be in stream order
+  };
+
   /** The plugin manager has a map of all available plugins.
    *  On creating time every plugin automatically registeres at
    *  the plugin manager, wich adds the event type string and 
@@ -35,22 +60,45 @@ namespace eudaq {
       static void Initialize(const DetectorEvent &);
       static lcio::LCRunHeader * GetLCRunHeader(const DetectorEvent &);
       static StandardEvent ConvertToStandard(const DetectorEvent &);
+      /** Converts into an existing StandardEvent, which keeps the memory of
+       *  its planes from one event to the next if it is reused.
+       */
+      static void ConvertToStandard(const DetectorEvent &, StandardEvent & result);
+      /** Converts a batch of events, events[i] into results[i], on up to
+       *  threads threads at once (0 for one per processor). Each event is
+       *  converted by one thread, as the single event version would, so
+       *  the order of the events and of their planes is kept. A BORE in
+       *  the batch is passed to Initialize once the events before it are
+       *  converted. results keeps the memory of its events if it is reused.
+       */
+      static void ConvertToStandard(const std::vector<const DetectorEvent *> & events,
+          std::vector<StandardEvent> & results, unsigned threads = 0);
       static lcio::LCEvent * ConvertToLCIO(const DetectorEvent &);
 
       static void ConvertStandardSubEvent(StandardEvent &, const Event &);
+      /// Converts with a plugin already looked up
+      static void ConvertStandardSubEvent(StandardEvent &, const Event &, DataConverterPlugin & plugin);
       static void ConvertLCIOSubEvent(lcio::LCEvent &, const Event &);
 
       /** Get the correct plugin implementation according to the event type.
        */
       DataConverterPlugin & GetPlugin(t_eventid eventtype);
       DataConverterPlugin & GetPlugin(const Event & event);
+      /// As GetPlugin, but returns 0 if there is no plugin for the event type
+      DataConverterPlugin * FindPlugin(const Event & event);
 
     private:
       /** The map that correlates the event type with its converter plugin.
        */
       std::map<t_eventid, DataConverterPlugin *> m_pluginmap;
+      /// The plugin whose planes go first in a StandardEvent
+      DataConverterPlugin * m_eudrb;
+      /// The streams of the run last passed to Initialize
+      PluginStreams m_streams;
+      /// Held while converting with a plugin that is not thread safe
+      Mutex m_serial;
 
-      PluginManager() {}
+      PluginManager() : m_eudrb(0) {}
       PluginManager(PluginManager const &) {}
       class _dummy;
       friend class _dummy; // Silence superfluous warnings in some gcc versions
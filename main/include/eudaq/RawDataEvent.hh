@@ -5,6 +5,7 @@
 
 #include <vector>
 #include "eudaq/Event.hh"
+#include "eudaq/Arena.hh"
 #include "eudaq/Platform.hh"
 namespace eudaq {
 
@@ -17,56 +18,92 @@ namespace eudaq {
     typedef unsigned char byte_t;
     typedef std::vector<byte_t> data_t;
     struct DLLEXPORT block_t : public Serializable {
-      block_t(unsigned id = (unsigned)-1, data_t data = data_t()) : id(id), data(data) {}
+      block_t(unsigned id = (unsigned)-1, const data_t & data = data_t()) : id(id), data(data) {}
       block_t(Deserializer &);
       void Serialize(Serializer &) const;
       void Append(const data_t & data);
+      void Append(const byte_t * data, size_t bytes);
+      /// Exchange the contents with another block without copying
+      void swap(block_t & other);
+      /// The block contents, wherever they are stored
+      ByteView View() const;
+      /// Copies a block that was read from a buffer into data, so that it can be changed
+      data_t & Vector();
       unsigned id;
+      /// The contents of a block made or changed in memory
       data_t data;
+      /** The contents of a block read from a shared buffer, referring to them in place.
+       *  Set once when the block is read, so a shared event can be read from several threads.
+       */
+      ByteView view;
     };
 
     RawDataEvent(std::string type, unsigned run, unsigned event);
     RawDataEvent(Deserializer &);
 
     /// Add an empty block
-    size_t AddBlock(unsigned id) {
-      m_blocks.push_back(block_t(id));
-      return m_blocks.size() - 1;
-    }
+    size_t AddBlock(unsigned id);
 
     /// Add a data block as std::vector
     template <typename T>
       size_t AddBlock(unsigned id, const std::vector<T> & data) {
-        m_blocks.push_back(block_t(id, make_vector(data)));
-        return m_blocks.size() - 1;
+        return AddBlock(id, data.empty() ? 0 : &data[0], data.size() * sizeof(T));
       }
 
     /// Add a data block as array with given size
     template <typename T>
       size_t AddBlock(unsigned id, const T * data, size_t bytes) {
-        m_blocks.push_back(block_t(id, make_vector(data, bytes)));
-        return m_blocks.size() - 1;
+        size_t index = AddBlock(id);
+        m_blocks[index].Append(reinterpret_cast<const byte_t *>(data), bytes);
+        return index;
       }
 
+    /** Add a data block by taking over the contents of data without copying them.
+     *  On return data is left empty.
+     */
+    size_t TakeBlock(unsigned id, data_t & data) {
+      size_t index = AddBlock(id);
+      m_blocks[index].data.swap(data);
+      return index;
+    }
+
+#ifdef CPP11
+    /// Add a data block by moving the contents of data into it
+    size_t AddBlock(unsigned id, data_t && data) {
+      return TakeBlock(id, data);
+    }
+#endif
+
     /// Append data to a block as std::vector
     template <typename T>
       void AppendBlock(size_t index, const std::vector<T> & data) {
-        m_blocks[index].Append(make_vector(data));
+        AppendBlock(index, data.empty() ? 0 : &data[0], data.size() * sizeof(T));
       }
 
     /// Append data to a block as array with given size
     template <typename T>
       void AppendBlock(size_t index, const T * data, size_t bytes) {
-        m_blocks[index].Append(make_vector(data, bytes));
+        m_blocks[index].Append(reinterpret_cast<const byte_t *>(data), bytes);
       }
 
+    /// Reserve space for a total of bytes in block index, so that appending does not reallocate
+    void ReserveBlock(size_t index, size_t bytes);
+    /// Reserve space for n blocks
+    void ReserveBlocks(size_t n);
+
     unsigned GetID(size_t i) const;
-    /** Get the data block number i as vector of \c{unsigned char}, which is the byte sequence which
+    /** Get a copy of the data block number i as vector of \c{unsigned char}, which is the byte sequence which
      *  which has been serialised. This is the recommended way to retrieve your
      *  data from the RawDataEvent since the other GetBlock functions might
      *  give different results depending on the endiannes of your mashine.
+     *  Use GetBlockView instead where the data need not be copied.
      */
-    const data_t & GetBlock(size_t i) const;
+    data_t GetBlock(size_t i) const;
+    /** Get the data block number i without copying it.
+     *  The view stays valid while the event exists; if the block was read
+     *  from a shared buffer, the view keeps that buffer alive on its own.
+     */
+    ByteView GetBlockView(size_t i) const;
     byte_t GetByte(size_t block, size_t index) const;
 
     /// Return the number of data blocks in the RawDataEvent
@@ -91,20 +128,9 @@ namespace eudaq {
       : Event(run, event, NOTIMESTAMP, flag) ,  m_type(type)
     {}
 
-    template <typename T>
-      static data_t make_vector(const T * data, size_t bytes) {
-        const unsigned char * ptr = reinterpret_cast<const byte_t *>(data);
-        return data_t(ptr, ptr + bytes);
-      }
-
-    template <typename T>
-      static data_t make_vector(const std::vector<T> & data) {
-        const unsigned char * ptr = reinterpret_cast<const byte_t *>(&data[0]);
-        return data_t(ptr, ptr + data.size() * sizeof(T));
-      }
-
+    typedef std::vector<block_t, ArenaAllocator<block_t> > blocks_t;
     std::string m_type;
-    std::vector<block_t> m_blocks;
+    blocks_t m_blocks; ///< In the arena of the event, if it was read into one
   };
 
 }
@@ -42,6 +42,8 @@ namespace eudaq {
       void InitLog(const ConnectionInfo & id);
       void InitData(const ConnectionInfo & id);
       void InitOther(const ConnectionInfo & id);
+      /// The data server address to give to a connection: shared memory if it is on the data collector's host
+      std::string DataAddress(const ConnectionInfo & id) const;
       void SendCommand(const std::string & cmd, const std::string & param = "",
           const ConnectionInfo & id = ConnectionInfo::ALL);
       std::string SendReceiveCommand(const std::string & cmd, const std::string & param = "",
@@ -57,6 +59,7 @@ namespace eudaq {
 	  eudaqThread m_thread;
       size_t m_idata, m_ilog;
 	  std::string m_dataaddr, m_logaddr;
+      std::string m_shmaddr, m_datahost; ///< Shared memory data server, if any, and the host it is on
       long long m_runsizelimit;
       bool m_stopping, m_busy, m_producerbusy;
   };
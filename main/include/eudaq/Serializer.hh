@@ -6,26 +6,139 @@
 #include <map>
 #include "eudaq/Serializable.hh"
 #include "eudaq/counted_ptr.hh"
+#include "eudaq/EventPtr.hh"
 #include "eudaq/Time.hh"
 #include "eudaq/Exception.hh"
+#include "eudaq/Utils.hh"
 #include "eudaq/Platform.hh"
 
 namespace eudaq {
 
+  class Arena;
+
   class InterruptedException : public std::exception {
     const char * what() const throw() { return "InterruptedException"; }
   };
 
+  /** Marks the primitive types whose in-memory representation is identical
+   *  to their serialized form (least significant byte first, no padding).
+   *  Contiguous arrays of these types can then be (de)serialized as one block
+   *  instead of element by element. On big-endian hosts this is never the case,
+   *  so they fall back to the per-element path which swaps the bytes.
+   */
+  template <typename T>
+    struct BulkSerializable { enum { value = 0 }; };
+
+#define EUDAQ_BULK_SERIALIZABLE(T) \
+  template <> struct BulkSerializable<T> { enum { value = EUDAQ_LITTLE_ENDIAN }; }
+  EUDAQ_BULK_SERIALIZABLE(char);
+  EUDAQ_BULK_SERIALIZABLE(signed char);
+  EUDAQ_BULK_SERIALIZABLE(unsigned char);
+  EUDAQ_BULK_SERIALIZABLE(short);
+  EUDAQ_BULK_SERIALIZABLE(unsigned short);
+  EUDAQ_BULK_SERIALIZABLE(int);
+  EUDAQ_BULK_SERIALIZABLE(unsigned int);
+  EUDAQ_BULK_SERIALIZABLE(long);
+  EUDAQ_BULK_SERIALIZABLE(unsigned long);
+  EUDAQ_BULK_SERIALIZABLE(long long);
+  EUDAQ_BULK_SERIALIZABLE(unsigned long long);
+  EUDAQ_BULK_SERIALIZABLE(float);
+  EUDAQ_BULK_SERIALIZABLE(double);
+#undef EUDAQ_BULK_SERIALIZABLE
+
+  template <typename T, bool BULK = BulkSerializable<T>::value>
+    struct VectorHelper;
+
+  /** Base class for anything that owns memory referenced by a ByteView.
+   *  The reference count is atomic, as views are passed between threads
+   *  (e.g. from a reading or decoding thread to the one using the event).
+   */
+  class BufferOwner {
+    public:
+      BufferOwner() {}
+      virtual ~BufferOwner() {}
+      /// For EventPtr, which deletes the owner once Release returns true
+      void AddRef() const { m_refs.Acquire(); }
+      bool Release() const { return m_refs.Release(); }
+      size_t RefCount() const { return m_refs.Count(); }
+    private:
+      BufferOwner(const BufferOwner &);
+      BufferOwner & operator = (const BufferOwner &);
+      mutable eudaq::RefCount m_refs;
+  };
+
+  /** Owns a container (std::string or std::vector) of bytes on behalf of ByteViews.
+   */
+  template <typename C>
+    class BufferHolder : public BufferOwner {
+      public:
+        C data;
+    };
+
+  /** A read-only range of bytes.
+   *  If the range belongs to a shared buffer, the view (and every copy of it)
+   *  keeps that buffer alive, so the bytes can be referenced in place instead
+   *  of being copied out.
+   */
+  class ByteView {
+    public:
+      ByteView() : m_data(0), m_size(0) {}
+      ByteView(const unsigned char * data, size_t size,
+          const EventPtr<BufferOwner> & owner = EventPtr<BufferOwner>())
+        : m_data(data), m_size(size), m_owner(owner) {}
+
+      /** Takes over the contents of a container (leaving it empty)
+       *  without copying, and returns a shared view of them.
+       */
+      template <typename C>
+        static ByteView Adopt(C & container) {
+          BufferHolder<C> * holder = new BufferHolder<C>;
+          EventPtr<BufferOwner> owner(holder);
+          holder->data.swap(container);
+          const unsigned char * data = holder->data.empty() ? 0 :
+            reinterpret_cast<const unsigned char *>(&holder->data[0]);
+          return ByteView(data, holder->data.size(), owner);
+        }
+
+      typedef const unsigned char * const_iterator;
+
+      const unsigned char * data() const { return m_data; }
+      size_t size() const { return m_size; }
+      bool empty() const { return m_size == 0; }
+      const unsigned char & operator [] (size_t i) const { return m_data[i]; }
+      const_iterator begin() const { return m_data; }
+      const_iterator end() const { return m_data + m_size; }
+      bool IsShared() const { return m_owner.get() != 0; }
+      ByteView Slice(size_t offset, size_t len) const {
+        return ByteView(m_data + offset, len, m_owner);
+      }
+    private:
+      const unsigned char * m_data;
+      size_t m_size;
+      EventPtr<BufferOwner> m_owner;
+  };
+
   class DLLEXPORT Serializer {
     public:
       virtual void Flush() {}
       void write(const Serializable & t) {
         t.Serialize(*this);
       }
+      /** Writes a block of bytes in the same format as a std::vector<unsigned char>.
+       */
+      void write(const ByteView & t) {
+        write((unsigned)t.size());
+        if (t.size()) Serialize(t.data(), t.size());
+      }
       template<typename T>
         void write(const T & t);
       template<typename T>
         void write(const std::vector<T> & t);
+      /** Writes n values without their number in front, so that a vector
+       *  can be written in pieces after writing its length.
+       */
+      template<typename T>
+        void write(const T * t, size_t n);
       template<typename T, typename U>
         void write(const std::map<T, U> & t);
       template<typename T, typename U>
@@ -35,6 +148,8 @@ namespace eudaq {
     private:
       template <typename T>
         friend struct WriteHelper;
+      template <typename T, bool BULK>
+        friend struct VectorHelper;
       virtual void Serialize(const unsigned char *, size_t) = 0;
   };
 
@@ -50,6 +165,9 @@ namespace eudaq {
         v.Serialize(sr);
       }
       static void write_int(Serializer & sr, const T & v) {
+#if EUDAQ_LITTLE_ENDIAN
+        sr.Serialize(reinterpret_cast<const unsigned char *>(&v), sizeof v);
+#else
         T t = v;
         unsigned char buf[sizeof t];
         for (size_t i = 0; i < sizeof t; ++i) {
@@ -57,6 +175,7 @@ namespace eudaq {
           t >>= 8;
         }
         sr.Serialize(buf, sizeof t);
+#endif
       }
       static void write_float(Serializer & sr, const float & v) {
         unsigned t = *(unsigned *)&v;
@@ -99,9 +218,12 @@ namespace eudaq {
     inline void Serializer::write(const std::vector<T> & t) {
       unsigned len = t.size();
       write(len);
-      for (size_t i = 0; i < len; ++i) {
-        write(t[i]);
-      }
+      VectorHelper<T>::write(*this, t);
+    }
+
+  template <typename T>
+    inline void Serializer::write(const T * t, size_t n) {
+      VectorHelper<T>::write(*this, t, n);
     }
 
   template <>
@@ -134,9 +256,14 @@ namespace eudaq {
 
   class DLLEXPORT Deserializer {
     public:
-      Deserializer() : m_interrupting(false) {}
+      Deserializer() : m_interrupting(false), m_arena(0) {}
       virtual bool HasData() = 0;
       void Interrupt() { m_interrupting = true; }
+      /** Events read from here are allocated from this arena (see Arena),
+       *  which must outlive the call that reads them.
+       */
+      void SetArena(Arena * arena) { m_arena = arena; }
+      Arena * GetArena() const { return m_arena; }
 
       template <typename T>
         void read(T & t);
@@ -157,12 +284,33 @@ namespace eudaq {
           return t;
         }
 
+      /** Reads a block of bytes written as a std::vector<unsigned char>.
+       *  If the underlying storage is a shared buffer (see CanView) the result
+       *  refers to the bytes in place, otherwise they are copied into a new buffer.
+       */
+      void read(ByteView & t) {
+        unsigned len = 0;
+        read(len);
+        if (CanView() && View(len, t)) return;
+        std::vector<unsigned char> data(len);
+        if (len) Deserialize(&data[0], len);
+        t = ByteView::Adopt(data);
+      }
+
+      /** Returns true if byte blocks can be read as views without copying.
+       */
+      virtual bool CanView() const { return false; }
+
       virtual ~Deserializer() {}
     protected:
       bool m_interrupting;
     private:
+      Arena * m_arena;
+      virtual bool View(size_t /*len*/, ByteView & /*view*/) { return false; }
       template <typename T>
         friend struct ReadHelper;
+      template <typename T, bool BULK>
+        friend struct VectorHelper;
       virtual void Deserialize(unsigned char *, size_t) = 0;
   };
 
@@ -178,6 +326,10 @@ namespace eudaq {
         return T(ds);
       }
       static T read_int(Deserializer & ds) {
+#if EUDAQ_LITTLE_ENDIAN
+        T t;
+        ds.Deserialize(reinterpret_cast<unsigned char *>(&t), sizeof t);
+#else
         unsigned char buf[sizeof (T)];
         ds.Deserialize(buf, sizeof (T));
         T t = 0;
@@ -185,6 +337,7 @@ namespace eudaq {
           t <<= 8;
           t += buf[sizeof t - 1 - i];
         }
+#endif
         return t;
       }
       static float read_float(Deserializer & ds) {
@@ -232,14 +385,53 @@ namespace eudaq {
       t = Time(sec, usec);
     }
 
+  /** Transfers the elements of a std::vector one at a time.
+   */
+  template <typename T, bool BULK>
+    struct VectorHelper {
+      static void write(Serializer & sr, const std::vector<T> & t) {
+        for (size_t i = 0; i < t.size(); ++i) {
+          sr.write(t[i]);
+        }
+      }
+      static void write(Serializer & sr, const T * t, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+          sr.write(t[i]);
+        }
+      }
+      static void read(Deserializer & ds, std::vector<T> & t, size_t len) {
+        t.reserve(t.size() + len);
+        for (size_t i = 0; i < len; ++i) {
+          t.push_back(ds.read<T>());
+        }
+      }
+    };
+
+  /** Transfers the elements of a std::vector as one contiguous block of memory.
+   */
+  template <typename T>
+    struct VectorHelper<T, true> {
+      static void write(Serializer & sr, const std::vector<T> & t) {
+        if (t.empty()) return;
+        sr.Serialize(reinterpret_cast<const unsigned char *>(&t[0]), t.size() * sizeof (T));
+      }
+      static void write(Serializer & sr, const T * t, size_t n) {
+        if (!n) return;
+        sr.Serialize(reinterpret_cast<const unsigned char *>(t), n * sizeof (T));
+      }
+      static void read(Deserializer & ds, std::vector<T> & t, size_t len) {
+        if (!len) return;
+        size_t offset = t.size();
+        t.resize(offset + len);
+        ds.Deserialize(reinterpret_cast<unsigned char *>(&t[offset]), len * sizeof (T));
+      }
+    };
+
   template <typename T>
     inline void Deserializer::read(std::vector<T> & t) {
       unsigned len = 0;
       read(len);
-      t.reserve(len);
-      for (size_t i = 0; i < len; ++i) {
-        t.push_back(read<T>());
-      }
+      VectorHelper<T>::read(*this, t, len);
     }
 
   template <>
@@ -7,6 +7,30 @@
 
 namespace eudaq {
 
+  class CompactPlane;
+
+  /** A pointer to something cached in the object holding it. A copy of the
+   *  object starts out with nothing cached, instead of pointing into the
+   *  original.
+   */
+  template <typename T>
+    class CachePtr {
+      public:
+        CachePtr(const T * p = 0) : m_ptr(p) {}
+        CachePtr(const CachePtr &) : m_ptr(0) {}
+        CachePtr & operator = (const CachePtr &) { m_ptr = 0; return *this; }
+        CachePtr & operator = (const T * p) { m_ptr = p; return *this; }
+        const T & operator * () const { return *m_ptr; }
+        const T * operator -> () const { return m_ptr; }
+        operator const T * () const { return m_ptr; }
+      private:
+        const T * m_ptr;
+    };
+
+  /** The hits of one sensor plane, in one or more frames.
+   *  It is serialized in the CompactPlane layout when the coordinates allow,
+   *  otherwise as nested vectors of doubles.
+   */
   class DLLEXPORT StandardPlane : public Serializable {
     public:
       enum FLAGS { FLAG_ZS = 0x1, // Data are zero suppressed
@@ -25,6 +49,8 @@ namespace eudaq {
       StandardPlane(Deserializer &);
       StandardPlane();
       void Serialize(Serializer &) const;
+      /// Empties the plane for reuse, keeping the memory allocated for its hits
+      void Reset(unsigned id, const std::string & type, const std::string & sensor = "");
       void SetSizeRaw(unsigned w, unsigned h,
           unsigned frames = 1, int flags = 0);
       void SetSizeZS(unsigned w, unsigned h, unsigned npix,
@@ -50,6 +76,21 @@ namespace eudaq {
           PushPixelHelper(x, y, (double)pix, false, frame);
         }
 
+      /** Fills the frames of a raw plane for n pixels, in whatever order
+       *  they were read out: pixel (x[k], y[k]) gets pivot flag pivot[k]
+       *  (0 or 1) and the value frames[f][k] in frame f. If the plane needs
+       *  CDS and every pixel is filled, the CDS is worked out in the same
+       *  pass, so that GetPixels does not need to.
+       */
+      void SetRawPixels(size_t n, const unsigned short * x, const unsigned short * y,
+          const unsigned char * pivot, const short * const * frames);
+      /** Appends n pixels of the same value to a frame, with their
+       *  coordinates and, if the plane has them, pivot flags (0 or 1) given
+       *  as arrays. Quicker than pushing them one by one.
+       */
+      void PushPixels(unsigned frame, size_t n, const unsigned short * x, const unsigned short * y,
+          double pix, const unsigned char * pivot = 0);
+
       void SetPixelHelper(unsigned index, unsigned x, unsigned y,
           double pix, bool pivot, unsigned frame);
       void PushPixelHelper(unsigned x, unsigned y,
@@ -72,6 +113,16 @@ namespace eudaq {
 		  }
 		  return result;
 	  }
+      /// As above, but reusing the memory of result
+      template <typename T>
+        void GetPixels(std::vector<T> & result) const {
+          SetupResult();
+          result.resize(m_result_pix->size());
+          const int polarity = Polarity();
+          for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = static_cast<T>((*m_result_pix)[i] * polarity);
+          }
+        }
       const std::vector<coord_t> & XVector(unsigned frame) const;
       const std::vector<coord_t> & XVector() const;
       const std::vector<coord_t> & YVector(unsigned frame) const;
@@ -103,6 +154,7 @@ namespace eudaq {
 
       void Print(std::ostream &) const;
     private:
+      friend class CompactPlane;
       const std::vector<pixel_t> & GetFrame(const std::vector<std::vector<pixel_t> > & v, unsigned f) const;
       void SetupResult() const;
 
@@ -115,8 +167,8 @@ namespace eudaq {
       std::vector<std::vector<bool> > m_pivot;
       std::vector<unsigned> m_mat;
 
-      mutable const std::vector<pixel_t> * m_result_pix;
-      mutable const std::vector<coord_t> * m_result_x, * m_result_y;
+      mutable CachePtr<std::vector<pixel_t> > m_result_pix;
+      mutable CachePtr<std::vector<coord_t> > m_result_x, m_result_y;
 
       mutable std::vector<pixel_t> m_temp_pix;
       mutable std::vector<coord_t> m_temp_x, m_temp_y;
@@ -131,7 +183,15 @@ namespace eudaq {
     StandardEvent(Deserializer &);
     void SetTimestamp(unsigned long long);
 
+    /** Empties the event for reuse with the header (numbers, flags and tags)
+     *  of another event. The planes keep their memory for the next event.
+     */
+    void Reset(const Event &);
     StandardPlane & AddPlane(const StandardPlane &);
+    /// Adds an empty plane to be filled in place, reusing one from before a Reset if possible
+    StandardPlane & NewPlane(unsigned id, const std::string & type, const std::string & sensor = "");
+    /// Removes the last plane added, for when it could not be filled
+    void PopPlane();
     size_t NumPlanes() const;
     const StandardPlane & GetPlane(size_t i) const;
     StandardPlane & GetPlane(size_t i);
@@ -139,7 +199,8 @@ namespace eudaq {
     virtual void Print(std::ostream &) const;
 
     private:
-    std::vector<StandardPlane> m_planes;
+    std::vector<StandardPlane> m_planes; ///< Only the first m_numplanes are in use
+    size_t m_numplanes;
   };
 
   inline std::ostream & operator << (std::ostream & os,
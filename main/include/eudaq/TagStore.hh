@@ -0,0 +1,136 @@
+#ifndef EUDAQ_INCLUDED_TagStore
+#define EUDAQ_INCLUDED_TagStore
+
+/**
+ * \file TagStore.hh
+ * Compact storage for the metadata tags of an Event.
+ */
+
+#include "eudaq/Serializable.hh"
+#include "eudaq/Serializer.hh"
+#include "eudaq/Utils.hh"
+#include "eudaq/Platform.hh"
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace eudaq {
+
+  /** The value of a tag. Numbers are kept as numbers, so reading one back
+   *  as a number needs no parsing; they are only turned into text to be
+   *  written out or read as a string.
+   */
+  class DLLEXPORT TagValue {
+    public:
+      enum Kind { TEXT, SIGNED, UNSIGNED, REAL };
+      TagValue() : m_kind(TEXT) {}
+      TagValue(const std::string & text) : m_kind(TEXT), m_text(text) {}
+      TagValue(const char * text) : m_kind(TEXT), m_text(text) {}
+      TagValue(int value) : m_kind(SIGNED) { m_num.s = value; }
+      TagValue(long value) : m_kind(SIGNED) { m_num.s = value; }
+      TagValue(long long value) : m_kind(SIGNED) { m_num.s = value; }
+      TagValue(unsigned value) : m_kind(UNSIGNED) { m_num.u = value; }
+      TagValue(unsigned long value) : m_kind(UNSIGNED) { m_num.u = value; }
+      TagValue(unsigned long long value) : m_kind(UNSIGNED) { m_num.u = value; }
+      TagValue(float value) : m_kind(REAL) { m_num.d = value; }
+      TagValue(double value) : m_kind(REAL) { m_num.d = value; }
+      /// Anything else is stored as the text to_string gives
+      template <typename T>
+        TagValue(const T & value) : m_kind(TEXT), m_text(to_string(value)) {}
+
+      Kind GetKind() const { return m_kind; }
+      /// The value as it is serialized
+      std::string Text() const;
+      /// The value as a T, or def if it is empty, as from_string would give
+      template <typename T>
+        T Get(const T & def) const;
+      /// A number as a T (only for numeric types)
+      template <typename T>
+        T Number() const {
+          switch (m_kind) {
+            case SIGNED: return static_cast<T>(m_num.s);
+            case UNSIGNED: return static_cast<T>(m_num.u);
+            default: return static_cast<T>(m_num.d);
+          }
+        }
+    private:
+      Kind m_kind;
+      union {
+        long long s;
+        unsigned long long u;
+        double d;
+      } m_num;
+      std::string m_text; ///< Only for TEXT
+  };
+
+  /// Converts a tag value to a T by way of its text; specialised below for numbers
+  template <typename T>
+    struct TagConvert {
+      static T Get(const TagValue & v, const T & def) { return from_string(v.Text(), def); }
+    };
+
+#define EUDAQ_TAG_NUMBER(T)                                           \
+  template <>                                                         \
+    struct TagConvert<T> {                                            \
+      static T Get(const TagValue & v, const T & def) {               \
+        if (v.GetKind() == TagValue::TEXT) return from_string(v.Text(), def); \
+        return v.Number<T>();                                         \
+      }                                                               \
+    }
+
+  EUDAQ_TAG_NUMBER(short);
+  EUDAQ_TAG_NUMBER(unsigned short);
+  EUDAQ_TAG_NUMBER(int);
+  EUDAQ_TAG_NUMBER(unsigned);
+  EUDAQ_TAG_NUMBER(long);
+  EUDAQ_TAG_NUMBER(unsigned long);
+  EUDAQ_TAG_NUMBER(long long);
+  EUDAQ_TAG_NUMBER(unsigned long long);
+  EUDAQ_TAG_NUMBER(float);
+  EUDAQ_TAG_NUMBER(double);
+
+#undef EUDAQ_TAG_NUMBER
+
+  template <typename T>
+    inline T TagValue::Get(const T & def) const {
+      return TagConvert<T>::Get(*this, def);
+    }
+
+  /** The tags of an event, as a flat vector sorted by name.
+   *  Names are interned: each distinct name is stored once for the whole
+   *  process, and events only point to it, so tags are matched by comparing
+   *  pointers. Interning takes a lock only the first time the process sees
+   *  a name, after that setting or finding a tag with that name takes none.
+   *  It is serialized in the same way as a std::map of strings.
+   */
+  class DLLEXPORT TagStore : public Serializable {
+    public:
+      typedef const std::string * name_t;
+      TagStore() {}
+      TagStore(Deserializer &);
+      void Serialize(Serializer &) const;
+
+      /// The shared copy of name, which stays valid for the lifetime of the process
+      static name_t Intern(const std::string & name);
+      /// The shared copy of name if it has been interned, otherwise 0
+      static name_t Lookup(const std::string & name);
+
+      void Set(const std::string & name, const TagValue & value);
+      /// Returns 0 if there is no such tag
+      const TagValue * Find(const std::string & name) const;
+      bool Empty() const { return m_tags.empty(); }
+      size_t Size() const { return m_tags.size(); }
+      const std::string & Name(size_t i) const { return *m_tags[i].first; }
+      const TagValue & Value(size_t i) const { return m_tags[i].second; }
+    private:
+      typedef std::pair<name_t, TagValue> tag_t;
+      /// The position of name, or where it would be inserted
+      size_t Position(const std::string & name) const;
+      /// The position of the tag with an interned name, or the number of tags if there is none
+      size_t Position(name_t name) const;
+      std::vector<tag_t> m_tags;
+  };
+
+}
+
+#endif // EUDAQ_INCLUDED_TagStore
@@ -21,7 +21,8 @@ namespace eudaq {
    */
   class ConnectionInfo {
     public:
-      explicit ConnectionInfo(const std::string & name = "") : m_state(0), m_name(name) {}
+      static const unsigned NOHANDLE = (unsigned)-1;
+      explicit ConnectionInfo(const std::string & name = "") : m_state(0), m_name(name), m_handle(NOHANDLE) {}
       virtual ~ConnectionInfo() {}
       virtual void Print(std::ostream &) const;
       virtual bool Matches(const ConnectionInfo & other) const;
@@ -32,6 +33,9 @@ namespace eudaq {
       void SetType(const std::string & type) { m_type = type; }
       std::string GetName() const { return m_name; }
       void SetName(const std::string & name) { m_name = name; }
+      /// A number the user of the transport may assign to the connection to find its own data directly
+      unsigned GetHandle() const { return m_handle; }
+      void SetHandle(unsigned handle) { m_handle = handle; }
       virtual std::string GetRemote() const { return ""; }
       static const ConnectionInfo ALL;
 
@@ -39,6 +43,7 @@ namespace eudaq {
     protected:
       int m_state;
       std::string m_type, m_name;
+      unsigned m_handle;
       /*
          public:
          virtual bool operator = (const ClientID & other) = 0;
@@ -166,6 +171,11 @@ namespace eudaq {
        */
       virtual void Close(const ConnectionInfo &) {}
 
+      /** Waits until all the data queued for sending has been passed on.
+       * Only Transports that queue outgoing data need to implement it.
+       */
+      virtual void Flush() {}
+
       /** Pure virtual function to receive data.
        * This function must be implemented by the concrete Transport class to receive
        * all pending data from the remote Transport instance, and fill the queue of
@@ -0,0 +1,96 @@
+#ifndef EUDAQ_INCLUDED_TransportSHM
+#define EUDAQ_INCLUDED_TransportSHM
+
+#include "eudaq/TransportFactory.hh"
+#include "eudaq/Platform.hh"
+#include "eudaq/Time.hh"
+
+#include <vector>
+#include <string>
+
+#if EUDAQ_PLATFORM_IS(LINUX)
+
+namespace eudaq {
+
+  struct ShmSegment;
+  struct ShmSlot;
+
+  /** A connection through a shared memory segment.
+   *  Each connection owns one slot of the segment, holding a single-producer
+   *  single-consumer ring in each direction. Packets are framed as in the TCP
+   *  transport, with a 4 byte length in front, and may be larger than the ring:
+   *  they are reassembled here as they trickle through.
+   */
+  class ConnectionInfoSHM : public ConnectionInfo {
+    public:
+      ConnectionInfoSHM(ShmSlot * slot = 0, unsigned index = 0, unsigned serial = 0, const std::string & host = "")
+        : m_slot(slot), m_index(index), m_serial(serial), m_host(host), m_hdrfill(0), m_len(0), m_fill(0) {}
+      ShmSlot * GetSlot() const { return m_slot; }
+      unsigned GetIndex() const { return m_index; }
+      /// Reads the data pending in the ring into packets, returns the number of packets completed
+      size_t receive(bool server, std::queue<TransportEvent> & events);
+      void Disable();
+      virtual bool Matches(const ConnectionInfo & other) const;
+      virtual void Print(std::ostream &) const;
+      virtual std::string GetRemote() const { return m_host; }
+      virtual ConnectionInfo * Clone() const;
+    private:
+      ShmSlot * m_slot;
+      unsigned m_index, m_serial;
+      std::string m_host;
+      unsigned char m_hdr[4];
+      size_t m_hdrfill, m_len, m_fill;
+      std::string m_packet; ///< the packet being reassembled, m_fill bytes of m_len received
+  };
+
+  /** A server for producers running on the same host.
+   *  It creates a POSIX shared memory segment named after the parameter
+   *  (shm://name), in which clients claim a slot to connect.
+   *  Data then moves between the processes without any system call,
+   *  a semaphore is only used to wake up a side that went to sleep.
+   */
+  class SHMServer : public TransportServer {
+    public:
+      SHMServer(const std::string & param);
+      virtual ~SHMServer();
+
+      virtual void Close(const ConnectionInfo & id);
+      virtual void SendPacket(const unsigned char * data, size_t len,
+          const ConnectionInfo & id = ConnectionInfo::ALL,
+          bool duringconnect = false);
+      virtual void ProcessEvents(int timeout);
+
+      virtual std::string ConnectionString() const;
+      static const std::string name;
+    private:
+      /// Handles connects, data and disconnects on all slots, returns true if any events were queued
+      bool Poll();
+      void Disconnect(unsigned slot);
+      std::string m_name;
+      ShmSegment * m_seg;
+      unsigned m_serial;
+      std::vector<ConnectionInfoSHM *> m_active; ///< the connection on each slot, or null
+      Time m_lastcheck; ///< when the connected processes were last checked to be alive
+  };
+
+  class SHMClient : public TransportClient {
+    public:
+      SHMClient(const std::string & param);
+      virtual ~SHMClient();
+
+      virtual void SendPacket(const unsigned char * data, size_t len,
+          const ConnectionInfo & id = ConnectionInfo::ALL,
+          bool = false);
+      virtual void ProcessEvents(int timeout = -1);
+    private:
+      std::string m_name;
+      ShmSegment * m_seg;
+      ShmSlot * m_slot;
+      ConnectionInfoSHM m_buf;
+  };
+
+}
+
+#endif
+
+#endif // EUDAQ_INCLUDED_TransportSHM
@@ -3,6 +3,8 @@
 
 #include "eudaq/TransportFactory.hh"
 #include "eudaq/Platform.hh"
+#include "eudaq/Mutex.hh"
+#include "eudaq/counted_ptr.hh"
 
 #if EUDAQ_PLATFORM_IS(WIN32) || EUDAQ_PLATFORM_IS(MINGW)
 # include <winsock2.h>
@@ -17,24 +19,63 @@ typedef int SOCKET;
 
 namespace eudaq {
 
+  /** Holds the state of a TCP connection, and reassembles the received
+   *  length-prefixed packets.
+   *  Received data is written directly into the connection's buffer (see
+   *  getspace() and received()). Packets that do not fit into that buffer are
+   *  received straight into a string of their own, which is then handed over
+   *  without any further copy.
+   *  Outgoing data that the socket cannot take right away is kept in a
+   *  bounded queue, and later packets go behind it. The queue is sent on by
+   *  later sends, while processing events and by flush(), so a send only
+   *  waits for the socket while the queue is full. Sending is safe from
+   *  several threads at once.
+   */
   class ConnectionInfoTCP : public ConnectionInfo {
     public:
-      ConnectionInfoTCP(SOCKET fd, const std::string & host = "") : m_fd(fd), m_host(host), m_len(0), m_buf("") {}
+      ConnectionInfoTCP(SOCKET fd, const std::string & host = "")
+        : m_fd(fd), m_host(host), m_len(0), m_havelen(false), m_pos(0), m_end(0), m_inbig(false), m_bigfill(0),
+        m_send(new SendQueue) {}
       void append(size_t length, const char * data);
+      /// Returns where up to len bytes of received data can be written
+      char * getspace(size_t & len);
+      /// Accounts for length bytes written to the space returned by getspace()
+      void received(size_t length);
       bool havepacket() const;
       std::string getpacket();
+      /// Moves the next packet into packet, replacing its contents
+      void getpacket(std::string & packet);
+      /// Sends a length-prefixed packet, queueing what cannot be sent without blocking
+      void sendpacket(const unsigned char * data, size_t len);
+      /// Sends queued data, waiting for the socket if wait is true; returns true once nothing is left in the queue
+      bool flush(bool wait = false);
+      bool havequeued() const;
       SOCKET GetFd() const { return m_fd; }
-      void Disable() { m_state = -1; m_len = 0; m_buf = ""; }
+      void Disable();
       virtual bool Matches(const ConnectionInfo & other) const;
       virtual void Print(std::ostream &) const;
       virtual std::string GetRemote() const { return m_host; }
-      virtual ConnectionInfo * Clone() const { return new ConnectionInfoTCP(*this); }
+      virtual ConnectionInfo * Clone() const;
     private:
-      void update_length(bool = false);
+      struct SendQueue {
+        SendQueue() : pos(0) {}
+        Mutex lock;
+        std::string buf; ///< data still to be sent is in [pos, end)
+        size_t pos;
+      };
+      void update_length();
+      /// Sends queued data, with the queue locked, waiting for the socket while more than keep bytes are left
+      bool sendqueued(size_t keep);
       SOCKET m_fd;
       std::string m_host;
       size_t m_len;
-      std::string m_buf;
+      bool m_havelen;
+      std::string m_buf; ///< received data not yet returned as packets is in [m_pos, m_end)
+      size_t m_pos, m_end;
+      std::string m_big; ///< the packet being received, if it is too large for m_buf
+      bool m_inbig;
+      size_t m_bigfill;
+      counted_ptr<SendQueue> m_send; ///< shared with copies, as they use the same socket
   };
 
   class TCPServer : public TransportServer {
@@ -47,6 +88,7 @@ namespace eudaq {
           const ConnectionInfo & id = ConnectionInfo::ALL,
           bool duringconnect = false);
       virtual void ProcessEvents(int timeout);
+      virtual void Flush();
 
       virtual std::string ConnectionString() const;
       static const std::string name;
@@ -61,6 +103,41 @@ namespace eudaq {
       //map_t m_map;
   };
 
+#if EUDAQ_PLATFORM_IS(LINUX)
+  /** A TCP server that waits on its sockets with epoll instead of select.
+   *  Each socket is registered together with its connection, so ready sockets
+   *  are dispatched without searching.
+   *  It uses the same protocol as TCPServer, so clients connect with a TCPClient.
+   */
+  class EpollServer : public TransportServer {
+    public:
+      EpollServer(const std::string & param);
+      virtual ~EpollServer();
+
+      virtual void Close(const ConnectionInfo & id);
+      virtual void SendPacket(const unsigned char * data, size_t len,
+          const ConnectionInfo & id = ConnectionInfo::ALL,
+          bool duringconnect = false);
+      virtual void ProcessEvents(int timeout);
+      virtual void Flush();
+
+      virtual std::string ConnectionString() const;
+      static const std::string name;
+    private:
+      void Accept();
+      /// Reads all pending data, returns true if any complete packets were queued
+      bool Receive(ConnectionInfoTCP & info);
+      /// Sets whether to wake up when the connection can take more outgoing data
+      void Watch(ConnectionInfoTCP & info, bool output);
+      void Disconnect(ConnectionInfoTCP & info);
+      int m_port;
+      SOCKET m_srvsock;
+      int m_epfd;
+      /// Connections whose slot was reused, kept until no queued events refer to them
+      std::vector<counted_ptr<ConnectionInfo> > m_retired;
+  };
+#endif
+
   class TCPClient: public TransportClient {
     public:
       TCPClient(const std::string & param);
@@ -70,6 +147,7 @@ namespace eudaq {
           const ConnectionInfo & id = ConnectionInfo::ALL,
           bool = false);
       virtual void ProcessEvents(int timeout = -1);
+      virtual void Flush();
     private:
       void OpenConnection();
       std::string m_server;
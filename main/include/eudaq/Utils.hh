@@ -29,6 +29,10 @@ namespace eudaq {
    * \param ms The number of milliseconds
    */
   void DLLEXPORT mSleep(unsigned ms);
+  /// The number of processors online, at least 1
+  unsigned DLLEXPORT NumProcessors();
+  /// Whether the processor has AVX2, and the build can make use of it
+  bool DLLEXPORT CpuHasAVX2();
 
   /** Converts any type to a string.
    * There must be a compatible streamer defined, which this function will make use of.
@@ -185,6 +189,17 @@ namespace eudaq {
     return constuchar_cast(&x[0]);
   }
 
+  /** Defined to 1 if the host stores integers least significant byte first,
+   * which is the byte order used by the Serializer.
+   */
+#if (defined(       __BYTE_ORDER) &&        __BYTE_ORDER ==        __LITTLE_ENDIAN) || \
+  (defined(__DARWIN_BYTE_ORDER) && __DARWIN_BYTE_ORDER == __DARWIN_LITTLE_ENDIAN) || \
+  defined(_WIN32)
+# define EUDAQ_LITTLE_ENDIAN 1
+#else
+# define EUDAQ_LITTLE_ENDIAN 0
+#endif
+
   template <typename T>
     inline T getbigendian(const unsigned char * ptr) {
 #if (defined(       __BYTE_ORDER) &&        __BYTE_ORDER ==        __BIG_ENDIAN) || \
@@ -0,0 +1,131 @@
+#include "eudaq/Arena.hh"
+#include <cstdlib>
+
+namespace eudaq {
+
+  namespace {
+    /// Every allocation is aligned to this
+    static const size_t ALIGNMENT = 16;
+
+    size_t RoundUp(size_t bytes) {
+      return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+  }
+
+  Arena * Arena::Create(size_t bytes) {
+    // the arena itself goes at the start of its own block
+    const size_t header = RoundUp(sizeof (Arena));
+    bytes = RoundUp(bytes);
+    char * block = static_cast<char *>(std::malloc(header + bytes));
+    if (!block) throw std::bad_alloc();
+    return new (block) Arena(block + header, bytes);
+  }
+
+  Arena::Arena(char * data, size_t bytes)
+    : m_refs(1), m_used(0), m_full(0), m_data(data), m_capacity(bytes) {}
+
+  void * Arena::Allocate(size_t bytes) {
+    bytes = RoundUp(bytes);
+    size_t used = m_used.load();
+    do {
+      if (bytes > m_capacity - used) {
+        m_full.store(1);
+        return 0;
+      }
+    } while (!m_used.compare_exchange(used, used + bytes));
+    return m_data + used;
+  }
+
+  size_t Arena::Used() const {
+    return m_used.load();
+  }
+
+  void Arena::Release() {
+    if (m_refs.fetch_sub(1) == 1) {
+      this->~Arena();
+      std::free(this);
+    }
+  }
+
+#if EUDAQ_COUNT_ALLOCATIONS
+  namespace {
+    Atomic<unsigned long long> & AllocationCounter() {
+      static Atomic<unsigned long long> counter;
+      return counter;
+    }
+
+    void * CountedAllocate(std::size_t size) {
+      AllocationCounter().fetch_add(1);
+      void * p = std::malloc(size ? size : 1);
+      if (!p) throw std::bad_alloc();
+      return p;
+    }
+  }
+
+  unsigned long long HeapAllocations() {
+    return AllocationCounter().load();
+  }
+
+#else
+
+  unsigned long long HeapAllocations() {
+    return 0;
+  }
+
+#endif
+
+}
+
+#if EUDAQ_COUNT_ALLOCATIONS
+// counting replacements for the global allocation functions, for measuring only
+#if __cplusplus >= 201103L
+#  define EUDAQ_THROW_BAD_ALLOC
+#  define EUDAQ_NOTHROW noexcept
+#else
+#  define EUDAQ_THROW_BAD_ALLOC throw(std::bad_alloc)
+#  define EUDAQ_NOTHROW throw()
+#endif
+
+void * operator new(std::size_t size) EUDAQ_THROW_BAD_ALLOC {
+  return eudaq::CountedAllocate(size);
+}
+
+void * operator new[](std::size_t size) EUDAQ_THROW_BAD_ALLOC {
+  return eudaq::CountedAllocate(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) EUDAQ_NOTHROW {
+  try {
+    return eudaq::CountedAllocate(size);
+  } catch (...) {
+    return 0;
+  }
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) EUDAQ_NOTHROW {
+  try {
+    return eudaq::CountedAllocate(size);
+  } catch (...) {
+    return 0;
+  }
+}
+
+void operator delete(void * p) EUDAQ_NOTHROW {
+  std::free(p);
+}
+
+void operator delete[](void * p) EUDAQ_NOTHROW {
+  std::free(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) EUDAQ_NOTHROW {
+  std::free(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) EUDAQ_NOTHROW {
+  std::free(p);
+}
+
+#undef EUDAQ_THROW_BAD_ALLOC
+#undef EUDAQ_NOTHROW
+#endif
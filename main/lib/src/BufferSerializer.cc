@@ -29,4 +29,31 @@ namespace eudaq {
     //std::cout << "Remaining: " << (end()-begin()) << /*" \"" << tmp << "\"" <<*/ std::endl;
   }
 
+  void BufferDeserializer::Seek(size_t offset) {
+    if (offset > m_data.size()) {
+      EUDAQ_THROW("Seek to " + to_string(offset) + " beyond end of buffer (" + to_string(m_data.size()) + ")");
+    }
+    m_offset = offset;
+  }
+
+  void BufferDeserializer::Deserialize(unsigned char * data, size_t len) {
+    if (!len) return;
+    if (len > m_data.size() - m_offset) {
+      EUDAQ_THROW("Deserialize asked for " + to_string(len) +
+          ", only have " + to_string(m_data.size()-m_offset));
+    }
+    std::copy(m_data.data() + m_offset, m_data.data() + m_offset + len, data);
+    m_offset += len;
+  }
+
+  bool BufferDeserializer::View(size_t len, ByteView & view) {
+    if (len > m_data.size() - m_offset) {
+      EUDAQ_THROW("Deserialize asked for " + to_string(len) +
+          ", only have " + to_string(m_data.size()-m_offset));
+    }
+    view = m_data.Slice(m_offset, len);
+    m_offset += len;
+    return true;
+  }
+
 }
@@ -0,0 +1,329 @@
+#include "eudaq/CompactPlane.hh"
+#include "eudaq/Exception.hh"
+
+namespace eudaq {
+
+  namespace {
+    static const unsigned PIVOTBITS = 32;
+
+    template <typename T>
+      void CopyColumn(const std::vector<T> & src, size_t begin, size_t end, std::vector<double> & dest) {
+        dest.resize(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+          dest[i - begin] = src[i];
+        }
+      }
+
+    /** True if v is an integer in lo-hi. Written without branches (the
+     *  conversion is of a value already clamped into range), so that the
+     *  loops checking whole columns can be vectorized.
+     */
+    inline bool IsInt(double v, double lo, double hi) {
+      double c = v > lo ? v : lo;
+      c = c < hi ? c : hi;
+      return (double)(int)c == v;
+    }
+
+    static const size_t CHUNK = 1024;
+
+    /// Writes the frames of a StandardPlane as one column of type T, converting them in small pieces
+    template <typename T>
+      void WriteColumn(Serializer & ser, const std::vector<std::vector<double> > & frames, size_t total) {
+        ser.write((unsigned)total);
+        T buf[CHUNK];
+        size_t n = 0;
+        for (size_t f = 0; f < frames.size(); ++f) {
+          for (size_t i = 0; i < frames[f].size(); ++i) {
+            buf[n++] = (T)frames[f][i];
+            if (n == CHUNK) {
+              ser.write(buf, n);
+              n = 0;
+            }
+          }
+        }
+        ser.write(buf, n);
+      }
+
+    /// Writes the number of frames plus one, then where each frame starts and the total
+    template <typename T>
+      size_t WriteOffsets(Serializer & ser, const std::vector<std::vector<T> > & frames) {
+        ser.write((unsigned)frames.size() + 1);
+        unsigned offset = 0;
+        ser.write(offset);
+        for (size_t f = 0; f < frames.size(); ++f) {
+          offset += frames[f].size();
+          ser.write(offset);
+        }
+        return offset;
+      }
+
+    /// True if the offsets start a column of the given size and never decrease
+    bool ValidOffsets(const std::vector<unsigned> & offsets, size_t size) {
+      if (offsets.empty() || offsets.back() != size) return false;
+      for (size_t i = 1; i < offsets.size(); ++i) {
+        if (offsets[i] < offsets[i - 1]) return false;
+      }
+      return true;
+    }
+  }
+
+  CompactPlane::CompactPlane()
+    : m_id(0), m_tluevent(0), m_xsize(0), m_ysize(0), m_flags(0), m_pivotpixel(0),
+    m_pixoffsets(1, 0), m_coordoffsets(1, 0), m_chargetype(CHARGE_SHORT), m_haspivot(false) {}
+
+  CompactPlane::CompactPlane(Deserializer & ds) {
+    ds.read(m_type);
+    ds.read(m_sensor);
+    ds.read(m_id);
+    ds.read(m_tluevent);
+    ds.read(m_xsize);
+    ds.read(m_ysize);
+    ds.read(m_flags);
+    ds.read(m_pivotpixel);
+    ds.read(m_pixoffsets);
+    ds.read(m_coordoffsets);
+    ds.read(m_x);
+    ds.read(m_y);
+    unsigned chargetype = 0;
+    ds.read(chargetype);
+    m_chargetype = static_cast<CHARGE>(chargetype);
+    switch (m_chargetype) {
+      case CHARGE_SHORT: ds.read(m_charge16); break;
+      case CHARGE_FLOAT: ds.read(m_chargef); break;
+      case CHARGE_DOUBLE: ds.read(m_charged); break;
+      default: EUDAQ_THROW("Unknown charge type " + to_string(chargetype) + " in compact plane");
+    }
+    unsigned haspivot = 0;
+    ds.read(haspivot);
+    m_haspivot = haspivot != 0;
+    ds.read(m_pivot);
+    ds.read(m_mat);
+    // check everything that ToStandardPlane and the accessors index by
+    const size_t ncharges = m_charge16.size() + m_chargef.size() + m_charged.size();
+    const size_t ncoords = m_x.size();
+    if (!ValidOffsets(m_pixoffsets, ncharges) || !ValidOffsets(m_coordoffsets, ncoords) ||
+        m_y.size() != ncoords ||
+        m_pivot.size() != (m_haspivot ? (ncoords + PIVOTBITS - 1) / PIVOTBITS : 0)) {
+      EUDAQ_THROW("Inconsistent compact plane " + to_string(m_id));
+    }
+  }
+
+  void CompactPlane::Serialize(Serializer & ser) const {
+    ser.write(m_type);
+    ser.write(m_sensor);
+    ser.write(m_id);
+    ser.write(m_tluevent);
+    ser.write(m_xsize);
+    ser.write(m_ysize);
+    ser.write(m_flags);
+    ser.write(m_pivotpixel);
+    ser.write(m_pixoffsets);
+    ser.write(m_coordoffsets);
+    ser.write(m_x);
+    ser.write(m_y);
+    ser.write((unsigned)m_chargetype);
+    switch (m_chargetype) {
+      case CHARGE_SHORT: ser.write(m_charge16); break;
+      case CHARGE_FLOAT: ser.write(m_chargef); break;
+      case CHARGE_DOUBLE: ser.write(m_charged); break;
+    }
+    ser.write((unsigned)m_haspivot);
+    ser.write(m_pivot);
+    ser.write(m_mat);
+  }
+
+  bool CompactPlane::Fits(const StandardPlane & plane, CHARGE & chargetype) {
+    const std::vector<std::vector<double> > & pix = plane.m_pix;
+    const std::vector<std::vector<double> > & xs = plane.m_x, & ys = plane.m_y;
+    const std::vector<std::vector<bool> > & pivot = plane.m_pivot;
+    if (ys.size() != xs.size() || (pivot.size() && pivot.size() != xs.size())) return false;
+    for (size_t f = 0; f < xs.size(); ++f) {
+      if (ys[f].size() != xs[f].size() || (pivot.size() && pivot[f].size() != xs[f].size())) return false;
+      bool ok = true;
+      for (size_t i = 0; i < xs[f].size(); ++i) {
+        ok &= IsInt(xs[f][i], 0, 65535) & IsInt(ys[f][i], 0, 65535);
+      }
+      if (!ok) return false;
+    }
+    // use the narrowest type that holds every charge exactly
+    bool isshort = true, isfloat = true;
+    for (size_t f = 0; f < pix.size(); ++f) {
+      for (size_t i = 0; i < pix[f].size(); ++i) {
+        double p = pix[f][i];
+        isshort &= IsInt(p, -32768, 32767);
+        isfloat &= (double)(float)p == p;
+      }
+    }
+    chargetype = isshort ? CHARGE_SHORT : isfloat ? CHARGE_FLOAT : CHARGE_DOUBLE;
+    return true;
+  }
+
+  void CompactPlane::Write(const StandardPlane & plane, CHARGE chargetype, Serializer & ser) {
+    const std::vector<std::vector<bool> > & pivot = plane.m_pivot;
+    ser.write(plane.m_type);
+    ser.write(plane.m_sensor);
+    ser.write(plane.m_id);
+    ser.write(plane.m_tluevent);
+    ser.write(plane.m_xsize);
+    ser.write(plane.m_ysize);
+    ser.write(plane.m_flags);
+    ser.write(plane.m_pivotpixel);
+    const size_t npix = WriteOffsets(ser, plane.m_pix);
+    const size_t ncoords = WriteOffsets(ser, plane.m_x);
+    WriteColumn<unsigned short>(ser, plane.m_x, ncoords);
+    WriteColumn<unsigned short>(ser, plane.m_y, ncoords);
+    ser.write((unsigned)chargetype);
+    switch (chargetype) {
+      case CHARGE_SHORT: WriteColumn<short>(ser, plane.m_pix, npix); break;
+      case CHARGE_FLOAT: WriteColumn<float>(ser, plane.m_pix, npix); break;
+      case CHARGE_DOUBLE: WriteColumn<double>(ser, plane.m_pix, npix); break;
+    }
+    const bool haspivot = pivot.size() != 0;
+    ser.write((unsigned)haspivot);
+    ser.write((unsigned)(haspivot ? (ncoords + PIVOTBITS - 1) / PIVOTBITS : 0));
+    unsigned word = 0;
+    size_t c = 0;
+    for (size_t f = 0; f < pivot.size(); ++f) {
+      for (std::vector<bool>::const_iterator it = pivot[f].begin(); it != pivot[f].end(); ++it) {
+        word |= (unsigned)*it << (c % PIVOTBITS);
+        if (++c % PIVOTBITS == 0) {
+          ser.write(word);
+          word = 0;
+        }
+      }
+    }
+    if (c % PIVOTBITS) ser.write(word);
+    ser.write(plane.m_mat);
+  }
+
+  bool CompactPlane::Assign(const StandardPlane & plane) {
+    const std::vector<std::vector<double> > & pix = plane.m_pix;
+    const std::vector<std::vector<double> > & xs = plane.m_x, & ys = plane.m_y;
+    const std::vector<std::vector<bool> > & pivot = plane.m_pivot;
+    if (!Fits(plane, m_chargetype)) return false;
+    m_coordoffsets.resize(1);
+    for (size_t f = 0; f < xs.size(); ++f) {
+      m_coordoffsets.push_back(m_coordoffsets.back() + xs[f].size());
+    }
+    const size_t ncoords = m_coordoffsets.back();
+    m_x.resize(ncoords);
+    m_y.resize(ncoords);
+    size_t c = 0;
+    for (size_t f = 0; f < xs.size(); ++f) {
+      for (size_t i = 0; i < xs[f].size(); ++i, ++c) {
+        m_x[c] = (unsigned short)xs[f][i];
+        m_y[c] = (unsigned short)ys[f][i];
+      }
+    }
+    m_haspivot = pivot.size() != 0;
+    m_pivot.assign(m_haspivot ? (ncoords + PIVOTBITS - 1) / PIVOTBITS : 0, 0);
+    c = 0;
+    for (size_t f = 0; f < pivot.size(); ++f) {
+      for (size_t i = 0; i < pivot[f].size(); ++i, ++c) {
+        if (pivot[f][i]) m_pivot[c / PIVOTBITS] |= 1U << (c % PIVOTBITS);
+      }
+    }
+
+    m_pixoffsets.resize(1);
+    for (size_t f = 0; f < pix.size(); ++f) {
+      m_pixoffsets.push_back(m_pixoffsets.back() + pix[f].size());
+    }
+    m_charge16.resize(m_chargetype == CHARGE_SHORT ? m_pixoffsets.back() : 0);
+    m_chargef.resize(m_chargetype == CHARGE_FLOAT ? m_pixoffsets.back() : 0);
+    m_charged.resize(m_chargetype == CHARGE_DOUBLE ? m_pixoffsets.back() : 0);
+    c = 0;
+    for (size_t f = 0; f < pix.size(); ++f) {
+      for (size_t i = 0; i < pix[f].size(); ++i, ++c) {
+        switch (m_chargetype) {
+          case CHARGE_SHORT: m_charge16[c] = (short)pix[f][i]; break;
+          case CHARGE_FLOAT: m_chargef[c] = (float)pix[f][i]; break;
+          case CHARGE_DOUBLE: m_charged[c] = pix[f][i]; break;
+        }
+      }
+    }
+
+    m_type = plane.m_type;
+    m_sensor = plane.m_sensor;
+    m_id = plane.m_id;
+    m_tluevent = plane.m_tluevent;
+    m_xsize = plane.m_xsize;
+    m_ysize = plane.m_ysize;
+    m_flags = plane.m_flags;
+    m_pivotpixel = plane.m_pivotpixel;
+    m_mat = plane.m_mat;
+    return true;
+  }
+
+  void CompactPlane::ToStandardPlane(StandardPlane & plane) const {
+    plane.m_type = m_type;
+    plane.m_sensor = m_sensor;
+    plane.m_id = m_id;
+    plane.m_tluevent = m_tluevent;
+    plane.m_xsize = m_xsize;
+    plane.m_ysize = m_ysize;
+    plane.m_flags = m_flags;
+    plane.m_pivotpixel = m_pivotpixel;
+    plane.m_mat = m_mat;
+    plane.m_pix.resize(NumFrames());
+    for (size_t f = 0; f < NumFrames(); ++f) {
+      size_t begin = m_pixoffsets[f], end = m_pixoffsets[f + 1];
+      switch (m_chargetype) {
+        case CHARGE_SHORT: CopyColumn(m_charge16, begin, end, plane.m_pix[f]); break;
+        case CHARGE_FLOAT: CopyColumn(m_chargef, begin, end, plane.m_pix[f]); break;
+        case CHARGE_DOUBLE: CopyColumn(m_charged, begin, end, plane.m_pix[f]); break;
+      }
+    }
+    const size_t coordframes = m_coordoffsets.size() - 1;
+    plane.m_x.resize(coordframes);
+    plane.m_y.resize(coordframes);
+    plane.m_pivot.resize(m_haspivot ? coordframes : 0);
+    for (size_t f = 0; f < coordframes; ++f) {
+      size_t begin = m_coordoffsets[f], end = m_coordoffsets[f + 1];
+      CopyColumn(m_x, begin, end, plane.m_x[f]);
+      CopyColumn(m_y, begin, end, plane.m_y[f]);
+      if (m_haspivot) {
+        std::vector<bool> & pivot = plane.m_pivot[f];
+        pivot.resize(end - begin);
+        for (size_t c = begin; c < end; ++c) {
+          pivot[c - begin] = (m_pivot[c / PIVOTBITS] >> (c % PIVOTBITS)) & 1;
+        }
+      }
+    }
+    // the combined frames are worked out again when they are next needed
+    plane.m_result_pix = 0;
+    plane.m_result_x = plane.m_result_y = 0;
+  }
+
+  size_t CompactPlane::CoordIndex(unsigned index, unsigned frame) const {
+    if (m_coordoffsets.size() <= 2) frame = 0;
+    size_t begin = m_coordoffsets.at(frame);
+    if (index >= m_coordoffsets.at(frame + 1) - begin) EUDAQ_THROW("Bad pixel index " + to_string(index));
+    return begin + index;
+  }
+
+  bool CompactPlane::Pivot(unsigned index, unsigned frame) const {
+    if (!m_haspivot) return false;
+    size_t c = CoordIndex(index, frame);
+    return (m_pivot[c / PIVOTBITS] >> (c % PIVOTBITS)) & 1;
+  }
+
+  double CompactPlane::Charge(unsigned index, unsigned frame) const {
+    if (index >= HitPixels(frame)) EUDAQ_THROW("Bad pixel index " + to_string(index));
+    size_t c = m_pixoffsets[frame] + index;
+    switch (m_chargetype) {
+      case CHARGE_SHORT: return m_charge16[c];
+      case CHARGE_FLOAT: return m_chargef[c];
+      default: return m_charged[c];
+    }
+  }
+
+  size_t CompactPlane::HitBytes() const {
+    return (m_x.size() + m_y.size()) * sizeof (unsigned short)
+      + m_charge16.size() * sizeof (short)
+      + m_chargef.size() * sizeof (float)
+      + m_charged.size() * sizeof (double)
+      + m_pivot.size() * sizeof (unsigned)
+      + (m_pixoffsets.size() + m_coordoffsets.size()) * sizeof (unsigned);
+  }
+
+}
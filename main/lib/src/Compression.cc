@@ -0,0 +1,136 @@
+#include "eudaq/Compression.hh"
+#include "eudaq/Exception.hh"
+#include "eudaq/Utils.hh"
+#include <cstring>
+
+#ifdef EUDAQ_HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef EUDAQ_HAVE_LZ4
+# include <lz4.h>
+#endif
+#ifdef EUDAQ_HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+namespace eudaq {
+
+  namespace {
+    static const char * const CODECNAMES[] = { "none", "zlib", "lz4", "zstd" };
+  }
+
+  bool Compression::Available(unsigned codec) {
+    switch (codec) {
+      case CODEC_NONE: return true;
+#ifdef EUDAQ_HAVE_ZLIB
+      case CODEC_ZLIB: return true;
+#endif
+#ifdef EUDAQ_HAVE_LZ4
+      case CODEC_LZ4: return true;
+#endif
+#ifdef EUDAQ_HAVE_ZSTD
+      case CODEC_ZSTD: return true;
+#endif
+      default: return false;
+    }
+  }
+
+  unsigned Compression::Default() {
+    static const unsigned preferred[] = { CODEC_LZ4, CODEC_ZSTD, CODEC_ZLIB };
+    for (size_t i = 0; i < sizeof preferred / sizeof *preferred; ++i) {
+      if (Available(preferred[i])) return preferred[i];
+    }
+    return CODEC_NONE;
+  }
+
+  unsigned Compression::FromName(const std::string & name) {
+    std::string lname = lcase(name);
+    for (unsigned i = 0; i < sizeof CODECNAMES / sizeof *CODECNAMES; ++i) {
+      if (lname == CODECNAMES[i]) {
+        if (!Available(i)) EUDAQ_THROW("Compression " + lname + " is not available in this build");
+        return i;
+      }
+    }
+    EUDAQ_THROW("Unknown compression: " + name);
+  }
+
+  std::string Compression::Name(unsigned codec) {
+    if (codec < sizeof CODECNAMES / sizeof *CODECNAMES) return CODECNAMES[codec];
+    return "unknown(" + to_string(codec) + ")";
+  }
+
+  void Compression::Compress(unsigned codec, int level, const unsigned char * data, size_t len,
+      std::vector<unsigned char> & out) {
+    switch (codec) {
+      case CODEC_NONE:
+        out.assign(data, data + len);
+        return;
+#ifdef EUDAQ_HAVE_ZLIB
+      case CODEC_ZLIB: {
+        uLongf size = compressBound(len);
+        out.resize(size);
+        if (compress2(&out[0], &size, data, len, level ? level : 1) != Z_OK) EUDAQ_THROW("zlib compression failed");
+        out.resize(size);
+        return;
+      }
+#endif
+#ifdef EUDAQ_HAVE_LZ4
+      case CODEC_LZ4: {
+        out.resize(LZ4_compressBound((int)len));
+        int size = LZ4_compress_fast(reinterpret_cast<const char *>(data), reinterpret_cast<char *>(&out[0]),
+            (int)len, (int)out.size(), level > 0 ? level : 1);
+        if (size <= 0) EUDAQ_THROW("LZ4 compression failed");
+        out.resize(size);
+        return;
+      }
+#endif
+#ifdef EUDAQ_HAVE_ZSTD
+      case CODEC_ZSTD: {
+        out.resize(ZSTD_compressBound(len));
+        size_t size = ZSTD_compress(&out[0], out.size(), data, len, level ? level : 1);
+        if (ZSTD_isError(size)) EUDAQ_THROW(std::string("zstd compression failed: ") + ZSTD_getErrorName(size));
+        out.resize(size);
+        return;
+      }
+#endif
+      default:
+        EUDAQ_THROW("Compression " + Name(codec) + " is not available in this build");
+    }
+  }
+
+  void Compression::Decompress(unsigned codec, const unsigned char * data, size_t len,
+      unsigned char * out, size_t outlen) {
+    switch (codec) {
+      case CODEC_NONE:
+        if (len != outlen) break;
+        std::memcpy(out, data, len);
+        return;
+#ifdef EUDAQ_HAVE_ZLIB
+      case CODEC_ZLIB: {
+        uLongf size = outlen;
+        if (uncompress(out, &size, data, len) != Z_OK || size != outlen) break;
+        return;
+      }
+#endif
+#ifdef EUDAQ_HAVE_LZ4
+      case CODEC_LZ4: {
+        int size = LZ4_decompress_safe(reinterpret_cast<const char *>(data), reinterpret_cast<char *>(out),
+            (int)len, (int)outlen);
+        if (size < 0 || (size_t)size != outlen) break;
+        return;
+      }
+#endif
+#ifdef EUDAQ_HAVE_ZSTD
+      case CODEC_ZSTD: {
+        size_t size = ZSTD_decompress(out, outlen, data, len);
+        if (ZSTD_isError(size) || size != outlen) break;
+        return;
+      }
+#endif
+      default:
+        EUDAQ_THROW("Compression " + Name(codec) + " is not available in this build");
+    }
+    EUDAQ_THROWX(FileFormatException, "Corrupt " + Name(codec) + " compressed block");
+  }
+
+}
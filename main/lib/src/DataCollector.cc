@@ -5,14 +5,22 @@
 #include "eudaq/Logger.hh"
 #include "eudaq/Utils.hh"
 #include "eudaq/PluginManager.hh"
+#include "eudaq/Arena.hh"
 #include <iostream>
 #include <ostream>
+#include <algorithm>
 
 namespace eudaq {
 
   namespace {
 
     static const char * const RUN_NUMBER_FILE = "../data/runnumber.dat";
+    /// Number of packets that may be between the transport and the event builder
+    static const size_t PIPELINE_SIZE = 256;
+    /// Number of built events that may be waiting to be written
+    static const size_t WRITE_QUEUE_SIZE = 64;
+    /// Bytes in each arena that received and built events are allocated from
+    static const size_t DEFAULT_ARENA_SIZE = 1 << 20;
 
     void * DataCollector_thread(void * arg) {
       DataCollector * dc = static_cast<DataCollector *>(arg);
@@ -20,15 +28,93 @@ namespace eudaq {
       return 0;
     }
 
+    void * DataCollector_shmthread(void * arg) {
+      DataCollector * dc = static_cast<DataCollector *>(arg);
+      dc->ShmDataThread();
+      return 0;
+    }
+
+    void * DataCollector_decode(void * arg) {
+      static_cast<DataCollector *>(arg)->DecodeThread();
+      return 0;
+    }
+
+    void * DataCollector_build(void * arg) {
+      static_cast<DataCollector *>(arg)->BuildThread();
+      return 0;
+    }
+
+    void * DataCollector_write(void * arg) {
+      static_cast<DataCollector *>(arg)->WriteThread();
+      return 0;
+    }
+
+    static size_t NumDecodeThreads() {
+      // leave cores for receiving, building and writing
+      return std::max(1U, std::min(NumProcessors() / 2, 4U));
+    }
+
   } // anonymous namespace
 
+  struct DataCollector::Item {
+    enum Type { DATA, CONNECT, DISCONNECT };
+    enum State { EMPTY, RECEIVED, DECODED };
+    Item() : state(EMPTY), type(DATA), handle(ConnectionInfo::NOHANDLE) {}
+    Atomic<int> state;
+    int type;
+    unsigned handle;
+    counted_ptr<ConnectionInfo> id; ///< Only for a new connection
+    std::string packet;
+    EventPtr<Event> event;
+    std::string error; ///< Why the packet could not be deserialized
+  };
+
+  class DataCollector::Pause {
+    public:
+      /// Waits until the event builder is between two items, and everything it built has been written
+      explicit Pause(DataCollector & dc) : m_dc(dc) {
+        m_dc.m_buildlock.Lock();
+        m_dc.WaitWritten();
+        m_dc.m_writelock.Lock();
+      }
+      ~Pause() {
+        m_dc.m_writelock.UnLock();
+        m_dc.m_buildlock.UnLock();
+      }
+    private:
+      DataCollector & m_dc;
+  };
+
   DataCollector::DataCollector(const std::string & runcontrol, const std::string & listenaddress) :
-    CommandReceiver("DataCollector", "", runcontrol, false), m_done(false), m_listening(true), m_dataserver(TransportFactory::CreateServer(listenaddress)), m_thread(), m_numwaiting(0), m_itlu((size_t) -1), m_runnumber(
-        ReadFromFile(RUN_NUMBER_FILE, 0U)), m_eventnumber(0), m_runstart(0) {
+    CommandReceiver("DataCollector", "", runcontrol, false), m_done(false), m_listening(true), m_dataserver(TransportFactory::CreateServer(listenaddress)), m_shmserver(0), m_thread(), m_numwaiting(0), m_itlu((size_t) -1), m_runnumber(
+        ReadFromFile(RUN_NUMBER_FILE, 0U)), m_eventnumber(0), m_runstart(0), m_building(BUILD_POSITION), m_window(0),
+    m_timestamptimeout(1.0), m_streamlimit(1024),
+    m_reorderdepth(0), m_nextid(0), m_havenextid(false), m_earlyfirst(0), m_pending(0), m_partial(0), m_late(0),
+    m_arenasize(DEFAULT_ARENA_SIZE), m_arena(0), m_allocations(0),
+    m_items(new Item[PIPELINE_SIZE]), m_received(0), m_decoding(0), m_built(0), m_queued(0), m_written(0), m_stop(0),
+    m_writequeue(WRITE_QUEUE_SIZE) {
       m_dataserver->SetCallback(TransportCallback(this, &DataCollector::DataHandler));
+#if EUDAQ_PLATFORM_IS(LINUX)
+      // producers on this host may send through shared memory, named after the data port
+      const std::string dataaddr = m_dataserver->ConnectionString();
+      if (dataaddr.compare(0, 6, "shm://") != 0) {
+        try {
+          m_shmserver = TransportFactory::CreateServer("shm://" + std::string(dataaddr, dataaddr.rfind(':') + 1));
+          m_shmserver->SetCallback(TransportCallback(this, &DataCollector::ShmDataHandler));
+        } catch (const std::exception & e) {
+          EUDAQ_WARN(std::string("No shared memory data server, all producers will use TCP: ") + e.what());
+        }
+      }
+#endif
+      for (size_t i = NumDecodeThreads(); i > 0; --i) {
+        m_decoders.push_back(new eudaqThread(DataCollector_decode, this));
+      }
+      m_builder.start(DataCollector_build, this);
+      m_writerthread.start(DataCollector_write, this);
       //pthread_attr_init(&m_threadattr);
       //pthread_create(&m_thread, &m_threadattr, DataCollector_thread, this);
 	  m_thread.start(DataCollector_thread,this);
+      if (m_shmserver) m_shmthread.start(DataCollector_shmthread, this);
       EUDAQ_DEBUG("Listen address=" + to_string(m_dataserver->ConnectionString()));
       CommandReceiver::StartThread();
     }
@@ -38,11 +124,28 @@ namespace eudaq {
     /*if (m_thread)*/
     //pthread_join(m_thread, 0);
 	m_thread.join();
+    if (m_shmserver) m_shmthread.join();
+    // let the pipeline finish with what has been received
+    m_stop.store(1);
+    m_onreceived.Notify();
+    m_ondecoded.Notify();
+    for (size_t i = 0; i < m_decoders.size(); ++i) {
+      m_decoders[i]->join();
+      delete m_decoders[i];
+    }
+    m_builder.join();
+    m_stop.store(2);
+    m_onqueued.Notify();
+    m_writerthread.join();
+    if (m_arena) m_arena->Release();
+    delete[] m_items;
     delete m_dataserver;
+    delete m_shmserver;
   }
 
   void DataCollector::OnServer() {
     m_status.SetTag("_SERVER", m_dataserver->ConnectionString());
+    if (m_shmserver) m_status.SetTag("_SHMSERVER", m_shmserver->ConnectionString());
   }
 
   void DataCollector::OnGetRun() {
@@ -52,30 +155,84 @@ namespace eudaq {
 
   void DataCollector::OnConnect(const ConnectionInfo & id) {
     EUDAQ_INFO("Connection from " + to_string(id));
-    Info info;
+    const unsigned handle = id.GetHandle();
+    if (handle >= m_buffer.size()) m_buffer.resize(handle + 1);
+    Info & info = m_buffer[handle];
     info.id = counted_ptr<ConnectionInfo>(id.Clone());
-    m_buffer.push_back(info);
+    info.events.clear();
+    info.newest = 0;
+    info.heard = Time::Current();
+    info.plugin = 0;
+    m_producers.push_back(handle);
     if (id.GetType() == "Producer" && id.GetName() == "TLU") {
-      m_itlu = m_buffer.size() - 1;
+      m_itlu = handle;
     }
   }
 
   void DataCollector::OnDisconnect(const ConnectionInfo & id) {
     EUDAQ_INFO("Disconnected: " + to_string(id));
-    size_t i = GetInfo(id);
-    if (i == m_itlu) {
+    const unsigned handle = GetInfo(id);
+    if (handle == m_itlu) {
       m_itlu = (size_t) -1;
-    } else if (i < m_itlu) {
-      --m_itlu;
     }
-    m_buffer.erase(m_buffer.begin() + i);
+    Info & info = m_buffer[handle];
+    if (info.events.size() > 0) {
+      m_numwaiting--;
+      info.events.clear();
+    }
+    info.id = counted_ptr<ConnectionInfo>();
+    m_producers.erase(std::find(m_producers.begin(), m_producers.end(), handle));
+    if (m_building == BUILD_TIMESTAMP) {
+      RebuildHeap();
+      // the producer may have been the one holding back the others
+      BuildByTimestamp();
+    } else if (m_building == BUILD_TRIGGERID) {
+      for (size_t i = 0; i < m_reorder.size(); ++i) {
+        Pending & p = m_reorder[i];
+        if (handle < p.parts.size() && p.parts[handle].get()) {
+          p.parts[handle].reset();
+          if (--p.count == 0) m_pending--;
+        }
+      }
+      for (size_t i = m_early.size(); i > 0; --i) {
+        if (m_early[i - 1].handle == handle) m_early.erase(m_early.begin() + (i - 1));
+      }
+      BuildByTriggerID(false);
+    }
     // if (during run) THROW
   }
 
   void DataCollector::OnConfigure(const Configuration & param) {
+    Drain();
+    Pause pause(*this);
     m_config = param;
     m_writer = FileWriterFactory::Create(m_config.Get("FileType", ""));
     m_writer->SetFilePattern(m_config.Get("FilePattern", ""));
+    m_writer->Configure(m_config);
+    m_arenasize.store(std::max(m_config.Get("ArenaSize", (long long)DEFAULT_ARENA_SIZE), 0LL));
+    std::string building = lcase(m_config.Get("EventBuilding", "position"));
+    if (building == "timestamp") {
+      m_building = BUILD_TIMESTAMP;
+      m_window = m_config.Get("TimestampWindow", 0LL);
+      m_timestamptimeout = m_config.Get("TimestampTimeout", 1.0);
+      m_streamlimit = std::max(m_config.Get("TimestampBuffer", 1024LL), 1LL);
+      EUDAQ_INFO("Building events by timestamp, window = " + to_string(m_window) +
+          ", timeout = " + to_string(m_timestamptimeout) + " s, buffer = " + to_string(m_streamlimit));
+    } else if (building == "triggerid") {
+      m_building = BUILD_TRIGGERID;
+      // a power of two, so that the slot of a trigger ID stays the same when the IDs wrap around
+      size_t depth = 1;
+      const size_t maxdepth = (TRIGGER_IDMASK + 1) / 2;
+      const long long requested = m_config.Get("ReorderDepth", 256LL);
+      while ((long long)depth < requested && depth < maxdepth) depth <<= 1;
+      m_reorderdepth = depth;
+      m_reordertimeout = m_config.Get("ReorderTimeout", 1.0);
+      EUDAQ_INFO("Building events by trigger ID, depth = " + to_string(m_reorderdepth) +
+          ", timeout = " + to_string(m_reordertimeout) + " s");
+    } else {
+      if (building != "position") EUDAQ_WARN("Unknown EventBuilding mode '" + building + "', building by position");
+      m_building = BUILD_POSITION;
+    }
   }
 
   void DataCollector::OnPrepareRun(unsigned runnumber) {
@@ -86,18 +243,14 @@ namespace eudaq {
       if (!m_writer) {
         EUDAQ_THROW("You must configure before starting a run");
       }
+      // the events of the previous run go to the previous file
+      Drain();
+      Pause pause(*this);
       m_writer->StartRun(runnumber);
       WriteToFile(RUN_NUMBER_FILE, runnumber);
       m_runnumber = runnumber;
-      m_eventnumber = 0;
-
-      for (size_t i = 0; i < m_buffer.size(); ++i) {
-        if (m_buffer[i].events.size() > 0) {
-          EUDAQ_WARN("Buffer " + to_string(*m_buffer[i].id) + " has " + to_string(m_buffer[i].events.size()) + " events remaining.");
-          m_buffer[i].events.clear();
-        }
-      }
-      m_numwaiting = 0;
+      ResetBuffers();
+      m_allocations = HeapAllocations();
 
       SetStatus(Status::LVL_OK);
     } catch (const Exception & e) {
@@ -113,18 +266,42 @@ namespace eudaq {
     //m_ser = counted_ptr<FileSerializer>();
   }
 
-  void DataCollector::OnReceive(const ConnectionInfo & id, counted_ptr<Event> ev) {
+  void DataCollector::OnReceive(const ConnectionInfo & id, EventPtr<Event> ev) {
     //std::cout << "Received Event from " << id << ": " << *ev << std::endl;
-    Info & inf = m_buffer[GetInfo(id)];
+    const unsigned handle = GetInfo(id);
+    Info & inf = m_buffer[handle];
+    if (ev->IsBORE()) {
+      // all events from a producer are of the same type
+      inf.plugin = PluginManager::GetInstance().FindPlugin(*ev);
+    }
+    if (m_building == BUILD_TRIGGERID && !ev->IsBORE() && !ev->IsEORE()) {
+      Reorder(handle, ev);
+      return;
+    }
     inf.events.push_back(ev);
+    inf.heard = Time::Current();
+    if (m_building == BUILD_TIMESTAMP) {
+      // streams are in time order, so the newest key limits what may still arrive
+      inf.newest = std::max(inf.newest, MergeKey(*ev));
+      if (inf.events.size() == 1) {
+        m_numwaiting++;
+        m_heap.push(std::make_pair(MergeKey(*ev), handle));
+      }
+      BuildByTimestamp();
+      return;
+    }
     bool tmp = false;
     if (inf.events.size() == 1) {
       m_numwaiting++;
-      if (m_numwaiting == m_buffer.size()) {
+      if (m_numwaiting == m_producers.size()) {
         tmp = true;
       }
     }
-    //std::cout << "Waiting buffers: " << m_numwaiting << " out of " << m_buffer.size() << std::endl;
+    //std::cout << "Waiting buffers: " << m_numwaiting << " out of " << m_producers.size() << std::endl;
+    if (tmp && m_building == BUILD_TRIGGERID) {
+      // only BOREs and EOREs are queued, and whatever is still pending belongs before the EOREs
+      BuildByTriggerID(true);
+    }
     if (tmp)
       OnCompleteEvent();
   }
@@ -137,6 +314,11 @@ namespace eudaq {
     m_status.SetTag("RUN", to_string(m_runnumber));
     if (m_writer.get())
       m_status.SetTag("FILEBYTES", to_string(m_writer->FileBytes()));
+    // occupancy of the pipeline stages, loaded downstream first so the differences are not negative
+    size_t built = m_built.load(), decoding = m_decoding.load(), received = m_received.load();
+    m_status.SetTag("DECODEQUEUE", to_string(received - decoding));
+    m_status.SetTag("BUILDQUEUE", to_string(decoding - built));
+    m_status.SetTag("WRITEQUEUE", to_string(m_writequeue.Size()));
   }
 
   void DataCollector::OnCompleteEvent() {
@@ -153,79 +335,344 @@ namespace eudaq {
         n_ev = ev->GetEventNumber();
         n_ts = ev->GetTimestamp();
       }
-      DetectorEvent ev(n_run, n_ev, n_ts);
+      DetectorEvent * evp = NewEvent(n_run, n_ev, n_ts);
+      DetectorEvent & ev = *evp;
       unsigned tluev = 0;
-      for (size_t i = 0; i < m_buffer.size(); ++i) {
-        if (m_buffer[i].events.front()->GetRunNumber() != m_runnumber) {
+      for (size_t i = 0; i < m_producers.size(); ++i) {
+        Info & inf = m_buffer[m_producers[i]];
+        if (inf.events.front()->GetRunNumber() != m_runnumber) {
           EUDAQ_ERROR("Run number mismatch in event " + to_string(ev.GetEventNumber()));
         }
         if (i == 0) {
-          tluev = PluginManager::GetTriggerID(*m_buffer[i].events.front());
+          tluev = GetTriggerID(inf, *inf.events.front());
         } else {
-          unsigned tluev2 = PluginManager::GetTriggerID(*m_buffer[i].events.front());
+          unsigned tluev2 = GetTriggerID(inf, *inf.events.front());
           if (tluev2 != tluev) {
             //EUDAQ_ERROR("Trigger number mismatch: " + to_string(tluev) + " != " + to_string(tluev2) +
-            //            " in " + m_buffer[i].id->GetName());
+            //            " in " + inf.id->GetName());
           }
         }
-        if ((m_buffer[i].events.front()->GetEventNumber() != m_eventnumber) && (m_buffer[i].events.front()->GetEventNumber() != m_eventnumber - 1)) {
+        if ((inf.events.front()->GetEventNumber() != m_eventnumber) && (inf.events.front()->GetEventNumber() != m_eventnumber - 1)) {
           if (ev.GetEventNumber() % 1000 == 0) {
             // dhaas: added if-statement to filter out TLU event number 0, in case of bad clocking out
-            if (m_buffer[i].events.front()->GetEventNumber() != 0)
-              EUDAQ_WARN("Event number mismatch > 2 in event " + to_string(ev.GetEventNumber()) + " " + to_string(m_buffer[i].events.front()->GetEventNumber()) + " " + to_string(m_eventnumber));
-            if (m_buffer[i].events.front()->GetEventNumber() == 0)
+            if (inf.events.front()->GetEventNumber() != 0)
+              EUDAQ_WARN("Event number mismatch > 2 in event " + to_string(ev.GetEventNumber()) + " " + to_string(inf.events.front()->GetEventNumber()) + " " + to_string(m_eventnumber));
+            if (inf.events.front()->GetEventNumber() == 0)
               EUDAQ_WARN("Event number mismatch > 2 in event " + to_string(ev.GetEventNumber()));
           }
         }
-        ev.AddEvent(m_buffer[i].events.front());
-        m_buffer[i].events.pop_front();
-        if (m_buffer[i].events.size() == 0) {
+        ev.AddEvent(inf.events.front());
+        inf.events.pop_front();
+        if (inf.events.size() == 0) {
           m_numwaiting--;
           more = false;
         }
       }
-      if (ev.IsBORE()) {
-        ev.SetTag("STARTTIME", m_runstart.Formatted());
-        ev.SetTag("CONFIG", to_string(m_config));
+      Emit(evp);
+    }
+  }
+
+  DetectorEvent * DataCollector::NewEvent(unsigned run, unsigned event, unsigned long long timestamp) {
+    const size_t arenasize = m_arenasize.load();
+    if (m_arena && (m_arena->Full() || m_arena->Capacity() != arenasize)) {
+      // the events already in it keep it until they are written
+      m_arena->Release();
+      m_arena = 0;
+    }
+    if (!m_arena && arenasize) m_arena = Arena::Create(arenasize);
+    DetectorEvent * ev = m_arena ? new (*m_arena) DetectorEvent(run, event, timestamp, m_arena)
+      : new DetectorEvent(run, event, timestamp);
+    ev->Reserve(m_producers.size());
+    return ev;
+  }
+
+  void DataCollector::Emit(DetectorEvent * evp) {
+    DetectorEvent & ev = *evp;
+    if (ev.IsBORE()) {
+      ev.SetTag("STARTTIME", m_runstart.Formatted());
+      ev.SetTag("CONFIG", to_string(m_config));
+    }
+    if (ev.IsEORE()) {
+      ev.SetTag("STOPTIME", Time::Current().Formatted());
+      if (m_partial || m_late) {
+        EUDAQ_WARN("Run " + to_string(ev.GetRunNumber()) + ": " + to_string(m_partial) + " incomplete events, " +
+            to_string(m_late) + " events dropped");
+      }
+      EUDAQ_INFO("Run " + to_string(ev.GetRunNumber()) + ", EORE = " + to_string(ev.GetEventNumber()));
+      if (unsigned long long allocations = HeapAllocations()) {
+        // only counted in builds made for measuring
+        EUDAQ_INFO("Heap allocations per event: " +
+            to_string((allocations - m_allocations) / (double)std::max(m_eventnumber, 1U)));
+      }
+    }
+    //std::cout << ev << std::endl;
+    for (;;) {
+      const unsigned epoch = m_onwritten.Epoch();
+      if (m_writequeue.TryPush(evp)) break;
+      m_onwritten.Wait(epoch);
+    }
+    m_queued.store(m_queued.load() + 1);
+    m_onqueued.Notify();
+    ++m_eventnumber;
+  }
+
+  unsigned DataCollector::GetTriggerID(const Info & inf, const Event & ev) {
+    if (inf.plugin) return inf.plugin->GetTriggerID(ev);
+    return PluginManager::GetTriggerID(ev);
+  }
+
+  unsigned long long DataCollector::MergeKey(const Event & ev) {
+    if (ev.IsBORE()) return 0;
+    if (ev.IsEORE()) return NOTIMESTAMP;
+    // keep data events strictly between the BOREs and EOREs
+    return std::min(std::max(ev.GetTimestamp(), 1ULL), NOTIMESTAMP - 1);
+  }
+
+  double DataCollector::BuildByTimestamp() {
+    const Time now = Time::Current();
+    while (!m_heap.empty()) {
+      const unsigned long long t0 = m_heap.top().first;
+      if (t0 == 0 || t0 == NOTIMESTAMP) {
+        // BOREs and EOREs are still combined one from each producer,
+        // and as EOREs sort last, an EORE on top means all producers have ended
+        if (m_numwaiting != m_producers.size()) break;
+        DetectorEvent * ev = NewEvent(m_runnumber, m_eventnumber, NOTIMESTAMP);
+        m_heap = heap_t();
+        for (size_t i = 0; i < m_producers.size(); ++i) {
+          Info & inf = m_buffer[m_producers[i]];
+          ev->AddEvent(inf.events.front());
+          inf.events.pop_front();
+          if (inf.events.size() == 0) {
+            m_numwaiting--;
+          } else {
+            m_heap.push(std::make_pair(MergeKey(*inf.events.front()), m_producers[i]));
+          }
+        }
+        Emit(ev);
+        continue;
+      }
+      // nothing inside the window may still be on its way, unless a producer is too slow to wait for
+      const unsigned long long tmax = t0 + m_window < t0 ? NOTIMESTAMP - 1 : t0 + m_window;
+      bool full = false;
+      for (size_t i = 0; i < m_producers.size(); ++i) {
+        if (m_buffer[m_producers[i]].events.size() >= m_streamlimit) full = true;
       }
-      if (ev.IsEORE()) {
-        ev.SetTag("STOPTIME", Time::Current().Formatted());
-        EUDAQ_INFO("Run " + to_string(ev.GetRunNumber()) + ", EORE = " + to_string(ev.GetEventNumber()));
+      double wait = -1;
+      for (size_t i = 0; !full && i < m_producers.size(); ++i) {
+        const Info & inf = m_buffer[m_producers[i]];
+        const double left = m_timestamptimeout - (now - inf.heard).Seconds();
+        if (inf.newest <= tmax && left > 0 && (wait < 0 || left < wait)) wait = left;
       }
-      if (m_writer.get()) {
-        m_writer->WriteEvent(ev);
+      if (wait >= 0) return wait;
+      DetectorEvent * ev = NewEvent(m_runnumber, m_eventnumber, t0);
+      while (!m_heap.empty() && m_heap.top().first <= tmax) {
+        ev->AddEvent(PopMerged());
+      }
+      Emit(ev);
+    }
+    return -1;
+  }
+
+  void DataCollector::Reorder(unsigned handle, EventPtr<Event> ev) {
+    unsigned id = (unsigned)-1;
+    try {
+      id = GetTriggerID(m_buffer[handle], *ev);
+    } catch (const Exception &) {
+      // no plugin for this type of event
+    }
+    if (id == (unsigned)-1) {
+      if (m_late++ == 0) EUDAQ_ERROR("No trigger ID in events from " + m_buffer[handle].id->GetName() + ", dropping them");
+      return;
+    }
+    id &= TRIGGER_IDMASK;
+    if (!m_havenextid) {
+      // the first trigger to arrive need not be the lowest, so wait for the others
+      if (m_early.empty()) m_earlyfirst = Time::Current();
+      Early early = { handle, id, ev };
+      m_early.push_back(early);
+      BuildByTriggerID(false);
+      return;
+    }
+    PlaceTrigger(handle, id, ev);
+  }
+
+  double DataCollector::StartTriggerIDs(bool flush) {
+    if (m_havenextid || m_early.empty()) return -1;
+    const double age = (Time::Current() - m_earlyfirst).Seconds();
+    if (!flush && age < m_reordertimeout && m_early.size() < m_reorderdepth) {
+      for (size_t i = 0; i < m_producers.size(); ++i) {
+        size_t j = 0;
+        while (j < m_early.size() && m_early[j].handle != m_producers[i]) ++j;
+        if (j == m_early.size()) return m_reordertimeout - age;
+      }
+    }
+    // the lowest ID, taking one more than half the range below another as having wrapped around
+    unsigned first = m_early[0].id;
+    for (size_t i = 1; i < m_early.size(); ++i) {
+      const unsigned behind = (first - m_early[i].id) & TRIGGER_IDMASK;
+      if (behind != 0 && behind <= TRIGGER_IDMASK / 2) first = m_early[i].id;
+    }
+    m_nextid = first;
+    m_havenextid = true;
+    std::vector<Early> early;
+    early.swap(m_early);
+    for (size_t i = 0; i < early.size(); ++i) {
+      PlaceTrigger(early[i].handle, early[i].id, early[i].ev);
+    }
+    return -1;
+  }
+
+  void DataCollector::PlaceTrigger(unsigned handle, unsigned id, EventPtr<Event> ev) {
+    if (m_reorder.size() != m_reorderdepth) m_reorder.resize(m_reorderdepth);
+    // how far ahead of the oldest unbuilt trigger, IDs more than half the range ahead are taken as already built
+    unsigned ahead = (id - m_nextid) & TRIGGER_IDMASK;
+    if (ahead > TRIGGER_IDMASK / 2) {
+      if (m_late++ == 0) EUDAQ_WARN("Trigger " + to_string(id) + " from " + m_buffer[handle].id->GetName() +
+          " arrived after its event was built, dropping it");
+      return;
+    }
+    // keep the memory bounded by building the oldest triggers, complete or not
+    while (ahead >= m_reorderdepth) {
+      BuildTrigger();
+      ahead = (id - m_nextid) & TRIGGER_IDMASK;
+    }
+    Pending & p = m_reorder[id & (m_reorderdepth - 1)];
+    if (p.parts.size() < m_buffer.size()) p.parts.resize(m_buffer.size());
+    if (p.parts[handle].get()) {
+      if (m_late++ == 0) EUDAQ_WARN("Trigger " + to_string(id) + " received twice from " + m_buffer[handle].id->GetName() +
+          ", dropping the second one");
+      return;
+    }
+    if (p.count++ == 0) {
+      p.first = Time::Current();
+      m_pending++;
+    }
+    p.parts[handle] = ev;
+    BuildByTriggerID(false);
+  }
+
+  double DataCollector::BuildByTriggerID(bool flush) {
+    if (!m_havenextid) {
+      const double wait = StartTriggerIDs(flush);
+      if (wait >= 0) return wait;
+    }
+    const Time now = Time::Current();
+    while (m_pending > 0) {
+      // the oldest trigger anything was received for
+      unsigned id = m_nextid;
+      while (m_reorder[id & (m_reorderdepth - 1)].count == 0) id = (id + 1) & TRIGGER_IDMASK;
+      const Pending & p = m_reorder[id & (m_reorderdepth - 1)];
+      const double age = (now - p.first).Seconds();
+      if (!flush && p.count < m_producers.size() && age < m_reordertimeout) return m_reordertimeout - age;
+      m_nextid = id;
+      BuildTrigger();
+    }
+    return -1;
+  }
+
+  void DataCollector::BuildTrigger() {
+    Pending & p = m_reorder[m_nextid & (m_reorderdepth - 1)];
+    m_nextid = (m_nextid + 1) & TRIGGER_IDMASK;
+    if (p.count == 0) return;
+    unsigned n_run = m_runnumber, n_ev = m_eventnumber;
+    unsigned long long n_ts = NOTIMESTAMP;
+    if (m_itlu != (size_t) -1 && m_itlu < p.parts.size() && p.parts[m_itlu].get()) {
+      const Event & tlu = *p.parts[m_itlu];
+      n_run = tlu.GetRunNumber();
+      n_ev = tlu.GetEventNumber();
+      n_ts = tlu.GetTimestamp();
+    }
+    DetectorEvent * ev = NewEvent(n_run, n_ev, n_ts);
+    std::string missing;
+    for (size_t i = 0; i < m_producers.size(); ++i) {
+      const unsigned handle = m_producers[i];
+      if (handle < p.parts.size() && p.parts[handle].get()) {
+        ev->AddEvent(p.parts[handle]);
+        p.parts[handle].reset();
       } else {
-        EUDAQ_ERROR("Event received before start of run");
+        missing += (missing.empty() ? "" : ",") + m_buffer[handle].id->GetName();
       }
-      //std::cout << ev << std::endl;
-      ++m_eventnumber;
     }
+    if (!missing.empty()) {
+      ev->SetFlags(Event::FLAG_PART);
+      ev->SetTag("MISSING", missing);
+      m_partial++;
+    }
+    p.count = 0;
+    m_pending--;
+    Emit(ev);
   }
 
-  size_t DataCollector::GetInfo(const ConnectionInfo & id) {
-    for (size_t i = 0; i < m_buffer.size(); ++i) {
-      //std::cout << "Checking " << *m_buffer[i].id << " == " << id<< std::endl;
-      if (m_buffer[i].id->Matches(id))
-        return i;
+  void DataCollector::RebuildHeap() {
+    m_heap = heap_t();
+    for (size_t i = 0; i < m_producers.size(); ++i) {
+      Info & inf = m_buffer[m_producers[i]];
+      inf.newest = 0;
+      for (std::list<EventPtr<Event> >::const_iterator it = inf.events.begin(); it != inf.events.end(); ++it) {
+        inf.newest = std::max(inf.newest, MergeKey(**it));
+      }
+      if (inf.events.size() > 0) m_heap.push(std::make_pair(MergeKey(*inf.events.front()), m_producers[i]));
+    }
+  }
+
+  EventPtr<Event> DataCollector::PopMerged() {
+    const unsigned handle = m_heap.top().second;
+    m_heap.pop();
+    Info & inf = m_buffer[handle];
+    EventPtr<Event> ev;
+    ev.swap(inf.events.front());
+    inf.events.pop_front();
+    if (inf.events.size() == 0) {
+      m_numwaiting--;
+    } else {
+      m_heap.push(std::make_pair(MergeKey(*inf.events.front()), handle));
     }
-    EUDAQ_THROW("Unrecognised connection id");
+    return ev;
+  }
+
+  unsigned DataCollector::GetInfo(const ConnectionInfo & id) {
+    const unsigned handle = id.GetHandle();
+    if (handle >= m_buffer.size() || !m_buffer[handle].id) EUDAQ_THROW("Unrecognised connection id");
+    return handle;
   }
 
   void DataCollector::DataHandler(TransportEvent & ev) {
+    HandleData(*m_dataserver, ev);
+  }
+
+  void DataCollector::ShmDataHandler(TransportEvent & ev) {
+    HandleData(*m_shmserver, ev);
+  }
+
+  void DataCollector::HandleData(TransportServer & server, TransportEvent & ev) {
+    m_datalock.Lock();
+    try {
+      DataHandlerLocked(server, ev);
+    } catch (...) {
+      m_datalock.UnLock();
+      throw;
+    }
+    m_datalock.UnLock();
+  }
+
+  void DataCollector::DataHandlerLocked(TransportServer & server, TransportEvent & ev) {
     //std::cout << "Event: ";
     switch (ev.etype) {
       case (TransportEvent::CONNECT):
         //std::cout << "Connect:    " << ev.id << std::endl;
         if (m_listening) {
-          m_dataserver->SendPacket("OK EUDAQ DATA DataCollector", ev.id, true);
+          server.SendPacket("OK EUDAQ DATA DataCollector", ev.id, true);
         } else {
-          m_dataserver->SendPacket("ERROR EUDAQ DATA Not accepting new connections", ev.id, true);
-          m_dataserver->Close(ev.id);
+          server.SendPacket("ERROR EUDAQ DATA Not accepting new connections", ev.id, true);
+          server.Close(ev.id);
         }
         break;
       case (TransportEvent::DISCONNECT):
         //std::cout << "Disconnect: " << ev.id << std::endl;
-        OnDisconnect(ev.id);
+        if (ev.id.GetHandle() != ConnectionInfo::NOHANDLE) {
+          m_handles[ev.id.GetHandle()] = false;
+          Enqueue(Item::DISCONNECT, ev.id);
+        }
         break;
       case (TransportEvent::RECEIVE):
         if (ev.id.GetState() == 0) { // waiting for identification
@@ -261,21 +708,20 @@ namespace eudaq {
             ev.id.SetName(part);
           } while (false);
           //std::cout << "client replied, sending OK" << std::endl;
-          m_dataserver->SendPacket("OK", ev.id, true);
+          server.SendPacket("OK", ev.id, true);
           ev.id.SetState(1); // successfully identified
-          OnConnect(ev.id);
+          // number it so that its data can be found without searching
+          ev.id.SetHandle(std::find(m_handles.begin(), m_handles.end(), false) - m_handles.begin());
+          if (ev.id.GetHandle() == m_handles.size()) m_handles.push_back(true);
+          m_handles[ev.id.GetHandle()] = true;
+          Enqueue(Item::CONNECT, ev.id);
         } else {
           //std::cout << "Receive: " << ev.id << " " << ev.packet.size() << std::endl;
           //for (size_t i = 0; i < 8 && i < ev.packet.size(); ++i) {
           //    std::cout << to_hex(ev.packet[i], 2) << ' ';
           //}
           //std::cout << ")" << std::endl;
-          BufferSerializer ser(ev.packet.begin(), ev.packet.end());
-          //std::cout << "Deserializing" << std::endl;
-          counted_ptr<Event> event(EventFactory::Create(ser));
-          //std::cout << "Done" << std::endl;
-          OnReceive(ev.id, event);
-          //std::cout << "End" << std::endl;
+          Enqueue(Item::DATA, ev.id, &ev.packet);
         }
         break;
       default:
@@ -295,4 +741,183 @@ namespace eudaq {
     }
   }
 
+  void DataCollector::ShmDataThread() {
+    try {
+      while (!m_done) {
+        m_shmserver->Process(100000);
+      }
+    } catch (const std::exception & e) {
+      std::cout << "Error: Uncaught exception: " << e.what() << "\n" << "ShmDataThread is dying..." << std::endl;
+    } catch (...) {
+      std::cout << "Error: Uncaught unrecognised exception: \n" << "ShmDataThread is dying..." << std::endl;
+    }
+  }
+
+  void DataCollector::Enqueue(int type, const ConnectionInfo & id, std::string * packet) {
+    size_t seq = m_received.load();
+    for (;;) {
+      const unsigned epoch = m_onbuilt.Epoch();
+      if (seq - m_built.load() < PIPELINE_SIZE) break;
+      m_onbuilt.Wait(epoch);
+    }
+    Item & item = m_items[seq % PIPELINE_SIZE];
+    item.type = type;
+    item.handle = id.GetHandle();
+    // only a new connection needs a copy, later items just refer to it by handle
+    if (type == Item::CONNECT) item.id = counted_ptr<ConnectionInfo>(id.Clone());
+    if (packet) item.packet.swap(*packet);
+    item.state.store(Item::RECEIVED);
+    m_received.store(seq + 1);
+    m_onreceived.Notify();
+  }
+
+  void DataCollector::DecodeThread() {
+    Arena * arena = 0; ///< This thread's, for the events it decodes
+    for (;;) {
+      const unsigned epoch = m_onreceived.Epoch();
+      size_t seq = m_decoding.load();
+      if (seq == m_received.load()) {
+        if (m_stop.load()) break;
+        m_onreceived.Wait(epoch);
+        continue;
+      }
+      if (!m_decoding.compare_exchange(seq, seq + 1)) continue;
+      Item & item = m_items[seq % PIPELINE_SIZE];
+      if (item.type == Item::DATA) {
+        try {
+          const size_t arenasize = m_arenasize.load();
+          if (arena && (arena->Full() || arena->Capacity() != arenasize)) {
+            arena->Release();
+            arena = 0;
+          }
+          if (!arena && arenasize) arena = Arena::Create(arenasize);
+          // take over the packet, so that the raw data blocks of the event refer to it in place
+          // (keeping it alive on whichever thread drops the event last) instead of copying it
+          BufferDeserializer ser(ByteView::Adopt(item.packet));
+          ser.SetArena(arena);
+          item.event.reset(EventFactory::Create(ser));
+        } catch (const std::exception & e) {
+          item.error = e.what();
+        }
+      }
+      item.state.store(Item::DECODED);
+      m_ondecoded.Notify();
+    }
+    if (arena) arena->Release();
+  }
+
+  void DataCollector::BuildThread() {
+    for (;;) {
+      const unsigned epoch = m_ondecoded.Epoch();
+      size_t seq = m_built.load();
+      Item & item = m_items[seq % PIPELINE_SIZE];
+      if (item.state.load() != Item::DECODED) {
+        if (m_stop.load() && seq == m_received.load()) break;
+        // triggers or windows waiting for a producer that went quiet have to time out without more data arriving
+        double timeout = -1;
+        m_buildlock.Lock();
+        if (m_building == BUILD_TRIGGERID && (m_pending > 0 || !m_early.empty())) {
+          timeout = BuildByTriggerID(false);
+        } else if (m_building == BUILD_TIMESTAMP && !m_heap.empty()) {
+          timeout = BuildByTimestamp();
+        }
+        m_buildlock.UnLock();
+        m_ondecoded.Wait(epoch, timeout < 0 ? -1 : static_cast<int>(timeout * 1000) + 1);
+        continue;
+      }
+      m_buildlock.Lock();
+      try {
+        Handle(item);
+      } catch (const std::exception & e) {
+        EUDAQ_ERROR("Error handling data from connection " + to_string(item.handle) + ": " + e.what());
+      }
+      m_buildlock.UnLock();
+      item.id = counted_ptr<ConnectionInfo>();
+      item.event.reset();
+      item.error.clear();
+      item.state.store(Item::EMPTY);
+      m_built.store(seq + 1);
+      m_onbuilt.Notify();
+    }
+  }
+
+  void DataCollector::ResetBuffers() {
+    for (size_t i = 0; i < m_buffer.size(); ++i) {
+      if (m_buffer[i].id && m_buffer[i].events.size() > 0) {
+        EUDAQ_WARN("Buffer " + to_string(*m_buffer[i].id) + " has " + to_string(m_buffer[i].events.size()) + " events remaining.");
+        m_buffer[i].events.clear();
+      }
+    }
+    m_numwaiting = 0;
+    m_eventnumber = 0;
+    RebuildHeap();
+    for (size_t i = 0; i < m_reorder.size(); ++i) {
+      m_reorder[i] = Pending();
+    }
+    m_havenextid = false;
+    m_early.clear();
+    m_pending = m_partial = m_late = 0;
+  }
+
+  void DataCollector::Handle(Item & item) {
+    if (item.type == Item::CONNECT) {
+      OnConnect(*item.id);
+      return;
+    }
+    if (item.handle >= m_buffer.size() || !m_buffer[item.handle].id) EUDAQ_THROW("Unrecognised connection id");
+    const ConnectionInfo & id = *m_buffer[item.handle].id;
+    if (item.type == Item::DISCONNECT) {
+      OnDisconnect(id);
+    } else if (item.error != "") {
+      EUDAQ_ERROR("Unable to deserialize event from " + to_string(id) + ": " + item.error);
+    } else {
+      OnReceive(id, item.event);
+    }
+  }
+
+  void DataCollector::WriteThread() {
+    for (;;) {
+      const unsigned epoch = m_onqueued.Epoch();
+      DetectorEvent * ev = 0;
+      if (!m_writequeue.TryPop(ev)) {
+        if (m_stop.load() > 1) break;
+        m_onqueued.Wait(epoch);
+        continue;
+      }
+      m_writelock.Lock();
+      try {
+        if (m_writer.get()) {
+          m_writer->WriteEvent(*ev);
+        } else {
+          EUDAQ_ERROR("Event received before start of run");
+        }
+      } catch (const std::exception & e) {
+        EUDAQ_ERROR(std::string("Error writing event: ") + e.what());
+      }
+      m_writelock.UnLock();
+      delete ev;
+      m_written.store(m_written.load() + 1);
+      m_onwritten.Notify();
+    }
+  }
+
+  void DataCollector::Drain() {
+    const size_t received = m_received.load();
+    for (;;) {
+      const unsigned epoch = m_onbuilt.Epoch();
+      if (m_built.load() >= received) break;
+      m_onbuilt.Wait(epoch);
+    }
+    WaitWritten();
+  }
+
+  void DataCollector::WaitWritten() {
+    const size_t queued = m_queued.load();
+    for (;;) {
+      const unsigned epoch = m_onwritten.Epoch();
+      if (m_written.load() >= queued) break;
+      m_onwritten.Wait(epoch);
+    }
+  }
+
 }
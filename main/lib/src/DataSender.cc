@@ -50,6 +50,8 @@ namespace eudaq {
     ev.Serialize(ser);
     //EUDAQ_DEBUG("Sending event");
     m_dataclient->SendPacket(ser);
+    // nothing else may be sent for a while, so do not leave the end of the run queued
+    if (ev.IsEORE()) m_dataclient->Flush();
     //EUDAQ_DEBUG("Sent event");
   }
 
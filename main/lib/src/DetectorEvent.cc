@@ -2,27 +2,32 @@
 #include "eudaq/RawDataEvent.hh"
 
 #include <ostream>
+#include <algorithm>
 
 namespace eudaq {
 
   EUDAQ_DEFINE_EVENT(DetectorEvent, str2id("_DET"));
 
   DetectorEvent::DetectorEvent(Deserializer & ds) :
-    Event(ds)
+    Event(ds),
+    m_events(ArenaAllocator<EventPtr<Event> >(ds.GetArena()))
   {
     unsigned n;
     ds.read(n);
+    m_events.reserve(std::min(n, 256U));
     //std::cout << "Num=" << n << std::endl;
     for (size_t i = 0; i < n; ++i) {
-      counted_ptr<Event> ev(EventFactory::Create(ds));
+      EventPtr<Event> ev(EventFactory::Create(ds));
       m_events.push_back(ev);
     }
   }
 
-  void DetectorEvent::AddEvent(counted_ptr<Event> evt) {
+  void DetectorEvent::AddEvent(EventPtr<Event> evt) {
     if (!evt.get()) EUDAQ_THROW("Adding null event!");
-    m_events.push_back(evt);
     SetFlags(evt->GetFlags());
+    // take over the reference, rather than counting another one
+    m_events.push_back(EventPtr<Event>());
+    m_events.back().swap(evt);
   }
 
   void DetectorEvent::Print(std::ostream & os) const {
@@ -4,6 +4,7 @@
 #include "eudaq/EUDRBEvent.hh"
 #include "eudaq/Configuration.hh"
 #include "eudaq/Logger.hh"
+#include "eudaq/Mutex.hh"
 
 #if USE_LCIO
 #  include "IMPL/LCEventImpl.h"
@@ -33,9 +34,67 @@ using eutelescope::EUTELESCOPE;
 #include <vector>
 #include <memory>
 #include <iomanip>
+#include <cstring>
 
 namespace eudaq {
 
+  namespace {
+
+    /// Reads the 12 bit values of the MATS big endian samples of one pixel from each sub-matrix
+    template <unsigned MATS>
+      struct SampleGroup {
+        static void Read(const unsigned char * data, short * dest) {
+          for (unsigned m = 0; m < MATS; ++m) {
+            dest[m] = getbigendian<unsigned short>(data + 2 * m) & 0xfff;
+          }
+        }
+      };
+
+    /// Four sub-matrices (MIMOTEL, MIMOSA18) are read as one 64 bit word, swapping the bytes of all samples at once
+    template <>
+      struct SampleGroup<4> {
+        static void Read(const unsigned char * data, short * dest) {
+          unsigned long long w;
+          std::memcpy(&w, data, sizeof w);
+#if EUDAQ_LITTLE_ENDIAN
+          w = (w >> 8 & 0x00ff00ff00ff00ffULL) | (w << 8 & 0xff00ff00ff00ff00ULL);
+#endif
+          w &= 0x0fff0fff0fff0fffULL;
+          std::memcpy(dest, &w, sizeof w);
+        }
+      };
+
+    /** Reads the samples of npixels pixels in NFRAMES frames, as the EUDRB
+     *  sends them: for each pixel of every sub-matrix, one sample per
+     *  sub-matrix for each frame in turn. Each frame goes to its own array.
+     */
+    template <unsigned MATS, unsigned NFRAMES>
+      void ReadFrames(const unsigned char * data, size_t npixels, short * const * frames) {
+        for (size_t p = 0; p < npixels; p += MATS) {
+          for (unsigned f = 0; f < NFRAMES; ++f, data += 2 * MATS) {
+            SampleGroup<MATS>::Read(data, frames[f] + p);
+          }
+        }
+      }
+
+    /// As above, for the layout of any sensor and mode
+    void ReadFrames(const unsigned char * data, size_t npixels, unsigned mats, unsigned nframes, short * const * frames) {
+      if (mats == 4 && nframes == 1) return ReadFrames<4, 1>(data, npixels, frames);
+      if (mats == 4 && nframes == 2) return ReadFrames<4, 2>(data, npixels, frames);
+      if (mats == 4 && nframes == 3) return ReadFrames<4, 3>(data, npixels, frames);
+      if (mats == 1 && nframes == 2) return ReadFrames<1, 2>(data, npixels, frames);
+      if (mats == 1 && nframes == 3) return ReadFrames<1, 3>(data, npixels, frames);
+      for (size_t p = 0; p < npixels; p += mats) {
+        for (unsigned f = 0; f < nframes; ++f) {
+          for (unsigned m = 0; m < mats; ++m, data += 2) {
+            frames[f][p + m] = getbigendian<unsigned short>(data) & 0xfff;
+          }
+        }
+      }
+    }
+
+  }
+
   void map_1x1(unsigned & x, unsigned & y, unsigned c, unsigned r, unsigned, unsigned, unsigned) {
     x = c;
     y = r;
@@ -74,9 +133,9 @@ namespace eudaq {
   struct BoardInfo {
     enum E_DET  { DET_NONE = -1, DET_MIMOSTAR2, DET_MIMOTEL, DET_MIMOTEL_NEWORDER, DET_MIMOSA18, DET_MIMOSA5, DET_MIMOSA26 };
     enum E_MODE { MODE_NONE = -1, MODE_ZS, MODE_RAW1, MODE_RAW2, MODE_RAW3, MODE_ZS2 };
-    BoardInfo() : m_version(0), m_det(DET_MIMOTEL), m_mode(MODE_RAW3) {}
+    BoardInfo() : m_version(0), m_det(DET_MIMOTEL), m_mode(MODE_RAW3), m_map(0) {}
     BoardInfo(const Event & ev, int brd)
-      : m_version(0), m_det(DET_NONE), m_mode(MODE_NONE)
+      : m_version(0), m_det(DET_NONE), m_mode(MODE_NONE), m_map(0)
     {
       std::string det = ev.GetTag("DET" + to_string(brd));
       if (det == "") det = ev.GetTag("DET", "MIMOTEL");
@@ -117,10 +176,64 @@ namespace eudaq {
     int m_version;
     E_DET m_det;
     E_MODE m_mode;
+    unsigned m_map; ///< Index of the board's PixelMap in EUDRBConverterBase
+  };
+
+  /** The mapping of one sensor type and data version, worked out once for
+   *  every pixel in readout order (row by row, column by column, then
+   *  sub-matrix), so that converting an event only needs to look it up.
+   */
+  struct PixelMap {
+    PixelMap(const SensorInfo & s, int version)
+      : sensor(&s), version(version)
+    {
+      const size_t n = s.cols * s.rows * s.mats;
+      x.resize(n);
+      y.resize(n);
+      pivotaddr.resize(n);
+      const unsigned shift = version < 2 ? 7 : 9;
+      size_t p = 0;
+      for (unsigned row = 0; row < s.rows; ++row) {
+        for (unsigned col = 0; col < s.cols; ++col) {
+          for (unsigned mat = 0; mat < s.mats; ++mat, ++p) {
+            unsigned px = 0, py = 0;
+            s.mapfunc(px, py, col, row, mat, s.cols, s.rows);
+            x[p] = px;
+            y[p] = py;
+            pivotaddr[p] = row << shift | col;
+          }
+        }
+      }
+    }
+    /// Maps a pixel as mapfunc would
+    void Map(unsigned & px, unsigned & py, unsigned col, unsigned row, unsigned mat) const {
+      if (col < sensor->cols && row < sensor->rows && mat < sensor->mats) {
+        const size_t p = (row * sensor->cols + col) * sensor->mats + mat;
+        px = x[p];
+        py = y[p];
+      } else {
+        sensor->mapfunc(px, py, col, row, mat, sensor->cols, sensor->rows);
+      }
+    }
+    const SensorInfo * sensor;
+    int version;
+    std::vector<unsigned short> x, y;
+    /// The address compared with the pivot pixel
+    std::vector<unsigned> pivotaddr;
+  };
+
+  /// The buffers ConvertRaw needs, kept from event to event so that it does not allocate them each time
+  struct RawScratch {
+    std::vector<short> samples; ///< All the frames, one after the other
+    std::vector<short *> frames; ///< Where each frame starts in samples
+    std::vector<unsigned char> pivots;
   };
 
   class EUDRBConverterBase {
     public:
+      ~EUDRBConverterBase() {
+        for (size_t i = 0; i < m_scratch.size(); ++i) delete m_scratch[i];
+      }
       void FillInfo(const Event & bore, const Configuration &) {
         unsigned nboards = from_string(bore.GetTag("BOARDS"), 0);
         //std::cout << "FillInfo " << nboards << std::endl;
@@ -128,21 +241,26 @@ namespace eudaq {
           unsigned id = from_string(bore.GetTag("ID" + to_string(i)), i);
           if (m_info.size() <= id) m_info.resize(id+1);
           m_info[id] = BoardInfo(bore, i);
+          m_info[id].m_map = FindMap(m_info[id]);
         }
       }
       const BoardInfo & GetInfo(unsigned id) const {
         if (id >= m_info.size() || m_info[id].m_version < 1) EUDAQ_THROW("Unrecognised ID ("+to_string(id)+", num="+to_string(m_info.size())+") converting EUDRB event");
         return m_info[id];
       }
-      static unsigned GetTLUEvent(const std::vector<unsigned char> & data) {
-        const unsigned word = getbigendian<unsigned>(&data[data.size() - 8]);
+      static unsigned GetTLUEvent(const ByteView & data) {
+        return GetTLUEvent(data.data(), data.size());
+      }
+      static unsigned GetTLUEvent(const unsigned char * data, size_t size) {
+        const unsigned word = getbigendian<unsigned>(data + size - 8);
         return word>>8 & 0xffff;
       }
       void ConvertLCIOHeader(lcio::LCRunHeader & header, eudaq::Event const & bore, eudaq::Configuration const & conf) const;
       bool ConvertStandard(StandardEvent & stdEvent, const Event & eudaqEvent) const;
-      StandardPlane ConvertPlane(const std::vector<unsigned char> & data, unsigned id, StandardEvent & evt) const {
+      /// Fills plane, which may be reused from a previous event
+      void ConvertPlane(StandardPlane & plane, const ByteView & data, unsigned id, StandardEvent & evt) const {
         const BoardInfo & info = GetInfo(id);
-        StandardPlane plane(id, "EUDRB", info.Sensor().name);
+        plane.Reset(id, "EUDRB", info.Sensor().name);
         plane.SetXSize(info.Sensor().width);
         plane.SetYSize(info.Sensor().height);
         plane.SetTLUEvent(GetTLUEvent(data));
@@ -150,15 +268,22 @@ namespace eudaq {
           unsigned numoverflows = ConvertZS2(plane, data, info);
           if (numoverflows) evt.SetTag("OVF" + to_string(id), numoverflows);
         } else if (info.m_mode == BoardInfo::MODE_ZS) {
-          ConvertZS(plane, data, info);
+          ConvertZS(plane, data, info, m_maps[info.m_map]);
         } else {
-          ConvertRaw(plane, data, info);
+          RawScratch * scratch = TakeScratch();
+          try {
+            ConvertRaw(plane, data, info, m_maps[info.m_map], *scratch);
+          } catch (...) {
+            ReturnScratch(scratch);
+            throw;
+          }
+          ReturnScratch(scratch);
         }
-        return plane;
       }
-      static unsigned ConvertZS2(StandardPlane & plane, const std::vector<unsigned char> & alldata, const BoardInfo & info);
-      static void ConvertZS(StandardPlane & plane, const std::vector<unsigned char> & alldata, const BoardInfo & info);
-      static void ConvertRaw(StandardPlane & plane, const std::vector<unsigned char> & data, const BoardInfo & info);
+      static unsigned ConvertZS2(StandardPlane & plane, const ByteView & alldata, const BoardInfo & info);
+      static void ConvertZS(StandardPlane & plane, const ByteView & alldata, const BoardInfo & info, const PixelMap & map);
+      static void ConvertRaw(StandardPlane & plane, const ByteView & data, const BoardInfo & info, const PixelMap & map,
+          RawScratch & scratch);
       bool ConvertLCIO(lcio::LCEvent & lcioEvent, const Event & eudaqEvent) const;
     protected:
       static size_t NumPlanes(const Event & event) {
@@ -169,13 +294,14 @@ namespace eudaq {
         }
         return 0;
       }
-      static std::vector<unsigned char> GetPlane(const Event & event, size_t i) {
+      static ByteView GetPlane(const Event & event, size_t i) {
         if (const RawDataEvent * ev = dynamic_cast<const RawDataEvent *>(&event)) {
-          return ev->GetBlock(i);
+          return ev->GetBlockView(i);
         } else if (const EUDRBEvent * ev = dynamic_cast<const EUDRBEvent *>(&event)) {
-          return ev->GetBoard(i).GetDataVector();
+          std::vector<unsigned char> data = ev->GetBoard(i).GetDataVector();
+          return ByteView::Adopt(data);
         }
-        return std::vector<unsigned char>();
+        return ByteView();
       }
       static size_t GetID(const Event & event, size_t i) {
         if (const RawDataEvent * ev = dynamic_cast<const RawDataEvent *>(&event)) {
@@ -185,7 +311,38 @@ namespace eudaq {
         }
         return 0;
       }
+      /// The index of the pixel map for a board, making it if it is not there from an earlier run
+      unsigned FindMap(const BoardInfo & info) {
+        for (size_t i = 0; i < m_maps.size(); ++i) {
+          if (m_maps[i].sensor == &info.Sensor() && m_maps[i].version == info.m_version) return i;
+        }
+        m_maps.push_back(PixelMap(info.Sensor(), info.m_version));
+        return m_maps.size() - 1;
+      }
+      /// Scratch buffers for one conversion, as several threads may convert at once
+      RawScratch * TakeScratch() const {
+        RawScratch * scratch = 0;
+        m_scratchlock.Lock();
+        if (!m_scratch.empty()) {
+          scratch = m_scratch.back();
+          m_scratch.pop_back();
+        }
+        m_scratchlock.UnLock();
+        return scratch ? scratch : new RawScratch;
+      }
+      void ReturnScratch(RawScratch * scratch) const {
+        m_scratchlock.Lock();
+        try {
+          m_scratch.push_back(scratch);
+        } catch (...) {
+          delete scratch;
+        }
+        m_scratchlock.UnLock();
+      }
       std::vector<BoardInfo> m_info;
+      std::vector<PixelMap> m_maps;
+      mutable Mutex m_scratchlock; ///< Protects m_scratch
+      mutable std::vector<RawScratch *> m_scratch; ///< Scratch buffers not in use
   };
 
   /********************************************/
@@ -199,14 +356,17 @@ namespace eudaq {
       virtual unsigned GetTriggerID(Event const & ev) const {
         const RawDataEvent & rawev = dynamic_cast<const RawDataEvent &>(ev);
         if (rawev.NumBlocks() < 1) return (unsigned)-1;
-        const std::vector<unsigned char> & data = rawev.GetBlock(rawev.NumBlocks() - 1);
-        return GetTLUEvent(data);
+        const ByteView data = rawev.GetBlockView(rawev.NumBlocks() - 1);
+        return GetTLUEvent(data.data(), data.size());
       }
 
       virtual bool GetStandardSubEvent(StandardEvent & result, const Event & source) const {
         return ConvertStandard(result, source);
       }
 
+      /// The board information only changes in Initialize
+      virtual bool IsThreadSafe() const { return true; }
+
 #if USE_LCIO && USE_EUTELESCOPE
       virtual void GetLCIORunHeader(lcio::LCRunHeader & header, eudaq::Event const & bore, eudaq::Configuration const & conf) const {
         return ConvertLCIOHeader(header, bore, conf);
@@ -234,14 +394,16 @@ namespace eudaq {
     virtual unsigned GetTriggerID(Event const & ev) const {
       const RawDataEvent & rawev = dynamic_cast<const RawDataEvent &>(ev);
       if (rawev.NumBlocks() < 1) return (unsigned)-1;
-      const std::vector<unsigned char> & data = rawev.GetBlock(0);
-      return GetTLUEvent(data);
+      const ByteView data = rawev.GetBlockView(0);
+      return GetTLUEvent(data.data(), data.size());
     }
 
     virtual bool GetStandardSubEvent(StandardEvent & result, const Event & source) const {
       return ConvertStandard(result, source);
     }
 
+    virtual bool IsThreadSafe() const { return true; }
+
 #if USE_LCIO && USE_EUTELESCOPE
     virtual void GetLCIORunHeader(lcio::LCRunHeader & header, eudaq::Event const & bore, eudaq::Configuration const & conf) const {
       return ConvertLCIOHeader(header, bore, conf);
@@ -272,13 +434,20 @@ namespace eudaq {
     // If we get here it must be a data event
     size_t numplanes = NumPlanes(source);
     for (size_t i = 0; i < numplanes; ++i) {
-      result.AddPlane(ConvertPlane(GetPlane(source, i), GetID(source, i), result));
+      unsigned id = GetID(source, i);
+      StandardPlane & plane = result.NewPlane(id, "EUDRB");
+      try {
+        ConvertPlane(plane, GetPlane(source, i), id, result);
+      } catch (...) {
+        result.PopPlane();
+        throw;
+      }
     }
     return true;
   }
 
 #define GET(o) getbigendian<unsigned>(&alldata[(o)*4])
-  unsigned EUDRBConverterBase::ConvertZS2(StandardPlane & plane, const std::vector<unsigned char> & alldata, const BoardInfo & info) {
+  unsigned EUDRBConverterBase::ConvertZS2(StandardPlane & plane, const ByteView & alldata, const BoardInfo & info) {
     static const bool dbg  = false;
     static const bool dbg2 = false;
     if (dbg) std::cout << "DataSize = " << hexdec(alldata.size(), 0) << std::endl;
@@ -386,7 +555,7 @@ namespace eudaq {
   }
 #undef GET
 
-  void EUDRBConverterBase::ConvertZS(StandardPlane & plane, const std::vector<unsigned char> & alldata, const BoardInfo & info) {
+  void EUDRBConverterBase::ConvertZS(StandardPlane & plane, const ByteView & alldata, const BoardInfo & info, const PixelMap & map) {
     unsigned headersize = 8, trailersize = 8;
     if (info.m_version > 2) {
       headersize += 8;
@@ -408,7 +577,7 @@ namespace eudaq {
         col = ((data[4*i+1] & 0x1F) << 4) | (data[4*i+2] >> 4);
       }
       unsigned x, y;
-      info.Sensor().mapfunc(x, y, col, row, mat, info.Sensor().cols, info.Sensor().rows);
+      map.Map(x, y, col, row, mat);
       unsigned pix = ((data[4*i+2] & 0x0F) << 8) | (data[4*i+3]);
       plane.SetPixel(i, x, y, pix);
       //plane.m_x[i] = x;
@@ -418,7 +587,8 @@ namespace eudaq {
     }
   }
 
-  void EUDRBConverterBase::ConvertRaw(StandardPlane & plane, const std::vector<unsigned char> & data, const BoardInfo & info) {
+  void EUDRBConverterBase::ConvertRaw(StandardPlane & plane, const ByteView & data, const BoardInfo & info, const PixelMap & map,
+      RawScratch & scratch) {
     unsigned headersize = 8, trailersize = 8;
     if (info.m_version > 2) {
       headersize += 8;
@@ -436,38 +606,25 @@ namespace eudaq {
       EUDAQ_THROW("Bad raw data size (" + to_string(data.size() - headersize - trailersize)+") expecting "
           + to_string(possible1) + " or " + to_string(possible2));
     }
-    //unsigned npixels = info.Sensor().cols * info.Sensor().rows * info.Sensor().mats;
     plane.SetSizeRaw(info.Sensor().width, info.Sensor().height, info.Frames(), StandardPlane::FLAG_WITHPIVOT | StandardPlane::FLAG_NEEDCDS | StandardPlane::FLAG_NEGATIVE);
-    //plane.m_mat.resize(plane.m_pix[0].size());
-    const unsigned char * ptr = &data[headersize];
-    for (unsigned row = 0; row < info.Sensor().rows; ++row) {
-      for (unsigned col = 0; col < info.Sensor().cols; ++col) {
-        if (missingpixel && row == info.Sensor().rows-1 && col == info.Sensor().cols-1) break; // last pixel is not transferred
-        for (size_t frame = 0; frame < info.Frames(); ++frame) {
-          for (size_t mat = 0; mat < info.Sensor().mats; ++mat) {
-            unsigned x = 0, y = 0;
-            info.Sensor().mapfunc(x, y, col, row, mat, info.Sensor().cols, info.Sensor().rows);
-            size_t i = x + y*info.Sensor().width;
-            // if (frame == 0) {
-            //   plane.m_x[i] = x;
-            //   plane.m_y[i] = y;
-            //   plane.m_mat[i] = mat;
-            //   if (info.m_version < 2) {
-            //     plane.m_pivot[i] = (row << 7 | col) >= plane.m_pivotpixel;
-            //   } else {
-            //     plane.m_pivot[i] = (row << 9 | col) >= plane.m_pivotpixel;
-            //   }
-            // }
-            short pix = *ptr++ << 8;
-            pix |= *ptr++;
-            pix &= 0xfff;
-            //plane.m_pix[frame][i] = pix;
-            bool pivot = (info.m_version < 2) ? (row << 7 | col) >= plane.PivotPixel() : (row << 9 | col) >= plane.PivotPixel();
-            plane.SetPixel(i, x, y, pix, pivot, frame);
-          }
-        }
-      }
+    const SensorInfo & sensor = info.Sensor();
+    const unsigned frames = info.Frames();
+    // the pixels are read out row by row, column by column, then for each frame the sub-matrices in turn
+    const size_t npixels = (sensor.cols * sensor.rows - missingpixel) * sensor.mats;
+    if (npixels == 0) return;
+    if (scratch.samples.size() < npixels * frames) scratch.samples.resize(npixels * frames);
+    scratch.frames.resize(frames);
+    for (unsigned frame = 0; frame < frames; ++frame) {
+      scratch.frames[frame] = &scratch.samples[frame * npixels];
+    }
+    ReadFrames(&data[headersize], npixels, sensor.mats, frames, &scratch.frames[0]);
+    if (scratch.pivots.size() < npixels) scratch.pivots.resize(npixels);
+    unsigned char * pivots = &scratch.pivots[0];
+    const unsigned pivotpixel = plane.PivotPixel();
+    for (size_t p = 0; p < npixels; ++p) {
+      pivots[p] = map.pivotaddr[p] >= pivotpixel;
     }
+    plane.SetRawPixels(npixels, &map.x[0], &map.y[0], pivots, &scratch.frames[0]);
   }
 
 #if USE_LCIO && USE_EUTELESCOPE
@@ -559,7 +716,8 @@ namespace eudaq {
     for (size_t iPlane = 0; iPlane < numplanes; ++iPlane) {
 
       StandardEvent tmp_evt;
-      StandardPlane plane = ConvertPlane(GetPlane(source, iPlane), GetID(source, iPlane), tmp_evt);
+      StandardPlane plane;
+      ConvertPlane(plane, GetPlane(source, iPlane), GetID(source, iPlane), tmp_evt);
 
       // The current detector is ...
       eutelescope::EUTelPixelDetector * currentDetector = 0x0;
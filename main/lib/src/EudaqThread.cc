@@ -30,7 +30,7 @@ eudaq::eudaqThread::~eudaqThread()
 {
 	if (m_impl!=nullptr)
 	{
-		m_impl->t1.join();
+		if (m_impl->t1.joinable()) m_impl->t1.join();
 		delete m_impl;
 		m_impl=nullptr;
 	}
@@ -49,7 +49,7 @@ void eudaq::eudaqThread::detach()
 
 void eudaq::eudaqThread::join()
 {
-	if (m_impl!=nullptr)
+	if (m_impl!=nullptr && m_impl->t1.joinable())
 	{
 		m_impl->t1.join();
 	}
@@ -2,21 +2,57 @@
 #include <iostream>
 
 #include "eudaq/Event.hh"
+#include "eudaq/Arena.hh"
 
 namespace eudaq {
 
   namespace {
 
+    /// Goes in front of every event allocated with new, to know where its memory came from
+    union AllocHeader {
+      Arena * arena; ///< Or 0 if it is on the heap
+      double align[2];
+    };
+
     static const char * const FLAGNAMES[] = {
       "BORE",
       "EORE",
       "HITS",
       "FAKE",
-      "SIMU"
+      "SIMU",
+      "PART"
     };
 
   }
 
+  void * Event::operator new(size_t size) {
+    AllocHeader * header = static_cast<AllocHeader *>(::operator new(sizeof (AllocHeader) + size));
+    header->arena = 0;
+    return header + 1;
+  }
+
+  void * Event::operator new(size_t size, Arena & arena) {
+    AllocHeader * header = static_cast<AllocHeader *>(arena.Allocate(sizeof (AllocHeader) + size));
+    if (!header) return Event::operator new(size);
+    header->arena = &arena;
+    arena.AddRef();
+    return header + 1;
+  }
+
+  void Event::operator delete(void * p) {
+    if (!p) return;
+    AllocHeader * header = static_cast<AllocHeader *>(p) - 1;
+    if (header->arena) {
+      header->arena->Release();
+    } else {
+      ::operator delete(header);
+    }
+  }
+
+  void Event::operator delete(void * p, Arena &) {
+    Event::operator delete(p);
+  }
+
   Event::Event(Deserializer & ds) {
     ds.read(m_flags);
     ds.read(m_runnumber);
@@ -51,9 +87,9 @@ namespace eudaq {
         }
       }
     }
-    if (m_tags.size() > 0) {
-      for (map_t::const_iterator i = m_tags.begin(); i != m_tags.end(); ++i) {
-        os << (i == m_tags.begin() ? ", {" : ", ")  << i->first << "=" << i->second;
+    if (!m_tags.Empty()) {
+      for (size_t i = 0; i < m_tags.Size(); ++i) {
+        os << (i == 0 ? ", {" : ", ")  << m_tags.Name(i) << "=" << m_tags.Value(i).Text();
       }
       os << "}";
     }
@@ -86,14 +122,13 @@ namespace eudaq {
   }
 
   Event & Event::SetTag(const std::string & name, const std::string & val) {
-    m_tags[name] = val;
+    m_tags.Set(name, TagValue(val));
     return *this;
   }
 
   std::string Event::GetTag(const std::string & name, const std::string & def) const {
-    std::map<std::string, std::string>::const_iterator i = m_tags.find(name);
-    if (i == m_tags.end()) return def;
-    return i->second;
+    const TagValue * val = m_tags.Find(name);
+    return val ? val->Text() : def;
   }
 
   std::ostream & operator << (std::ostream &os, const Event &ev) {
@@ -112,8 +147,9 @@ namespace eudaq {
   }
 
   EventFactory::event_creator EventFactory::GetCreator(unsigned long id) {
-    // TODO: check it exists...
-    return get_map()[id];
+    // only look, so that several threads can deserialize at the same time
+    map_t::const_iterator it = get_map().find(id);
+    return it == get_map().end() ? 0 : it->second;
   }
 
 }
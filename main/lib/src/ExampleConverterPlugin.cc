@@ -44,9 +44,9 @@ namespace eudaq {
           // This is just an example, modified it to suit your raw data format
           // Make sure we have at least one block of data, and it is large enough
           if (rev->NumBlocks() > 0 &&
-              rev->GetBlock(0).size() >= (TRIGGER_OFFSET + sizeof(short))) {
+              rev->GetBlockView(0).size() >= (TRIGGER_OFFSET + sizeof(short))) {
             // Read a little-endian unsigned short from offset TRIGGER_OFFSET
-            return getlittleendian<unsigned short> (&rev->GetBlock(0)[TRIGGER_OFFSET]);
+            return getlittleendian<unsigned short> (&rev->GetBlockView(0)[TRIGGER_OFFSET]);
           }
         }
         // If we are unable to extract the Trigger ID, signal with (unsigned)-1
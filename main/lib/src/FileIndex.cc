@@ -0,0 +1,123 @@
+#include "eudaq/FileIndex.hh"
+#include "eudaq/DetectorEvent.hh"
+#include "eudaq/PluginManager.hh"
+#include "eudaq/Exception.hh"
+#include <algorithm>
+
+namespace eudaq {
+
+  namespace {
+    static const unsigned INDEXTAG = Event::str2id("EIDX");
+    static const unsigned INDEXVERSION = 1;
+  }
+
+  FileIndex::Entry FileIndex::MakeEntry(const Event & ev, unsigned long long offset, unsigned long long length,
+      const PluginStreams * streams) {
+    unsigned triggerid = (unsigned)-1;
+    const DetectorEvent * dev = dynamic_cast<const DetectorEvent *>(&ev);
+    for (size_t i = 0; dev && i < dev->NumEvents() && triggerid == (unsigned)-1; ++i) {
+      try {
+        triggerid = streams ? streams->GetTriggerID(*dev, i) : PluginManager::GetTriggerID(*dev->GetEvent(i));
+      } catch (const Exception &) {
+        // no plugin for this type of event
+      }
+    }
+    return Entry(ev.GetEventNumber(), triggerid, ev.GetFlags(), offset, length);
+  }
+
+  bool FileIndex::Load(const std::string & datafile) {
+    Clear();
+    try {
+      FileDeserializer des(Filename(datafile), true);
+      unsigned tag = 0, version = 0;
+      des.read(tag);
+      des.read(version);
+      if (tag != INDEXTAG || version != INDEXVERSION) return false;
+      while (des.HasData()) {
+        Entry e;
+        des.read(e.eventnumber);
+        des.read(e.triggerid);
+        des.read(e.flags);
+        des.read(e.offset);
+        des.read(e.length);
+        Add(e);
+      }
+    } catch (const FileReadException &) {
+      // the last entry is still being written, use the ones before it
+      return m_entries.size() > 0;
+    } catch (const Exception &) {
+      Clear();
+      return false;
+    }
+    return true;
+  }
+
+  void FileIndex::Clear() {
+    m_entries.clear();
+    m_sorted.clear();
+    m_insorted = true;
+  }
+
+  void FileIndex::Add(const Entry & entry) {
+    if (m_entries.size() > 0 && entry.eventnumber < m_entries.back().eventnumber) m_insorted = false;
+    m_entries.push_back(entry);
+  }
+
+  namespace {
+    struct EntryLess {
+      bool operator () (const FileIndex::Entry & e, unsigned n) const { return e.eventnumber < n; }
+    };
+  }
+
+  size_t FileIndex::Find(unsigned eventnumber) const {
+    if (m_insorted) {
+      std::vector<Entry>::const_iterator it = std::lower_bound(m_entries.begin(), m_entries.end(), eventnumber, EntryLess());
+      if (it == m_entries.end() || it->eventnumber != eventnumber) return npos;
+      return it - m_entries.begin();
+    }
+    if (m_sorted.size() < m_entries.size()) {
+      const size_t sorted = m_sorted.size();
+      m_sorted.reserve(m_entries.size());
+      for (size_t i = sorted; i < m_entries.size(); ++i) {
+        m_sorted.push_back(std::make_pair(m_entries[i].eventnumber, i));
+      }
+      std::sort(m_sorted.begin() + sorted, m_sorted.end());
+      std::inplace_merge(m_sorted.begin(), m_sorted.begin() + sorted, m_sorted.end());
+    }
+    std::vector<std::pair<unsigned, size_t> >::const_iterator it =
+      std::lower_bound(m_sorted.begin(), m_sorted.end(), std::make_pair(eventnumber, (size_t)0));
+    if (it == m_sorted.end() || it->first != eventnumber) return npos;
+    return it->second;
+  }
+
+  FileIndexWriter::FileIndexWriter(const std::string & datafile)
+    : m_ser(FileIndex::Filename(datafile), true), m_streams(new PluginStreams) {
+    m_ser.write(INDEXTAG);
+    m_ser.write(INDEXVERSION);
+  }
+
+  FileIndexWriter::~FileIndexWriter() {
+    delete m_streams;
+  }
+
+  FileIndex::Entry FileIndexWriter::Write(const Event & ev, unsigned long long offset, unsigned long long length) {
+    FileIndex::Entry entry = MakeEntry(ev, offset, length);
+    Write(entry);
+    return entry;
+  }
+
+  FileIndex::Entry FileIndexWriter::MakeEntry(const Event & ev, unsigned long long offset, unsigned long long length) {
+    const DetectorEvent * dev = dynamic_cast<const DetectorEvent *>(&ev);
+    if (dev && dev->IsBORE()) m_streams->Reset(*dev);
+    return FileIndex::MakeEntry(ev, offset, length, m_streams);
+  }
+
+  void FileIndexWriter::Write(const FileIndex::Entry & e) {
+    m_ser.write(e.eventnumber);
+    m_ser.write(e.triggerid);
+    m_ser.write(e.flags);
+    m_ser.write(e.offset);
+    m_ser.write(e.length);
+  }
+
+}
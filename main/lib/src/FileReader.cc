@@ -3,6 +3,10 @@
 #include "eudaq/PluginManager.hh"
 #include "eudaq/Event.hh"
 #include "eudaq/Logger.hh"
+#include "eudaq/Compression.hh"
+#include "eudaq/BufferSerializer.hh"
+#include "eudaq/BoundedQueue.hh"
+#include "eudaq/EudaqThread.hh"
 
 #include <list>
 
@@ -17,18 +21,18 @@ namespace eudaq {
 
   struct FileReader::eventqueue_t {
     struct item_t {
-      item_t(DetectorEvent * ev = 0) : event(ev) {
+      item_t(DetectorEvent * ev, const PluginStreams & streams) : event(ev) {
         if (ev) {
           for (size_t i = 0; i < ev->NumEvents(); ++i) {
-            triggerids.push_back(PluginManager::GetTriggerID(*ev->GetEvent(i)));
+            triggerids.push_back(streams.GetTriggerID(*ev, i));
           }
         }
       }
-      eudaq::DetectorEvent * event;
+      EventPtr<eudaq::DetectorEvent> event; ///< Freed once the item is dropped and its sub-events regrouped
       std::vector<unsigned>  triggerids;
     };
-    eventqueue_t(unsigned numproducers = 0)
-      : offsets(numproducers, items.end()), firstid((unsigned)-1), lastid(0) {}
+    eventqueue_t(const DetectorEvent & bore)
+      : offsets(bore.NumEvents(), items.end()), streams(bore), firstid((unsigned)-1), lastid(0) {}
     bool isempty() const {
       for (size_t i = 0; i < offsets.size(); ++i) {
         if (events(i) == 0) {
@@ -52,7 +56,7 @@ namespace eudaq {
     }
     void push(eudaq::Event * ev) {
       DetectorEvent * dev = dynamic_cast<DetectorEvent *>(ev);
-      items.push_front(item_t(dev));
+      items.push_front(item_t(dev, streams));
     }
     void discardevent(size_t producer) {
       --offsets[producer];
@@ -142,6 +146,7 @@ namespace eudaq {
     }
     std::list<item_t> items;
     std::vector<std::list<item_t>::const_iterator> offsets;
+    PluginStreams streams; ///< Looked up from the BORE
     unsigned firstid, lastid;
   };
 
@@ -151,8 +156,159 @@ namespace eudaq {
   }
 
   namespace {
+    void * blockreader_thread(void * arg);
+  }
+
+  /** Reads and decompresses the blocks of a compressed file on its own thread,
+   *  keeping a few blocks ahead of the events being read.
+   *  The thread stops at the end of the data currently in the file, and is
+   *  started again on the next read in case the file is still being written.
+   */
+  class FileReader::blockreader_t {
+    public:
+      blockreader_t(FileDeserializer & des)
+        : m_des(des), m_queue(4), m_stop(0), m_running(false), m_offset(0), m_remaining(0) {}
+      ~blockreader_t() {
+        if (m_running) {
+          m_stop.store(1);
+          m_des.Interrupt();
+          m_thread.join();
+        }
+        block_t * b = 0;
+        while (m_queue.TryPop(b)) delete b;
+      }
+      /// Reads skip+1 events, decoding only the last; as for the uncompressed formats
+      bool Read(eudaq::Event * & ev, size_t skip) {
+        ByteView record;
+        bool result = false;
+        for (size_t i = 0; i <= skip; ++i) {
+          if (m_remaining == 0 && !NextBlock()) break;
+          // only the lengths of the skipped events are read
+          BufferDeserializer block(m_block);
+          block.Seek(m_offset);
+          block.read(record);
+          m_offset = block.Offset();
+          --m_remaining;
+          result = true;
+        }
+        if (result) {
+          BufferDeserializer des(record);
+          ev = EventFactory::Create(des);
+        }
+        return result;
+      }
+      void Thread() {
+        for (;;) {
+          block_t * b = new block_t;
+          try {
+            if (m_stop.load() || !m_des.HasData()) {
+              b->status = block_t::END;
+            } else {
+              unsigned codec = 0, rawsize = 0;
+              ByteView data;
+              m_des.read(codec);
+              m_des.read(b->nevents);
+              m_des.read(b->firstevent);
+              m_des.read(rawsize);
+              m_des.read(data);
+              if (codec == Compression::CODEC_NONE) {
+                // refers to the file mapping, which is then shared with the reading thread
+                b->data = data;
+              } else {
+                std::vector<unsigned char> raw(rawsize);
+                Compression::Decompress(codec, data.data(), data.size(), &raw[0], raw.size());
+                b->data = ByteView::Adopt(raw);
+              }
+            }
+          } catch (const InterruptedException &) {
+            b->status = block_t::INTERRUPTED;
+          } catch (const std::exception & e) {
+            b->status = block_t::FAILED;
+            b->error = e.what();
+          }
+          bool last = b->status != block_t::OK;
+          Backoff wait;
+          while (!m_queue.TryPush(b)) {
+            if (m_stop.load()) {
+              delete b;
+              return;
+            }
+            wait();
+          }
+          if (last) return;
+        }
+      }
+    private:
+      struct block_t {
+        enum status_t { OK, END, INTERRUPTED, FAILED };
+        block_t() : nevents(0), firstevent(0), status(OK) {}
+        ByteView data;
+        unsigned nevents, firstevent;
+        status_t status;
+        std::string error;
+      };
+      bool NextBlock() {
+        if (!m_running) {
+          m_thread.start(blockreader_thread, this);
+          m_running = true;
+        }
+        block_t * b = 0;
+        Backoff wait;
+        while (!m_queue.TryPop(b)) wait();
+        if (b->status != block_t::OK) {
+          block_t::status_t status = b->status;
+          std::string error = b->error;
+          delete b;
+          m_thread.join();
+          m_running = false;
+          if (status == block_t::INTERRUPTED) throw InterruptedException();
+          if (status == block_t::FAILED) EUDAQ_THROWX(FileReadException, error);
+          return false;
+        }
+        m_block = b->data;
+        m_offset = 0;
+        m_remaining = b->nevents;
+        delete b;
+        return true;
+      }
+      FileDeserializer & m_des;
+      BoundedQueue<block_t *> m_queue;
+      Atomic<int> m_stop;
+      eudaqThread m_thread;
+      bool m_running;
+      ByteView m_block; ///< The uncompressed block being read
+      size_t m_offset; ///< Of the next event in m_block
+      unsigned m_remaining; ///< Events left in m_block
+  };
 
-    static bool ReadEvent(FileDeserializer & des, int ver, eudaq::Event * & ev, size_t skip = 0) {
+  namespace {
+    void * blockreader_thread(void * arg) {
+      static_cast<FileReader::blockreader_t *>(arg)->Thread();
+      return 0;
+    }
+  }
+
+  namespace {
+
+    static unsigned ReadVersion(FileDeserializer & des) {
+      unsigned versiontag = des.peek<unsigned>();
+      if (versiontag == Event::str2id("VER2")) {
+        des.read(versiontag);
+        return 2;
+      } else if (versiontag == Event::str2id("VER3")) {
+        des.read(versiontag);
+        return 3;
+      } else if (versiontag != Event::str2id("_DET")) {
+        EUDAQ_WARN("Unrecognised native file (tag=" + Event::id2str(versiontag) + "), assuming version 1");
+      }
+      return 1;
+    }
+
+    static bool ReadEvent(FileDeserializer & des, int ver, eudaq::Event * & ev, size_t skip = 0,
+        FileReader::blockreader_t * blocks = 0) {
+      if (blocks) {
+        return blocks->Read(ev, skip);
+      }
       if (!des.HasData()) {
         return false;
       }
@@ -162,17 +318,20 @@ namespace eudaq {
           ev = EventFactory::Create(des);
         }
       } else {
-        BufferSerializer buf;
+        ByteView buf;
         for (size_t i = 0; i <= skip; ++i) {
           if (!des.HasData()) break;
           des.read(buf);
         }
-        ev = eudaq::EventFactory::Create(buf);
+        // raw data blocks of the event will refer to buf instead of copying it
+        BufferDeserializer bufdes(buf);
+        ev = eudaq::EventFactory::Create(bufdes);
       }
       return true;
     }
 
-    static bool SyncEvent(FileReader::eventqueue_t & queue, FileDeserializer & des, int ver, eudaq::Event * & ev) {
+    static bool SyncEvent(FileReader::eventqueue_t & queue, FileDeserializer & des, int ver, eudaq::Event * & ev,
+        FileReader::blockreader_t * blocks) {
       static const int MAXTRIES = 3;
       unsigned eventnum = 0;
       static const bool dbg = false;
@@ -180,7 +339,7 @@ namespace eudaq {
         // Make sure there is at least one whole event in the queue
         if (queue.isempty()) {
           eudaq::Event * evnt = 0;
-          if (!ReadEvent(des, ver, evnt)) {
+          if (!ReadEvent(des, ver, evnt, 0, blocks)) {
             return false;
           }
           queue.push(evnt);
@@ -188,7 +347,7 @@ namespace eudaq {
         if (queue.firstid == (unsigned)-1 && !queue.getevent(0).IsBORE()) {
           for (size_t i = 0; i < queue.producers(); ++i) {
             if (queue.getevent(i).get_id() != TLUID) {
-              queue.firstid = PluginManager::GetTriggerID(queue.getevent(i)) & IDMASK;
+              queue.firstid = queue.iter(i)->triggerids[i] & IDMASK;
               if (queue.firstid <= 1) {
                 EUDAQ_INFO("First TLU id detected as " + to_string(queue.firstid));
               } else {
@@ -299,7 +458,7 @@ namespace eudaq {
         // Make sure we have at least two full events in the queue
         if (queue.fullevents() < 2) {
           eudaq::Event * evnt = 0;
-          if (!ReadEvent(des, ver, evnt)) {
+          if (!ReadEvent(des, ver, evnt, 0, blocks)) {
             break;
           }
           queue.push(evnt);
@@ -319,7 +478,7 @@ namespace eudaq {
               // Make sure there are at least three full events in the queue
               if (queue.fullevents() < 3) {
                 eudaq::Event * evnt = 0;
-                if (!ReadEvent(des, ver, evnt)) {
+                if (!ReadEvent(des, ver, evnt, 0, blocks)) {
                   break;
                 }
                 queue.push(evnt);
@@ -335,12 +494,12 @@ namespace eudaq {
               } else if (tid2 == triggerid1) {
                 EUDAQ_WARN("Ambiguous double zero in event " + to_string(eventnum) + ", discarding whole event plus zero");
                 queue.discardevent(i);
-                queue.popevent();
+                delete queue.popevent();
                 doskip = true;
                 break;
               } else if (tid2 == 0) {
                 EUDAQ_WARN("Three consecutive 'zero's in event " + to_string(eventnum) + ", discarding one event.");
-                queue.popevent();
+                delete queue.popevent();
                 doskip = true;
                 break;
               }
@@ -365,25 +524,39 @@ namespace eudaq {
   FileReader::FileReader(const std::string & file, const std::string & filepattern, bool synctriggerid)
     : m_filename(FileNamer(filepattern).Set('X', ".raw").SetReplace('R', file)),
     m_des(m_filename),
-    m_ev(EventFactory::Create(m_des)),
+    m_ev(0),
     m_ver(1),
-    m_queue(0) {
-      //unsigned versiontag = m_des.peek<unsigned>();
-      //if (versiontag == Event::str2id("VER2")) {
-      //  m_ver = 2;
-      //  m_des.read(versiontag);
-      //} else if (versiontag != Event::str2id("_DET")) {
-      //  EUDAQ_WARN("Unrecognised native file (tag=" + Event::id2str(versiontag) + "), assuming version 1");
-      //}
-      //EUDAQ_INFO("FileReader, version = " + to_string(m_ver));
-      //NextEvent();
+    m_queue(0),
+    m_blocks(0),
+    m_pos(0) {
+      m_ver = ReadVersion(m_des);
+      unsigned long long first = m_des.Position();
+      if (m_ver >= 3) {
+        m_blocks = new blockreader_t(m_des);
+        // events are not at fixed offsets in compressed files, so they cannot be indexed
+        m_pos = FileIndex::npos;
+      }
+      eudaq::Event * ev = 0;
+      try {
+        if (!ReadEvent(m_des, m_ver, ev, 0, m_blocks)) EUDAQ_THROW("No events in file " + m_filename);
+      } catch (...) {
+        delete m_blocks;
+        throw;
+      }
+      m_ev = ev;
       if (synctriggerid) {
-        m_queue = new eventqueue_t(GetDetectorEvent().NumEvents());
+        m_queue = new eventqueue_t(GetDetectorEvent());
+        // events are regrouped, so they no longer match the index
+        m_pos = FileIndex::npos;
+      } else if (!m_blocks && m_index.Load(m_filename) && m_index[0].offset != first) {
+        EUDAQ_WARN("Index does not match file " + m_filename + ", ignoring it");
+        m_index.Clear();
       }
     }
 
   FileReader::~FileReader() {
     delete m_queue;
+    delete m_blocks;
   }
 
   bool FileReader::NextEvent(size_t skip) {
@@ -391,7 +564,7 @@ namespace eudaq {
     if (m_queue) {
       bool result = false;
       for (size_t i = 0; i <= skip; ++i) {
-        if (!SyncEvent(*m_queue, m_des, m_ver, ev)) break;
+        if (!SyncEvent(*m_queue, m_des, m_ver, ev, m_blocks)) break;
         result = true;
       }
       if (ev) {
@@ -399,11 +572,47 @@ namespace eudaq {
       }
       return result;
     }
-    bool result = ReadEvent(m_des, m_ver, ev, skip);
+    if (skip > 0 && m_pos != FileIndex::npos && m_pos + skip + 1 < m_index.Size()) {
+      m_des.Seek(m_index[m_pos + skip + 1].offset);
+      m_pos += skip;
+      skip = 0;
+    }
+    bool result = ReadEvent(m_des, m_ver, ev, skip, m_blocks);
     if (ev) m_ev = ev;
+    if (result && m_pos != FileIndex::npos) m_pos += skip + 1;
     return result;
   }
 
+  bool FileReader::GotoEvent(unsigned eventnumber) {
+    if (m_queue) EUDAQ_THROW("Unable to go to an event while synchronising by trigger ID");
+    if (m_blocks) return false;
+    size_t pos = m_index.Find(eventnumber);
+    if (eventnumber == (unsigned)-1 && m_index.Size() > 0) pos = m_index.Size() - 1;
+    if (pos == FileIndex::npos) return false;
+    m_des.Seek(m_index[pos].offset);
+    eudaq::Event * ev = 0;
+    if (!ReadEvent(m_des, m_ver, ev)) return false;
+    m_ev = ev;
+    m_pos = pos;
+    return true;
+  }
+
+  void FileReader::BuildIndex() {
+    if (m_blocks) EUDAQ_THROW("Compressed files cannot be indexed: " + m_filename);
+    FileDeserializer des(m_filename);
+    int ver = ReadVersion(des);
+    FileIndexWriter writer(m_filename);
+    m_index.Clear();
+    for (;;) {
+      unsigned long long offset = des.Position();
+      eudaq::Event * ev = 0;
+      if (!ReadEvent(des, ver, ev)) break;
+      EventPtr<eudaq::Event> owner(ev);
+      m_index.Add(writer.Write(*ev, offset, des.Position() - offset));
+    }
+    writer.Flush();
+  }
+
   unsigned FileReader::RunNumber() const {
     return m_ev->GetRunNumber();
   }
@@ -416,6 +625,10 @@ namespace eudaq {
     return dynamic_cast<const DetectorEvent &>(*m_ev);
   }
 
+  EventPtr<DetectorEvent> FileReader::GetDetectorEventPtr() const {
+    return EventPtr<DetectorEvent>(&dynamic_cast<DetectorEvent &>(*m_ev));
+  }
+
   const StandardEvent & FileReader::GetStandardEvent() const {
     return dynamic_cast<const StandardEvent &>(*m_ev);
   }
@@ -5,6 +5,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <iostream>
+#if EUDAQ_PLATFORM_IS(WIN32)
+# include <io.h>
+#else
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+#if EUDAQ_PLATFORM_IS(LINUX)
+# include <sys/inotify.h>
+# include <poll.h>
+#endif
 
 namespace eudaq {
 
@@ -40,11 +50,81 @@ namespace eudaq {
     fflush(m_file);
   }
 
+  void FileSerializer::Sync() {
+    fflush(m_file);
+#if EUDAQ_PLATFORM_IS(WIN32)
+    _commit(_fileno(m_file));
+#else
+    fsync(fileno(m_file));
+#endif
+  }
+
+  namespace {
+#if EUDAQ_PLATFORM_IS(WIN32)
+    unsigned long long FileTell(FILE * f) { return _ftelli64(f); }
+    int FileSeek(FILE * f, unsigned long long offset) { return _fseeki64(f, offset, SEEK_SET); }
+#else
+    unsigned long long FileTell(FILE * f) { return ftello(f); }
+    int FileSeek(FILE * f, unsigned long long offset) { return fseeko(f, offset, SEEK_SET); }
+
+    /// A read-only mapping of (the first size bytes of) a file, shared by the views into it
+    class FileMapping : public BufferOwner {
+      public:
+        FileMapping(int fd, size_t size) : m_data(0), m_size(size) {
+          void * p = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+          if (p == MAP_FAILED) return;
+          m_data = static_cast<unsigned char *>(p);
+          madvise(p, size, MADV_SEQUENTIAL);
+        }
+        ~FileMapping() {
+          if (m_data) munmap(m_data, m_size);
+        }
+        unsigned char * data() const { return m_data; }
+        size_t size() const { return m_size; }
+      private:
+        unsigned char * m_data;
+        size_t m_size;
+    };
+#endif
+  }
+
   FileDeserializer::FileDeserializer(const std::string & fname, bool faileof, size_t buffersize) :
-    m_file(0), m_faileof(faileof), m_buf(buffersize), m_start(&m_buf[0]), m_stop(m_start)
+    m_file(0), m_faileof(faileof), m_buf(buffersize), m_start(&m_buf[0]), m_stop(m_start), m_mapbase(0), m_notify(-1)
   {
     m_file = fopen(fname.c_str(), "rb");
     if (!m_file) EUDAQ_THROWX(FileNotFoundException, "Unable to open file: " + fname);
+#if !EUDAQ_PLATFORM_IS(WIN32)
+    struct stat st;
+    if (fstat(fileno(m_file), &st) == 0 && S_ISREG(st.st_mode)) {
+      // an empty mapping, until there is something to map
+      m_map = EventPtr<BufferOwner>(new FileMapping(fileno(m_file), 0));
+      m_start = m_stop = 0;
+      try {
+        Remap();
+      } catch (const FileReadException &) {
+        // e.g. not enough address space, read it through the buffer instead
+        m_map = EventPtr<BufferOwner>();
+        m_mapbase = 0;
+        m_start = m_stop = &m_buf[0];
+      }
+    }
+# if EUDAQ_PLATFORM_IS(LINUX)
+    if (!m_faileof) {
+      m_notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (m_notify >= 0 && inotify_add_watch(m_notify, fname.c_str(), IN_MODIFY) < 0) {
+        close(m_notify);
+        m_notify = -1;
+      }
+    }
+# endif
+#endif
+  }
+
+  FileDeserializer::~FileDeserializer() {
+#if !EUDAQ_PLATFORM_IS(WIN32)
+    if (m_notify >= 0) close(m_notify);
+#endif
+    if (m_file) fclose(m_file);
   }
 
   bool FileDeserializer::HasData() {
@@ -52,14 +132,98 @@ namespace eudaq {
     return level() > 0;
   }
 
+  unsigned long long FileDeserializer::Position() {
+    if (m_map.get()) return m_start - m_mapbase;
+    return FileTell(m_file) - level();
+  }
+
+  void FileDeserializer::Seek(unsigned long long offset) {
+    if (m_map.get()) {
+      if (offset > (unsigned long long)(m_stop - m_mapbase)) Remap();
+      if (offset > (unsigned long long)(m_stop - m_mapbase)) {
+        EUDAQ_THROWX(FileReadException, "Attempt to seek beyond the end of the file");
+      }
+      m_start = const_cast<ptr_t>(m_mapbase) + offset;
+      return;
+    }
+    if (FileSeek(m_file, offset) != 0) {
+      EUDAQ_THROWX(FileReadException, "Error seeking in file: " + to_string(errno) + ", " + strerror(errno));
+    }
+    m_start = m_stop = &m_buf[0];
+  }
+
+  size_t FileDeserializer::Remap() {
+#if EUDAQ_PLATFORM_IS(WIN32)
+    return 0;
+#else
+    struct stat st;
+    if (fstat(fileno(m_file), &st) != 0) {
+      EUDAQ_THROWX(FileReadException, "Error reading from file: " + to_string(errno) + ", " + strerror(errno));
+    }
+    const FileMapping & old = static_cast<const FileMapping &>(*m_map);
+    if ((size_t)st.st_size <= old.size()) return 0;
+    // views into the old mapping keep it alive, so a new one is made instead of extending it
+    FileMapping * map = new FileMapping(fileno(m_file), st.st_size);
+    EventPtr<BufferOwner> owner(map);
+    if (!map->data()) {
+      EUDAQ_THROWX(FileReadException, "Unable to map file: " + to_string(errno) + ", " + strerror(errno));
+    }
+    size_t offset = m_start - m_mapbase, added = map->size() - old.size();
+    m_map = owner;
+    m_mapbase = map->data();
+    m_start = map->data() + offset;
+    m_stop = map->data() + map->size();
+    return added;
+#endif
+  }
+
+  void FileDeserializer::WaitForData() {
+#if EUDAQ_PLATFORM_IS(LINUX)
+    if (m_notify >= 0) {
+      // sleep until the file is written to, but wake up now and then to check for an interrupt
+      pollfd pfd;
+      pfd.fd = m_notify;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, 100) > 0) {
+        char buf[4096];
+        while (::read(m_notify, buf, sizeof buf) > 0) {}
+      }
+      return;
+    }
+#endif
+    mSleep(10);
+  }
+
+  bool FileDeserializer::View(size_t len, ByteView & view) {
+    if (!m_map.get()) return false;
+    if (level() < len) FillBuffer(len - level());
+    view = ByteView(m_start, len, m_map);
+    m_start += len;
+    return true;
+  }
+
   size_t FileDeserializer::FillBuffer(size_t min) {
+    if (m_map.get()) {
+      size_t read = Remap();
+      while (read < min) {
+        if (m_faileof) {
+          throw FileReadException("End of File encountered");
+        } else if (m_interrupting) {
+          m_interrupting = false;
+          throw InterruptedException();
+        }
+        WaitForData();
+        read += Remap();
+      }
+      return read;
+    }
     clearerr(m_file);
     if (level() == 0) m_start = m_stop = &m_buf[0];
     unsigned char * end = &m_buf[0] + m_buf.size();
     if (size_t(end - m_stop) < min) {
       // not enough space remaining before end of buffer,
       // so shift everything back to the beginning of the buffer
-      std::memmove(m_start, &m_buf[0], level());
+      std::memmove(&m_buf[0], m_start, level());
       m_stop -= (m_start - &m_buf[0]);
       m_start = &m_buf[0];
       if (size_t(end - m_stop) < min) {
@@ -78,7 +242,7 @@ namespace eudaq {
         m_interrupting = false;
         throw InterruptedException();
       }
-      mSleep(10);
+      WaitForData();
       clearerr(m_file);
       size_t bytes = fread(reinterpret_cast<char *>(m_stop), 1, end - m_stop, m_file);
       read += bytes;
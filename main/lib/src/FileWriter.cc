@@ -34,4 +34,10 @@ namespace eudaq {
 
   FileWriter::FileWriter() : m_filepattern(FileNamer::default_pattern) {}
 
+  void FileWriter::WriteEvents(const std::vector<const DetectorEvent *> & events) {
+    for (size_t i = 0; i < events.size(); ++i) {
+      WriteEvent(*events[i]);
+    }
+  }
+
 }
@@ -0,0 +1,187 @@
+#include "eudaq/FileNamer.hh"
+#include "eudaq/FileWriter.hh"
+#include "eudaq/FileSerializer.hh"
+#include "eudaq/Compression.hh"
+#include "eudaq/Event.hh"
+#include "eudaq/Logger.hh"
+#include "eudaq/EudaqThread.hh"
+#include "eudaq/BoundedQueue.hh"
+#include <algorithm>
+
+namespace eudaq {
+
+  namespace {
+    /// Events waiting to be compressed, each with its length in front as in the native2 format
+    struct RawBlock {
+      std::vector<unsigned char> data;
+      unsigned nevents, firstevent;
+    };
+  }
+
+  /** Writes the native format in independently compressed blocks.
+   *  After the version tag VER3, each block holds the codec, the number of
+   *  events, the number of the first event and the uncompressed size,
+   *  followed by the compressed data. Once uncompressed, the events in a
+   *  block are laid out as in the native2 format.
+   *
+   *  Blocks hold BlockEvents events (or BlockSize bytes, whichever is
+   *  reached first), compressed with Compression (none, zlib, lz4 or zstd,
+   *  by default the fastest one available) at CompressionLevel. Compression
+   *  and writing happen on a separate thread.
+   */
+  class FileWriterCompressed : public FileWriter {
+    public:
+      FileWriterCompressed(const std::string &);
+      virtual void Configure(const Configuration &);
+      virtual void StartRun(unsigned);
+      virtual void WriteEvent(const DetectorEvent &);
+      virtual unsigned long long FileBytes() const;
+      virtual ~FileWriterCompressed();
+      void CompressThread();
+    private:
+      void Close();
+      void Handoff();
+      unsigned m_codec;
+      int m_level;
+      size_t m_blockevents, m_blocksize;
+      FileSerializer * m_ser;
+      RawBlock * m_block;
+      BoundedQueue<RawBlock *> m_full, m_free;
+      Atomic<unsigned long long> m_filebytes;
+      Atomic<int> m_failed;
+      std::string m_error; ///< Set by the compressing thread before m_failed
+      eudaqThread m_thread;
+  };
+
+  namespace {
+    static RegisterFileWriter<FileWriterCompressed> reg("compressed");
+
+    /// Appends to a vector of bytes
+    class VectorSerializer : public Serializer {
+      public:
+        VectorSerializer(std::vector<unsigned char> & data) : m_data(data) {}
+      private:
+        virtual void Serialize(const unsigned char * data, size_t len) {
+          m_data.insert(m_data.end(), data, data + len);
+        }
+        std::vector<unsigned char> & m_data;
+    };
+
+    void * FileWriterCompressed_thread(void * arg) {
+      static_cast<FileWriterCompressed *>(arg)->CompressThread();
+      return 0;
+    }
+  }
+
+  FileWriterCompressed::FileWriterCompressed(const std::string & /*param*/)
+    : m_codec(Compression::Default()), m_level(0), m_blockevents(100), m_blocksize(16 << 20),
+    m_ser(0), m_block(0), m_full(4), m_free(4), m_filebytes(0), m_failed(0) {
+    }
+
+  void FileWriterCompressed::Configure(const Configuration & conf) {
+    m_codec = Compression::FromName(conf.Get("Compression", Compression::Name(Compression::Default())));
+    m_level = conf.Get("CompressionLevel", 0);
+    m_blockevents = std::max(conf.Get("BlockEvents", 100), 1);
+    m_blocksize = std::max(conf.Get("BlockSize", (long long)(16 << 20)), 1LL);
+    if (conf.Get("FileIndex", 0)) {
+      EUDAQ_WARN("FileIndex is not supported for compressed files, no index will be written");
+    }
+  }
+
+  void FileWriterCompressed::StartRun(unsigned runnumber) {
+    Close();
+    m_ser = new FileSerializer(FileNamer(m_filepattern).Set('X', ".raw").Set('R', runnumber));
+    unsigned versiontag = Event::str2id("VER3");
+    m_ser->write(versiontag);
+    m_filebytes.store(m_ser->FileBytes());
+    m_failed.store(0);
+    m_thread.start(FileWriterCompressed_thread, this);
+  }
+
+  void FileWriterCompressed::WriteEvent(const DetectorEvent & ev) {
+    if (!m_ser) EUDAQ_THROW("FileWriterCompressed: Attempt to write unopened file");
+    if (m_failed.load()) EUDAQ_THROW(m_error);
+    if (!m_block) {
+      if (!m_free.TryPop(m_block)) m_block = new RawBlock;
+      m_block->data.clear();
+      m_block->nevents = 0;
+      m_block->firstevent = ev.GetEventNumber();
+    }
+    // the length goes in front, it is filled in once the event is serialized
+    std::vector<unsigned char> & data = m_block->data;
+    size_t start = data.size();
+    VectorSerializer ser(data);
+    ser.write(0U);
+    ser.write(ev);
+    unsigned len = (unsigned)(data.size() - start - sizeof len);
+    for (size_t i = 0; i < sizeof len; ++i) {
+      data[start + i] = (unsigned char)(len >> (8 * i));
+    }
+    if (++m_block->nevents >= m_blockevents || data.size() >= m_blocksize || ev.IsBORE() || ev.IsEORE()) {
+      // the BORE gets a block of its own, so it can be read without waiting for the next events
+      Handoff();
+    }
+  }
+
+  void FileWriterCompressed::Handoff() {
+    m_full.Push(m_block);
+    m_block = 0;
+  }
+
+  void FileWriterCompressed::CompressThread() {
+    std::vector<unsigned char> out;
+    Backoff wait;
+    for (;;) {
+      RawBlock * b = 0;
+      if (!m_full.TryPop(b)) {
+        wait();
+        continue;
+      }
+      wait.Reset();
+      if (!b) break;
+      try {
+        if (!m_failed.load()) {
+          unsigned codec = m_codec;
+          Compression::Compress(codec, m_level, &b->data[0], b->data.size(), out);
+          if (out.size() >= b->data.size()) {
+            // not worth decompressing
+            codec = Compression::CODEC_NONE;
+            out.assign(b->data.begin(), b->data.end());
+          }
+          m_ser->write(codec);
+          m_ser->write(b->nevents);
+          m_ser->write(b->firstevent);
+          m_ser->write((unsigned)b->data.size());
+          m_ser->write(ByteView(&out[0], out.size()));
+          m_ser->Flush();
+          m_filebytes.store(m_ser->FileBytes());
+        }
+      } catch (const std::exception & e) {
+        m_error = std::string("Error writing compressed block: ") + e.what();
+        m_failed.store(1);
+      }
+      if (!m_free.TryPush(b)) delete b;
+    }
+  }
+
+  void FileWriterCompressed::Close() {
+    if (!m_ser) return;
+    if (m_block) Handoff();
+    m_full.Push(0);
+    m_thread.join();
+    RawBlock * b = 0;
+    while (m_free.TryPop(b)) delete b;
+    if (m_failed.load()) EUDAQ_ERROR(m_error);
+    delete m_ser;
+    m_ser = 0;
+  }
+
+  FileWriterCompressed::~FileWriterCompressed() {
+    Close();
+  }
+
+  unsigned long long FileWriterCompressed::FileBytes() const {
+    return m_filebytes.load();
+  }
+
+}
@@ -39,7 +39,7 @@ namespace eudaq {
       if (!ev || ev->GetSubType() != "EUDRB") continue;
       //std::cout << " EUDRB " << ev->NumBlocks() << " boards" << std::endl;
       for (size_t j = 0; j < ev->NumBlocks(); ++j) {
-        const std::vector<unsigned char> & alldata = ev->GetBlock(j);
+        const ByteView alldata = ev->GetBlockView(j);
         //std::cout << "  board " << j << ", (" << ev->GetID(j) << ") " << alldata.size() << " bytes" << std::endl;
         if (alldata.size() < 4) break;
         //std::cout << "  BaseAddress: " << to_hex(getbigendian<unsigned>(&alldata[0]) & 0xff000000 | 0x00400000) << std::endl;
@@ -1,6 +1,7 @@
 #include "eudaq/FileNamer.hh"
 #include "eudaq/FileWriter.hh"
 #include "eudaq/FileSerializer.hh"
+#include "eudaq/FileIndex.hh"
 //#include "eudaq/Logger.hh"
 
 namespace eudaq {
@@ -8,35 +9,53 @@ namespace eudaq {
   class FileWriterNative : public FileWriter {
     public:
       FileWriterNative(const std::string &);
+      virtual void Configure(const Configuration &);
       virtual void StartRun(unsigned);
       virtual void WriteEvent(const DetectorEvent &);
       virtual unsigned long long FileBytes() const;
       virtual ~FileWriterNative();
     private:
       FileSerializer * m_ser;
+      bool m_indexed;
+      FileIndexWriter * m_index;
   };
 
   namespace {
     static RegisterFileWriter<FileWriterNative> reg("native");
   }
 
-  FileWriterNative::FileWriterNative(const std::string & /*param*/) : m_ser(0) {
+  FileWriterNative::FileWriterNative(const std::string & /*param*/) : m_ser(0), m_indexed(false), m_index(0) {
     //EUDAQ_DEBUG("Constructing FileWriterNative(" + to_string(param) + ")");
   }
 
+  void FileWriterNative::Configure(const Configuration & conf) {
+    m_indexed = conf.Get("FileIndex", 0) != 0;
+  }
+
   void FileWriterNative::StartRun(unsigned runnumber) {
     delete m_ser;
-    m_ser = new FileSerializer(FileNamer(m_filepattern).Set('X', ".raw").Set('R', runnumber));
+    delete m_index;
+    m_index = 0;
+    std::string fname = FileNamer(m_filepattern).Set('X', ".raw").Set('R', runnumber);
+    m_ser = new FileSerializer(fname);
+    if (m_indexed) m_index = new FileIndexWriter(fname);
   }
 
   void FileWriterNative::WriteEvent(const DetectorEvent & ev) {
     if (!m_ser) EUDAQ_THROW("FileWriterNative: Attempt to write unopened file");
+    unsigned long long offset = m_ser->FileBytes();
     m_ser->write(ev);
     m_ser->Flush();
+    if (m_index) {
+      // after the event, so that the index never points past the end of the data
+      m_index->Write(ev, offset, m_ser->FileBytes() - offset);
+      m_index->Flush();
+    }
   }
 
   FileWriterNative::~FileWriterNative() {
     delete m_ser;
+    delete m_index;
   }
 
   unsigned long long FileWriterNative::FileBytes() const { return m_ser ? m_ser->FileBytes() : 0; }
@@ -2,49 +2,368 @@
 #include "eudaq/FileWriter.hh"
 #include "eudaq/FileSerializer.hh"
 #include "eudaq/BufferSerializer.hh"
+#include "eudaq/FileIndex.hh"
 #include "eudaq/Event.hh"
+#include "eudaq/Logger.hh"
+#include "eudaq/Mutex.hh"
+#include "eudaq/EudaqThread.hh"
+#include "eudaq/BoundedQueue.hh"
+#include "eudaq/Time.hh"
+
+#if !EUDAQ_PLATFORM_IS(WIN32)
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <cstdlib>
+# include <cerrno>
+# include <cstring>
+# define EUDAQ_ASYNC_WRITE 1
+#endif
 
 namespace eudaq {
 
+  namespace {
+    /// Serialized events on their way to the file, in memory aligned for O_DIRECT
+    struct WriteBlock {
+      unsigned char * data;
+      size_t capacity, used;
+      size_t length; ///< The number of bytes to write, the rest is carried over to the next block
+      std::vector<FileIndex::Entry> entries; ///< Of the events that end in the bytes written
+    };
+  }
+
+  /** Writes the native format with a length in front of each event, so that
+   *  readers can skip events without decoding them.
+   *
+   *  With AsyncWrite = 1 in the configuration, events are serialized into
+   *  large blocks which a separate thread writes to the file, so there is
+   *  no system call per event. A block is written once it holds FlushSize
+   *  bytes, or FlushInterval seconds after its first event. Durability
+   *  chooses what happens after each write: "none" leaves the data to the
+   *  page cache, "fdatasync" waits for it to reach the disk, and "direct"
+   *  also bypasses the page cache with O_DIRECT (the last partial page is
+   *  then held back until the next write or the end of the run).
+   *  The index entries of the events are written by the same thread, once
+   *  the block holding the end of each event has been written (and synced).
+   */
   class FileWriterNative2 : public FileWriter {
     public:
       FileWriterNative2(const std::string &);
+      virtual void Configure(const Configuration &);
       virtual void StartRun(unsigned);
       virtual void WriteEvent(const DetectorEvent &);
       virtual unsigned long long FileBytes() const;
       virtual ~FileWriterNative2();
+      void IOThread();
     private:
+      enum Durability { DUR_NONE, DUR_FDATASYNC, DUR_DIRECT };
+      void Close();
+      /// Queues the current block for writing, the caller must hold m_mutex
+      void Handoff(bool final);
+      void Write(WriteBlock * block);
+      WriteBlock * GetBlock();
       BufferSerializer m_buf;
       FileSerializer * m_ser;
+      bool m_indexed;
+      FileIndexWriter * m_index;
+
+      bool m_async;
+      size_t m_flushsize;
+      double m_flushinterval;
+      Durability m_durability;
+      int m_fd, m_directfd; ///< The file, and the same file opened with O_DIRECT (or -1)
+      unsigned long long m_bytes; ///< Bytes written by the caller so far
+      unsigned long long m_fileoffset; ///< Where the I/O thread writes the next block
+      unsigned long long m_handedoff; ///< Bytes handed to the I/O thread so far
+      Mutex m_mutex; ///< Protects m_block, m_blockstart, m_carry, m_entries and m_handedoff
+      WriteBlock * m_block;
+      Time m_blockstart;
+      std::vector<unsigned char> m_carry; ///< Bytes held back from the last block written with O_DIRECT
+      std::vector<FileIndex::Entry> m_entries; ///< Index entries of the events not handed off yet
+      BoundedQueue<WriteBlock *> m_full, m_free;
+      Atomic<int> m_error;
+      eudaqThread m_thread;
   };
 
   namespace {
     static RegisterFileWriter<FileWriterNative2> reg("native2");
+
+    static const size_t ALIGNMENT = 4096;
+
+    /// Waits for the mutex, where MutexLock would fail if it is taken
+    class BlockingLock {
+      public:
+        BlockingLock(Mutex & m) : m_mutex(m) { m_mutex.Lock(); }
+        ~BlockingLock() { m_mutex.UnLock(); }
+      private:
+        Mutex & m_mutex;
+    };
+
+    void FreeBlock(WriteBlock * b) {
+      if (!b) return;
+      std::free(b->data);
+      delete b;
+    }
+
+#if EUDAQ_ASYNC_WRITE
+    WriteBlock * NewBlock(size_t capacity) {
+      capacity = (capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+      void * p = 0;
+      if (posix_memalign(&p, ALIGNMENT, capacity) != 0) throw std::bad_alloc();
+      WriteBlock * b = new WriteBlock;
+      b->data = static_cast<unsigned char *>(p);
+      b->capacity = capacity;
+      b->used = b->length = 0;
+      return b;
+    }
+
+    /// Appends to a block, moving it to a larger one if it fills up
+    class BlockSerializer : public Serializer {
+      public:
+        BlockSerializer(WriteBlock * & block) : m_block(block) {}
+      private:
+        virtual void Serialize(const unsigned char * data, size_t len) {
+          if (m_block->used + len > m_block->capacity) {
+            WriteBlock * b = NewBlock(2 * (m_block->used + len));
+            std::memcpy(b->data, m_block->data, m_block->used);
+            b->used = m_block->used;
+            FreeBlock(m_block);
+            m_block = b;
+          }
+          std::memcpy(m_block->data + m_block->used, data, len);
+          m_block->used += len;
+        }
+        WriteBlock * & m_block;
+    };
+
+    void * FileWriterNative2_thread(void * arg) {
+      static_cast<FileWriterNative2 *>(arg)->IOThread();
+      return 0;
+    }
+#endif
   }
 
-  FileWriterNative2::FileWriterNative2(const std::string & /*param*/) : m_ser(0) {
+  FileWriterNative2::FileWriterNative2(const std::string & /*param*/) : m_ser(0), m_indexed(false), m_index(0),
+    m_async(false), m_flushsize(4 << 20), m_flushinterval(0.5), m_durability(DUR_NONE), m_fd(-1), m_directfd(-1),
+    m_bytes(0), m_fileoffset(0), m_handedoff(0), m_block(0), m_blockstart(0), m_full(8), m_free(4), m_error(0) {
     //EUDAQ_DEBUG("Constructing FileWriterNative(" + to_string(param) + ")");
   }
 
+  void FileWriterNative2::Configure(const Configuration & conf) {
+    m_indexed = conf.Get("FileIndex", 0) != 0;
+    m_async = conf.Get("AsyncWrite", 0) != 0;
+#if !EUDAQ_ASYNC_WRITE
+    if (m_async) EUDAQ_WARN("AsyncWrite is not available on this platform");
+    m_async = false;
+#endif
+    m_flushsize = std::max(conf.Get("FlushSize", (long long)(4 << 20)), (long long)ALIGNMENT);
+    m_flushinterval = conf.Get("FlushInterval", 0.5);
+    std::string durability = lcase(conf.Get("Durability", "none"));
+    if (durability == "fdatasync") {
+      m_durability = DUR_FDATASYNC;
+    } else if (durability == "direct") {
+      m_durability = DUR_DIRECT;
+    } else {
+      if (durability != "none") EUDAQ_WARN("Unknown Durability '" + durability + "', using none");
+      m_durability = DUR_NONE;
+    }
+  }
+
   void FileWriterNative2::StartRun(unsigned runnumber) {
-    delete m_ser;
-    m_ser = new FileSerializer(FileNamer(m_filepattern).Set('X', ".raw").Set('R', runnumber));
+    Close();
+    std::string fname = FileNamer(m_filepattern).Set('X', ".raw").Set('R', runnumber);
     unsigned versiontag = Event::str2id("VER2");
-    m_ser->write(versiontag);
+    if (m_indexed) m_index = new FileIndexWriter(fname);
+    if (!m_async) {
+      m_ser = new FileSerializer(fname);
+      m_ser->write(versiontag);
+    }
+#if EUDAQ_ASYNC_WRITE
+    else {
+      m_fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+      if (m_fd < 0 && errno == EEXIST) EUDAQ_THROWX(FileExistsException, "File already exists: " + fname);
+      if (m_fd < 0) EUDAQ_THROWX(FileNotFoundException, "Unable to open file: " + fname);
+# ifdef O_DIRECT
+      if (m_durability == DUR_DIRECT) {
+        m_directfd = open(fname.c_str(), O_WRONLY | O_DIRECT);
+        if (m_directfd < 0) EUDAQ_WARN("Unable to open " + fname + " with O_DIRECT, using fdatasync instead");
+      }
+# endif
+      m_bytes = m_fileoffset = m_handedoff = 0;
+      m_entries.clear();
+      m_error.store(0);
+      m_block = GetBlock();
+      m_blockstart = Time::Current();
+      BlockSerializer ser(m_block);
+      ser.write(versiontag);
+      m_bytes = m_block->used;
+      m_thread.start(FileWriterNative2_thread, this);
+    }
+#endif
   }
 
   void FileWriterNative2::WriteEvent(const DetectorEvent & ev) {
-    if (!m_ser) EUDAQ_THROW("FileWriterNative: Attempt to write unopened file");
-    m_buf.clear();
-    m_buf.write(ev);
-    m_ser->write(m_buf);
-    m_ser->Flush();
+    if (!m_async) {
+      if (!m_ser) EUDAQ_THROW("FileWriterNative: Attempt to write unopened file");
+      m_buf.clear();
+      m_buf.write(ev);
+      unsigned long long offset = m_ser->FileBytes();
+      m_ser->write(m_buf);
+      m_ser->Flush();
+      if (m_index) {
+        m_index->Write(ev, offset, m_ser->FileBytes() - offset);
+        m_index->Flush();
+      }
+      return;
+    }
+#if EUDAQ_ASYNC_WRITE
+    if (m_fd < 0) EUDAQ_THROW("FileWriterNative: Attempt to write unopened file");
+    if (int err = m_error.load()) EUDAQ_THROW("Error writing to file: " + to_string(err) + ", " + strerror(err));
+    unsigned long long offset = m_bytes;
+    {
+      BlockingLock lock(m_mutex);
+      if (!m_block) {
+        m_block = GetBlock();
+        if (m_carry.size()) std::memcpy(m_block->data, &m_carry[0], m_carry.size());
+        m_block->used = m_carry.size();
+        m_carry.clear();
+        m_blockstart = Time::Current();
+      }
+      // the same layout as writing a BufferSerializer: the length, then the event
+      size_t start = m_block->used;
+      BlockSerializer ser(m_block);
+      ser.write(0U);
+      ser.write(ev);
+      unsigned len = (unsigned)(m_block->used - start - sizeof len);
+      for (size_t i = 0; i < sizeof len; ++i) {
+        m_block->data[start + i] = (unsigned char)(len >> (8 * i));
+      }
+      m_bytes += m_block->used - start;
+      if (m_index) m_entries.push_back(m_index->MakeEntry(ev, offset, m_bytes - offset));
+      if (m_block->used >= m_flushsize) Handoff(false);
+    }
+#endif
   }
 
-  FileWriterNative2::~FileWriterNative2() {
+#if EUDAQ_ASYNC_WRITE
+  WriteBlock * FileWriterNative2::GetBlock() {
+    WriteBlock * b = 0;
+    if (m_free.TryPop(b) && b->capacity >= m_flushsize + ALIGNMENT) {
+      b->used = b->length = 0;
+      b->entries.clear();
+      return b;
+    }
+    FreeBlock(b);
+    // room for the last event to go past the flush size
+    return NewBlock(m_flushsize + m_flushsize / 4 + ALIGNMENT);
+  }
+
+  void FileWriterNative2::Handoff(bool final) {
+    WriteBlock * b = m_block;
+    m_block = 0;
+    // O_DIRECT writes whole pages, so any partial page is written again with the next block
+    size_t tail = (m_directfd >= 0 && !final) ? b->used % ALIGNMENT : 0;
+    b->length = b->used - tail;
+    m_carry.assign(b->data + b->length, b->data + b->used);
+    // the events that end in what is written now, the others end in the carried over bytes
+    m_handedoff += b->length;
+    size_t n = 0;
+    while (n < m_entries.size() && m_entries[n].offset + m_entries[n].length <= m_handedoff) ++n;
+    b->entries.assign(m_entries.begin(), m_entries.begin() + n);
+    m_entries.erase(m_entries.begin(), m_entries.begin() + n);
+    m_full.Push(b);
+  }
+
+  void FileWriterNative2::Write(WriteBlock * b) {
+    const unsigned char * data = b->data;
+    size_t len = b->length;
+    while (len > 0) {
+      // the direct descriptor takes whole pages only, the end of the file goes through the other one
+      bool direct = m_directfd >= 0 && len >= ALIGNMENT;
+      size_t chunk = direct ? len / ALIGNMENT * ALIGNMENT : len;
+      ssize_t written = pwrite(direct ? m_directfd : m_fd, data, chunk, m_fileoffset);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        m_error.store(errno);
+        return;
+      }
+      data += written;
+      len -= written;
+      m_fileoffset += written;
+    }
+    if (m_durability != DUR_NONE && fdatasync(m_fd) != 0) m_error.store(errno);
+  }
+
+  void FileWriterNative2::IOThread() {
+    Backoff wait;
+    for (;;) {
+      WriteBlock * b = 0;
+      if (m_full.TryPop(b)) {
+        if (!b) break;
+        Write(b);
+        if (m_index && b->entries.size() && !m_error.load()) {
+          for (size_t i = 0; i < b->entries.size(); ++i) {
+            m_index->Write(b->entries[i]);
+          }
+          if (m_durability != DUR_NONE) {
+            m_index->Sync();
+          } else {
+            m_index->Flush();
+          }
+        }
+        if (!m_free.TryPush(b)) FreeBlock(b);
+        wait.Reset();
+        continue;
+      }
+      // the caller may be waiting for this thread with the lock held, so do not wait for it
+      if (m_mutex.TryLock() == 0) {
+        if (m_block && m_block->used > 0 &&
+            (Time::Current() - m_blockstart).Seconds() >= m_flushinterval &&
+            (m_directfd < 0 || m_block->used >= ALIGNMENT)) {
+          Handoff(false);
+        }
+        m_mutex.UnLock();
+      }
+      wait();
+    }
+  }
+#else
+  void FileWriterNative2::IOThread() {}
+#endif
+
+  void FileWriterNative2::Close() {
+#if EUDAQ_ASYNC_WRITE
+    if (m_fd >= 0) {
+      {
+        BlockingLock lock(m_mutex);
+        if (m_block) Handoff(true);
+        m_carry.clear();
+      }
+      m_full.Push(0);
+      m_thread.join();
+      WriteBlock * b = 0;
+      while (m_free.TryPop(b)) FreeBlock(b);
+      if (m_durability != DUR_NONE) fdatasync(m_fd);
+      if (m_directfd >= 0) close(m_directfd);
+      close(m_fd);
+      m_fd = m_directfd = -1;
+      if (int err = m_error.load()) EUDAQ_ERROR("Error writing to file: " + to_string(err) + ", " + strerror(err));
+    }
+#endif
     delete m_ser;
+    m_ser = 0;
+    delete m_index;
+    m_index = 0;
+  }
+
+  FileWriterNative2::~FileWriterNative2() {
+    Close();
   }
 
-  unsigned long long FileWriterNative2::FileBytes() const { return m_ser ? m_ser->FileBytes() : 0; }
+  unsigned long long FileWriterNative2::FileBytes() const {
+    if (m_async) return m_bytes;
+    return m_ser ? m_ser->FileBytes() : 0;
+  }
 
 }
@@ -17,11 +17,15 @@ namespace eudaq {
       FileWriterRoot(const std::string &);
       virtual void StartRun(unsigned);
       virtual void WriteEvent(const DetectorEvent &);
+      virtual void WriteEvents(const std::vector<const DetectorEvent *> &);
       virtual unsigned long long FileBytes() const;
       virtual ~FileWriterRoot();
     private:
+      void Fill(const StandardEvent & sev);
       TFile * m_tfile; // book the pointer to a file (to store the otuput)
       TTree * m_ttree; // book the tree (to store the needed event info)
+      StandardEvent m_sev; // reused for every event, so its planes keep their memory
+      std::vector<StandardEvent> m_sevs; // reused for every batch of events
       // Book variables for the Event_to_TTree conversion 
       Int_t id_plane; // plane id, where the hit is 
       Int_t id_hit; // the hit id (within a plane)  
@@ -74,7 +78,21 @@ namespace eudaq {
     } else if (ev.IsEORE()) {
       m_ttree->Write();
     }
-    StandardEvent sev = eudaq::PluginManager::ConvertToStandard(ev);
+    eudaq::PluginManager::ConvertToStandard(ev, m_sev);
+    Fill(m_sev);
+  }
+
+  void FileWriterRoot::WriteEvents(const std::vector<const DetectorEvent *> & events) {
+    // BOREs are converted too, but only used to initialise the plugins
+    eudaq::PluginManager::ConvertToStandard(events, m_sevs);
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (events[i]->IsBORE()) continue;
+      if (events[i]->IsEORE()) m_ttree->Write();
+      Fill(m_sevs[i]);
+    }
+  }
+
+  void FileWriterRoot::Fill(const StandardEvent & sev) {
     for (size_t iplane = 0; iplane < sev.NumPlanes(); ++iplane) {
 
       const eudaq::StandardPlane & plane = sev.GetPlane(iplane);
@@ -11,10 +11,13 @@ namespace eudaq {
       FileWriterStandard(const std::string &);
       virtual void StartRun(unsigned);
       virtual void WriteEvent(const DetectorEvent &);
+      virtual void WriteEvents(const std::vector<const DetectorEvent *> &);
       virtual unsigned long long FileBytes() const;
       virtual ~FileWriterStandard();
     private:
       FileSerializer * m_ser;
+      StandardEvent m_sev; ///< Reused for every event, so its planes keep their memory
+      std::vector<StandardEvent> m_sevs; ///< Reused for every batch of events
   };
 
   namespace {
@@ -33,7 +36,17 @@ namespace eudaq {
   void FileWriterStandard::WriteEvent(const DetectorEvent & ev) {
     if (!m_ser) EUDAQ_THROW("FileWriterStandard: Attempt to write unopened file");
     if (ev.IsBORE()) PluginManager::Initialize(ev);
-    m_ser->write(PluginManager::ConvertToStandard(ev));
+    PluginManager::ConvertToStandard(ev, m_sev);
+    m_ser->write(m_sev);
+    m_ser->Flush();
+  }
+
+  void FileWriterStandard::WriteEvents(const std::vector<const DetectorEvent *> & events) {
+    if (!m_ser) EUDAQ_THROW("FileWriterStandard: Attempt to write unopened file");
+    PluginManager::ConvertToStandard(events, m_sevs);
+    for (size_t i = 0; i < events.size(); ++i) {
+      m_ser->write(m_sevs[i]);
+    }
     m_ser->Flush();
   }
 
@@ -10,10 +10,13 @@ namespace eudaq {
       FileWriterText(const std::string &);
       virtual void StartRun(unsigned);
       virtual void WriteEvent(const DetectorEvent &);
+      virtual void WriteEvents(const std::vector<const DetectorEvent *> &);
       virtual unsigned long long FileBytes() const;
       virtual ~FileWriterText();
     private:
       std::FILE * m_file;
+      StandardEvent m_sev;
+      std::vector<StandardEvent> m_sevs;
   };
 
   namespace {
@@ -45,8 +48,17 @@ namespace eudaq {
       <<  devent.GetRunNumber() <<"." << devent.GetEventNumber() << std::endl;
 
     //disentangle the detector event
-    StandardEvent sevent(PluginManager::ConvertToStandard(devent));
-    std::cout << "Event: " << sevent << std::endl;
+    PluginManager::ConvertToStandard(devent, m_sev);
+    std::cout << "Event: " << m_sev << std::endl;
+  }
+
+  void FileWriterText::WriteEvents(const std::vector<const DetectorEvent *> & events) {
+    PluginManager::ConvertToStandard(events, m_sevs);
+    for (size_t i = 0; i < events.size(); ++i) {
+      std::cout << "EUDAQ_DEBUG: FileWriterText::WriteEvent() processing event "
+        <<  events[i]->GetRunNumber() <<"." << events[i]->GetEventNumber() << std::endl;
+      std::cout << "Event: " << m_sevs[i] << std::endl;
+    }
   }
 
   FileWriterText::~FileWriterText() {
@@ -0,0 +1,106 @@
+#include "eudaq/M26Decoder.hh"
+#include "eudaq/Utils.hh"
+
+#ifdef EUDAQ_TARGET_AVX2
+#  include <immintrin.h>
+#endif
+
+namespace eudaq {
+
+  namespace {
+
+    inline unsigned M26Word(const unsigned char * data, size_t i) {
+      return getlittleendian<unsigned short>(data + 2 * i);
+    }
+
+    /// Expands n states, each with its row, to pixels from hits[start], returns the new number of hits
+    inline size_t M26Expand(const unsigned short * states, const unsigned short * rows, size_t n,
+        unsigned pivotrow, M26Hits & hits, size_t start) {
+      unsigned short * x = &hits.x[0], * y = &hits.y[0];
+      unsigned char * pivot = &hits.pivot[0];
+      for (size_t s = 0; s < n; ++s) {
+        const unsigned short column = states[s] >> 2 & 0x7ff;
+        const unsigned char piv = rows[s] >= pivotrow;
+        // always four pixels, those beyond the state are overwritten by the next one
+        for (unsigned j = 0; j < 4; ++j) {
+          x[start + j] = column + j;
+          y[start + j] = rows[s];
+          pivot[start + j] = piv;
+        }
+        start += (states[s] & 3) + 1;
+      }
+      return start;
+    }
+
+    typedef size_t (*M26Decoder)(const unsigned char *, size_t, unsigned, M26Hits &);
+
+    M26Decoder ChooseM26Decoder() {
+#ifdef EUDAQ_TARGET_AVX2
+      if (CpuHasAVX2()) return DecodeM26AVX2;
+#endif
+      return DecodeM26Scalar;
+    }
+
+  }
+
+  size_t DecodeM26(const unsigned char * data, size_t nwords, unsigned pivotrow, M26Hits & hits) {
+    // chosen on first use, rather than while the libraries are still being loaded
+    static const M26Decoder decoder = ChooseM26Decoder();
+    return decoder(data, nwords, pivotrow, hits);
+  }
+
+  size_t DecodeM26Scalar(const unsigned char * data, size_t nwords, unsigned pivotrow, M26Hits & hits) {
+    size_t n = 0;
+    for (size_t i = 0; i + 1 < nwords; ++i) {
+      const unsigned header = M26Word(data, i);
+      const unsigned numstates = header & 0xf;
+      if (numstates + 1 > nwords - i) break;
+      const unsigned short row = header >> 4 & 0x7ff;
+      for (unsigned s = 0; s < numstates; ++s) {
+        const unsigned short state = M26Word(data, ++i);
+        n = M26Expand(&state, &row, 1, pivotrow, hits, n);
+      }
+    }
+    return n;
+  }
+
+#ifdef EUDAQ_TARGET_AVX2
+  EUDAQ_TARGET_AVX2
+  size_t DecodeM26AVX2(const unsigned char * data, size_t nwords, unsigned pivotrow, M26Hits & hits) {
+    unsigned short * states = &hits.states[0], * rows = &hits.rows[0];
+    size_t nstates = 0;
+    for (size_t i = 0; i + 1 < nwords; ++i) {
+      const unsigned header = M26Word(data, i);
+      const unsigned numstates = header & 0xf;
+      if (numstates + 1 > nwords - i) break;
+      const unsigned short row = header >> 4 & 0x7ff;
+      for (unsigned s = 0; s < numstates; ++s) {
+        states[nstates] = M26Word(data, ++i);
+        rows[nstates++] = row;
+      }
+    }
+    unsigned short * x = &hits.x[0], * y = &hits.y[0];
+    unsigned char * pivot = &hits.pivot[0];
+    const __m256i columnmask = _mm256_set1_epi16(0x7ff), countmask = _mm256_set1_epi16(3);
+    const __m256i lastbefore = _mm256_set1_epi16((short)pivotrow - 1);
+    const __m128i one = _mm_set1_epi8(1);
+    size_t n = 0, s = 0;
+    for (; s + 16 <= nstates; s += 16) {
+      const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(states + s));
+      if (!_mm256_testz_si256(v, countmask)) {
+        n = M26Expand(states + s, rows + s, 16, pivotrow, hits, n);
+        continue;
+      }
+      const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows + s));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(x + n), _mm256_and_si256(_mm256_srli_epi16(v, 2), columnmask));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(y + n), r);
+      const __m256i p = _mm256_cmpgt_epi16(r, lastbefore);
+      const __m128i p8 = _mm_packs_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(pivot + n), _mm_and_si128(p8, one));
+      n += 16;
+    }
+    return M26Expand(states + s, rows + s, nstates - s, pivotrow, hits, n);
+  }
+#endif
+
+}
@@ -58,8 +58,9 @@ namespace eudaq {
 
     try {
       const DetectorEvent & dev = m_reader->GetDetectorEvent();
-      if (dev.IsBORE()) m_lastbore = counted_ptr<DetectorEvent>(new DetectorEvent(dev));
-      OnEvent(PluginManager::ConvertToStandard(dev));
+      if (dev.IsBORE()) m_lastbore.reset(new DetectorEvent(dev));
+      PluginManager::ConvertToStandard(dev, m_sev);
+      OnEvent(m_sev);
       //        ++counter_events_for_online_monitor;
     } catch (const InterruptedException &) {
       return false;
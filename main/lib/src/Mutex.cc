@@ -3,6 +3,8 @@
 #ifdef CPP11
 
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace eudaq {
 
@@ -59,6 +61,37 @@ namespace eudaq {
 		Release();
 	}
 
+	class EventCount::Impl {
+	public:
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+	};
+
+	EventCount::EventCount() : m_impl(new EventCount::Impl) {}
+
+	EventCount::~EventCount() { delete m_impl; }
+
+	void EventCount::Wait(unsigned epoch, int timeout) {
+		std::unique_lock<std::mutex> lock(m_impl->m_mutex);
+		// the read-modify-write operations order these against the ones in Notify
+		m_waiters.fetch_add(1);
+		if (m_epoch.fetch_add(0) == epoch) {
+			if (timeout < 0) {
+				m_impl->m_cond.wait(lock);
+			} else {
+				m_impl->m_cond.wait_for(lock, std::chrono::milliseconds(timeout));
+			}
+		}
+		m_waiters.fetch_sub(1);
+	}
+
+	void EventCount::Notify() {
+		m_epoch.fetch_add(1);
+		if (m_waiters.fetch_add(0) == 0) return;
+		std::lock_guard<std::mutex> lock(m_impl->m_mutex);
+		m_impl->m_cond.notify_all();
+	}
+
 	//   MutexTryLock::MutexTryLock(Mutex & m) : m_mutex(m), m_locked(true) {
 	//     if (m_mutex.TryLock()) {
 	//       m_locked = false;
@@ -81,6 +114,7 @@ namespace eudaq {
 }
 #else
 #include <pthread.h>
+#include "eudaq/Time.hh"
 
 namespace eudaq {
 
@@ -142,6 +176,54 @@ namespace eudaq {
     Release();
   }
 
+  class EventCount::Impl {
+    public:
+      Impl() {
+        if (pthread_mutex_init(&m_mutex, 0) || pthread_cond_init(&m_cond, 0)) {
+          EUDAQ_THROW("Unable to create condition variable");
+        }
+      }
+      ~Impl() {
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_mutex);
+      }
+      pthread_mutex_t m_mutex;
+      pthread_cond_t m_cond;
+  };
+
+  EventCount::EventCount() : m_impl(new EventCount::Impl) {}
+
+  EventCount::~EventCount() { delete m_impl; }
+
+  void EventCount::Wait(unsigned epoch, int timeout) {
+    timespec until;
+    if (timeout >= 0) {
+      const timeval t = Time::Current() + Time(0, timeout * 1000L);
+      until.tv_sec = t.tv_sec;
+      until.tv_nsec = t.tv_usec * 1000L;
+    }
+    pthread_mutex_lock(&m_impl->m_mutex);
+    // the read-modify-write operations order these against the ones in Notify
+    m_waiters.fetch_add(1);
+    if (m_epoch.fetch_add(0) == epoch) {
+      if (timeout < 0) {
+        pthread_cond_wait(&m_impl->m_cond, &m_impl->m_mutex);
+      } else {
+        pthread_cond_timedwait(&m_impl->m_cond, &m_impl->m_mutex, &until);
+      }
+    }
+    m_waiters.fetch_sub(1);
+    pthread_mutex_unlock(&m_impl->m_mutex);
+  }
+
+  void EventCount::Notify() {
+    m_epoch.fetch_add(1);
+    if (m_waiters.fetch_add(0) == 0) return;
+    pthread_mutex_lock(&m_impl->m_mutex);
+    pthread_cond_broadcast(&m_impl->m_cond);
+    pthread_mutex_unlock(&m_impl->m_mutex);
+  }
+
   //   MutexTryLock::MutexTryLock(Mutex & m) : m_mutex(m), m_locked(true) {
   //     if (m_mutex.TryLock()) {
   //       m_locked = false;
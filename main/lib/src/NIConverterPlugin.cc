@@ -7,6 +7,7 @@
 #include "eudaq/RawDataEvent.hh"
 #include "eudaq/Configuration.hh"
 #include "eudaq/Logger.hh"
+#include "eudaq/M26Decoder.hh"
 
 #if USE_LCIO
 #  include "IMPL/LCEventImpl.h"
@@ -46,8 +47,8 @@ namespace eudaq {
   static const int PIVOTPIXELOFFSET = 64;
 
   class NIConverterPlugin : public DataConverterPlugin {
-    typedef std::vector<unsigned char> datavect;
-    typedef std::vector<unsigned char>::const_iterator datait;
+    typedef ByteView datavect;
+    typedef ByteView::const_iterator datait;
     public:
     virtual ~NIConverterPlugin(){ }
 
@@ -65,10 +66,15 @@ namespace eudaq {
 
     virtual unsigned GetTriggerID(Event const & ev) const {
       const RawDataEvent & rawev = dynamic_cast<const RawDataEvent &>(ev);
-      if (rawev.NumBlocks() < 1 || rawev.GetBlock(0).size() < 8) return (unsigned)-1;
-      return GET(rawev.GetBlock(0), 1) >> 16;
+      if (rawev.NumBlocks() < 1) return (unsigned)-1;
+      const ByteView data = rawev.GetBlockView(0);
+      if (data.size() < 8) return (unsigned)-1;
+      return GET(data.data(), 1) >> 16;
     }
 
+    /// The sensor IDs only change in Initialize
+    virtual bool IsThreadSafe() const { return true; }
+
     virtual bool GetStandardSubEvent(StandardEvent & result, const Event & source) const {
       if (source.IsBORE()) {
         std::cout << "GetStandardSubEvent : got BORE" << std::endl;
@@ -84,13 +90,13 @@ namespace eudaq {
 
       // If we get here it must be a data event
       const RawDataEvent & rawev = dynamic_cast<const RawDataEvent &>(source);
-      if (rawev.NumBlocks() != 2 || rawev.GetBlock(0).size() < 20 ||
-          rawev.GetBlock(1).size() < 20) {
+      if (rawev.NumBlocks() != 2 || rawev.GetBlockView(0).size() < 20 ||
+          rawev.GetBlockView(1).size() < 20) {
         EUDAQ_WARN("Ignoring bad event " + to_string(source.GetEventNumber()));
         return false;
       }
-      const datavect & data0 = rawev.GetBlock(0);
-      const datavect & data1 = rawev.GetBlock(1);
+      const datavect data0 = rawev.GetBlockView(0);
+      const datavect data1 = rawev.GetBlockView(1);
       unsigned header0 = GET(data0, 0);
       unsigned header1 = GET(data1, 0);
       unsigned tluid = GetTriggerID(source);
@@ -100,6 +106,7 @@ namespace eudaq {
       datait it0 = data0.begin() + 8;
       datait it1 = data1.begin() + 8;
       unsigned board = 0;
+      M26Hits hits;
       while (it0 < data0.end() && it1 < data1.end()) {
         unsigned id = board;
         if (id < m_ids.size()) id = m_ids[id];
@@ -147,13 +154,12 @@ namespace eudaq {
           EUDAQ_WARN("Bad length in second frame");
           break;
         }
-        StandardPlane plane(id, "NI", "MIMOSA26");
+        StandardPlane & plane = result.NewPlane(id, "NI", "MIMOSA26");
         plane.SetSizeZS(1152, 576, 0, 2, StandardPlane::FLAG_WITHPIVOT | StandardPlane::FLAG_DIFFCOORDS);
         plane.SetTLUEvent(tluid);
         plane.SetPivotPixel((9216 + pivot + PIVOTPIXELOFFSET) % 9216);
-        DecodeFrame(plane, len0, it0+8, 0);
-        DecodeFrame(plane, len1, it1+8, 1);
-        result.AddPlane(plane);
+        DecodeFrame(plane, len0, it0+8, 0, hits);
+        DecodeFrame(plane, len1, it1+8, 1, hits);
 
         if (dbg) std::cout << "Mimosa_trailer0 = " << hexdec(GET(it0, len0+2)) << std::endl;
         //        if (dbg) std::cout << "Mimosa        0 = " << hexdec(GET(it0, 0)) << " len0 = " << len0 << " by " << (len0*4+16) <<std::endl;      
@@ -205,45 +211,12 @@ namespace eudaq {
     }
 
 
-    void DecodeFrame(StandardPlane & plane, size_t len, datait it, int frame) const {
-      std::vector<unsigned short> vec;
-      for (size_t i = 0; i < len; ++i) {
-        unsigned v = GET(it, i);
-        vec.push_back(v & 0xffff);
-        vec.push_back(v >> 16);
-      }
-
-      unsigned npixels = 0;
-      for (size_t i = 0; i < vec.size(); ++i) {
-        //  std::cout << "  " << i << " : " << hexdec(vec[i]) << std::endl;
-        if (i == vec.size() - 1) break;
-        unsigned numstates = vec[i] & 0xf;
-        unsigned row = vec[i]>>4 & 0x7ff;
-        if (numstates+1 > vec.size()-i) {
-          // Ignoring bad line
-          //std::cout << "Ignoring bad line " << row << " (too many states)" << std::endl;
-          break;
-        }
-        if (dbg>2) std::cout << "Hit line " << (vec[i] & 0x8000 ? "* " : ". ") << row
-          << ", states " << numstates << ":";
-        bool pivot = (row >= (plane.PivotPixel() / 16));
-        for (unsigned s = 0; s < numstates; ++s) {
-          unsigned v = vec.at(++i);
-          unsigned column = v>>2 & 0x7ff;
-          unsigned num = v & 3;
-          if (dbg>2) std::cout << (s ? "," : " ") << column;
-          if (dbg>2) if ((v&3) > 0) std::cout << "-" << (column + num);
-          for (unsigned j = 0; j < num+1; ++j) {
-            plane.PushPixel(column+j, row, 1, pivot, frame);
-          }
-          npixels += num + 1;
-        }
-        if (dbg>2) std::cout << std::endl;
-      }
+    void DecodeFrame(StandardPlane & plane, size_t len, datait it, int frame, M26Hits & hits) const {
+      // len 32 bit words, each holding two 16 bit words, low half first
+      hits.Reserve(2 * len);
+      const size_t npixels = DecodeM26(&*it, 2 * len, plane.PivotPixel() / 16, hits);
+      plane.PushPixels(frame, npixels, &hits.x[0], &hits.y[0], 1, &hits.pivot[0]);
       if (dbg) std::cout << "Total pixels " << frame << " = " << npixels << std::endl;
-      //++offset;
-
-
     }
 
 #if USE_LCIO && USE_EUTELESCOPE
@@ -1,6 +1,8 @@
 #include "eudaq/PluginManager.hh"
 #include "eudaq/Exception.hh"
 #include "eudaq/Configuration.hh"
+#include "eudaq/EudaqThread.hh"
+#include "eudaq/Atomic.hh"
 
 #if USE_LCIO
 #  include "lcio.h"
@@ -20,6 +22,59 @@ using namespace std;
 
 namespace eudaq {
 
+  namespace {
+    /// Events shared out between the threads converting them
+    struct ConvertBatch {
+      ConvertBatch(const DetectorEvent * const * in, StandardEvent * out, size_t n)
+        : events(in), results(out), size(n), next(0), errors(n) {}
+      void Run() {
+        for (;;) {
+          const size_t i = next.fetch_add(1);
+          if (i >= size) break;
+          try {
+            PluginManager::ConvertToStandard(*events[i], results[i]);
+          } catch (const std::exception & e) {
+            errors[i] = e.what();
+          }
+        }
+      }
+      const DetectorEvent * const * events;
+      StandardEvent * results;
+      const size_t size;
+      Atomic<size_t> next;
+      std::vector<std::string> errors; ///< Each only written by the thread converting that event
+    };
+
+    void * ConvertBatch_thread(void * arg) {
+      static_cast<ConvertBatch *>(arg)->Run();
+      return 0;
+    }
+
+    void ConvertParallel(const DetectorEvent * const * events, StandardEvent * results, size_t n, unsigned threads) {
+      if (n == 0) return;
+      ConvertBatch batch(events, results, n);
+      std::vector<eudaqThread *> pool;
+      try {
+        // this thread does its share too
+        for (unsigned i = 1; i < threads && i < n; ++i) {
+          pool.push_back(new eudaqThread(ConvertBatch_thread, &batch));
+        }
+      } catch (...) {
+        // carry on with the threads that did start
+      }
+      batch.Run();
+      for (size_t i = 0; i < pool.size(); ++i) {
+        pool[i]->join();
+        delete pool[i];
+      }
+      for (size_t i = 0; i < n; ++i) {
+        if (!batch.errors[i].empty()) {
+          EUDAQ_THROW("Error converting event " + to_string(events[i]->GetEventNumber()) + ": " + batch.errors[i]);
+        }
+      }
+    }
+  }
+
   PluginManager & PluginManager::GetInstance() {
     // the only one static instance of the plugin manager is in the getInstance function
     // like this it is ensured that the instance is created before it is used
@@ -29,12 +84,19 @@ namespace eudaq {
 
   void PluginManager::RegisterPlugin(DataConverterPlugin * plugin) {
     m_pluginmap[plugin->GetEventType()] = plugin;
+    if (plugin->GetEventType().second == "EUDRB") m_eudrb = plugin;
   }
 
   DataConverterPlugin & PluginManager::GetPlugin(const Event & event) {
     return GetPlugin(std::make_pair(event.get_id(), event.GetSubType()));
   }
 
+  DataConverterPlugin * PluginManager::FindPlugin(const Event & event) {
+    std::map<t_eventid, DataConverterPlugin *>::iterator pluginiter
+      = m_pluginmap.find(std::make_pair(event.get_id(), event.GetSubType()));
+    return pluginiter == m_pluginmap.end() ? 0 : pluginiter->second;
+  }
+
   DataConverterPlugin & PluginManager::GetPlugin(PluginManager::t_eventid eventtype) {
     std::map<t_eventid, DataConverterPlugin *>::iterator pluginiter
       = m_pluginmap.find(eventtype);
@@ -48,9 +110,13 @@ namespace eudaq {
 
   void PluginManager::Initialize(const DetectorEvent & dev) {
     const eudaq::Configuration conf(dev.GetTag("CONFIG"));
+    PluginManager & manager = GetInstance();
+    manager.m_streams.Reset(dev);
     for (size_t i = 0; i < dev.NumEvents(); ++i) {
       const eudaq::Event & subev = *dev.GetEvent(i);
-      GetInstance().GetPlugin(subev).Initialize(subev, conf);
+      DataConverterPlugin * plugin = manager.m_streams.Get(dev, i);
+      if (!plugin) plugin = &manager.GetPlugin(subev); // throws
+      plugin->Initialize(subev, conf);
     }
   }
 
@@ -86,21 +152,28 @@ namespace eudaq {
   StandardEvent PluginManager::ConvertToStandard(const DetectorEvent & dev) {
     //StandardEvent event(dev.GetRunNumber(), dev.GetEventNumber(), dev.GetTimestamp());
     StandardEvent event(dev);
-    for (size_t i = 0; i < dev.NumEvents(); ++i) {
-      const Event * ev = dev.GetEvent(i);
-      if (!ev) EUDAQ_THROW("Null event!");
-      if (ev->GetSubType() == "EUDRB") {
-        ConvertStandardSubEvent(event, *ev);
-      }
-    }
-    for (size_t i = 0; i < dev.NumEvents(); ++i) {
-      const Event * ev = dev.GetEvent(i);
-      if (!ev) EUDAQ_THROW("Null event!");
-      if (ev->GetSubType() != "EUDRB") {
-        ConvertStandardSubEvent(event, *ev);
+    ConvertToStandard(dev, event);
+    return event;
+  }
+
+  void PluginManager::ConvertToStandard(const DetectorEvent & dev, StandardEvent & event) {
+    event.Reset(dev);
+    const PluginManager & manager = GetInstance();
+    // the EUDRB planes go first
+    for (int pass = 0; pass < 2; ++pass) {
+      for (size_t i = 0; i < dev.NumEvents(); ++i) {
+        const Event * ev = dev.GetEvent(i);
+        if (!ev) EUDAQ_THROW("Null event!");
+        DataConverterPlugin * plugin = manager.m_streams.Get(dev, i);
+        if ((plugin && plugin == manager.m_eudrb) != (pass == 0)) continue;
+        if (plugin) {
+          ConvertStandardSubEvent(event, *ev, *plugin);
+        } else {
+          // reports that there is no plugin
+          ConvertStandardSubEvent(event, *ev);
+        }
       }
     }
-    return event;
   }
 
 #if USE_LCIO
@@ -122,9 +195,45 @@ namespace eudaq {
   }
 #endif
 
+  void PluginManager::ConvertToStandard(const std::vector<const DetectorEvent *> & events,
+      std::vector<StandardEvent> & results, unsigned threads) {
+    if (threads == 0) threads = NumProcessors();
+    results.resize(events.size());
+    size_t begin = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (events[i]->IsBORE()) {
+        // the events of the previous run are converted before the plugins are set up for the next one
+        if (i > begin) ConvertParallel(&events[begin], &results[begin], i - begin, threads);
+        Initialize(*events[i]);
+        begin = i;
+      }
+    }
+    if (events.size() > begin) ConvertParallel(&events[begin], &results[begin], events.size() - begin, threads);
+  }
+
   void PluginManager::ConvertStandardSubEvent(StandardEvent & dest, const Event & source) {
     try {
-      GetInstance().GetPlugin(source).GetStandardSubEvent(dest, source);
+      ConvertStandardSubEvent(dest, source, GetInstance().GetPlugin(source));
+    } catch (const Exception & e) {
+      std::cerr << "Error during conversion in PluginManager::ConvertStandardSubEvent:\n" << e.what() << std::endl;
+    }
+  }
+
+  void PluginManager::ConvertStandardSubEvent(StandardEvent & dest, const Event & source, DataConverterPlugin & plugin) {
+    try {
+      if (plugin.IsThreadSafe()) {
+        plugin.GetStandardSubEvent(dest, source);
+      } else {
+        Mutex & serial = GetInstance().m_serial;
+        serial.Lock();
+        try {
+          plugin.GetStandardSubEvent(dest, source);
+        } catch (...) {
+          serial.UnLock();
+          throw;
+        }
+        serial.UnLock();
+      }
     } catch (const Exception & e) {
       std::cerr << "Error during conversion in PluginManager::ConvertStandardSubEvent:\n" << e.what() << std::endl;
     }
@@ -134,4 +243,32 @@ namespace eudaq {
     GetInstance().GetPlugin(source).GetLCIOSubEvent(dest, source);
   }
 
+  void PluginStreams::Reset(const DetectorEvent & bore) {
+    // events built by timestamp hold any number of events from each producer
+    const Configuration conf(bore.GetTag("CONFIG"), "DataCollector");
+    m_ordered = lcase(conf.Get("EventBuilding", "position")) != "timestamp";
+    m_plugins.resize(bore.NumEvents());
+    for (size_t i = 0; i < bore.NumEvents(); ++i) {
+      const Event * ev = bore.GetEvent(i);
+      m_plugins[i] = ev ? PluginManager::GetInstance().FindPlugin(*ev) : 0;
+    }
+  }
+
+  DataConverterPlugin * PluginStreams::Get(const DetectorEvent & dev, size_t i) const {
+    const Event * ev = dev.GetEvent(i);
+    if (!ev) return 0;
+    if (m_ordered && dev.NumEvents() == m_plugins.size() && !dev.IsPartial()) {
+      DataConverterPlugin * plugin = m_plugins[i];
+      // a different class of event means the stream order was not kept after all
+      if (plugin && plugin->GetEventType().first == ev->get_id()) return plugin;
+    }
+    return PluginManager::GetInstance().FindPlugin(*ev);
+  }
+
+  unsigned PluginStreams::GetTriggerID(const DetectorEvent & dev, size_t i) const {
+    DataConverterPlugin * plugin = Get(dev, i);
+    if (!plugin) return PluginManager::GetTriggerID(*dev.GetEvent(i)); // throws
+    return plugin->GetTriggerID(*dev.GetEvent(i));
+  }
+
 }//namespace eudaq
@@ -321,7 +321,7 @@ namespace eudaq {
         std::vector< eutelescope::EUTelSetupDescription * >  setupDescription;
 
         for (size_t chip = 0; chip < ev_raw.NumBlocks(); ++chip) {
-          const std::vector <unsigned char> & buffer=dynamic_cast<const std::vector<unsigned char> &> (ev_raw.GetBlock(chip));
+          const std::vector <unsigned char> buffer = ev_raw.GetBlock(chip);
 
           if (lcioEvent.getEventNumber() == 0) {
             eutelescope::EUTelPixelDetector * currentDetector = new eutelescope::EUTelAPIXMCDetector(2);
@@ -2,6 +2,8 @@
 #include "eudaq/PluginManager.hh"
 
 #include <ostream>
+#include <stdexcept>
+#include <algorithm>
 
 namespace eudaq {
 
@@ -9,16 +11,43 @@ namespace eudaq {
 
   RawDataEvent::block_t::block_t(Deserializer & des) {
     des.read(id);
-    des.read(data);
+    if (des.CanView()) {
+      des.read(view);
+    } else {
+      des.read(data);
+    }
   }
 
   void RawDataEvent::block_t::Serialize(Serializer & ser) const {
     ser.write(id);
-    ser.write(data);
+    ser.write(View());
   }
 
   void RawDataEvent::block_t::Append(const RawDataEvent::data_t & d) {
-    data.insert(data.end(), d.begin(), d.end());
+    Append(d.empty() ? 0 : &d[0], d.size());
+  }
+
+  void RawDataEvent::block_t::Append(const byte_t * d, size_t bytes) {
+    Vector().insert(data.end(), d, d + bytes);
+  }
+
+  void RawDataEvent::block_t::swap(block_t & other) {
+    std::swap(id, other.id);
+    data.swap(other.data);
+    std::swap(view, other.view);
+  }
+
+  ByteView RawDataEvent::block_t::View() const {
+    if (view.data()) return view;
+    return ByteView(data.empty() ? 0 : &data[0], data.size());
+  }
+
+  RawDataEvent::data_t & RawDataEvent::block_t::Vector() {
+    if (view.data()) {
+      data.assign(view.begin(), view.end());
+      view = ByteView();
+    }
+    return data;
   }
 
   RawDataEvent::RawDataEvent(std::string type, unsigned run, unsigned event) :
@@ -28,22 +57,66 @@ namespace eudaq {
   }
 
   RawDataEvent::RawDataEvent(Deserializer & ds) :
-    Event(ds)
+    Event(ds),
+    m_blocks(ArenaAllocator<block_t>(ds.GetArena()))
   {
     ds.read(m_type);
-    ds.read(m_blocks);
+    unsigned len = 0;
+    ds.read(len);
+    m_blocks.resize(len);
+    for (size_t i = 0; i < len; ++i) {
+      block_t block(ds);
+      m_blocks[i].swap(block);
+    }
+  }
+
+  size_t RawDataEvent::AddBlock(unsigned id) {
+    if (m_blocks.size() == m_blocks.capacity()) {
+      // grow by hand, so that the existing blocks are swapped rather than copied
+      blocks_t blocks(m_blocks.get_allocator());
+      blocks.reserve(m_blocks.empty() ? 4 : 2 * m_blocks.size());
+      blocks.resize(m_blocks.size());
+      for (size_t i = 0; i < m_blocks.size(); ++i) {
+        blocks[i].swap(m_blocks[i]);
+      }
+      m_blocks.swap(blocks);
+    }
+    m_blocks.push_back(block_t(id));
+    return m_blocks.size() - 1;
+  }
+
+  void RawDataEvent::ReserveBlock(size_t index, size_t bytes) {
+    m_blocks.at(index).Vector().reserve(bytes);
+  }
+
+  void RawDataEvent::ReserveBlocks(size_t n) {
+    if (n <= m_blocks.capacity()) return;
+    blocks_t blocks(m_blocks.get_allocator());
+    blocks.reserve(n);
+    blocks.resize(m_blocks.size());
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+      blocks[i].swap(m_blocks[i]);
+    }
+    m_blocks.swap(blocks);
   }
 
   unsigned RawDataEvent::GetID(size_t i) const {
     return m_blocks.at(i).id;
   }
 
-  const RawDataEvent::data_t & RawDataEvent::GetBlock(size_t i) const {
-    return m_blocks.at(i).data;
+  RawDataEvent::data_t RawDataEvent::GetBlock(size_t i) const {
+    const ByteView data = GetBlockView(i);
+    return data_t(data.begin(), data.end());
+  }
+
+  ByteView RawDataEvent::GetBlockView(size_t i) const {
+    return m_blocks.at(i).View();
   }
 
   RawDataEvent::byte_t RawDataEvent::GetByte(size_t block, size_t index) const {
-    return GetBlock(block).at(index);
+    ByteView data = GetBlockView(block);
+    if (index >= data.size()) throw std::out_of_range("RawDataEvent::GetByte");
+    return data.data()[index];
   }
 
   void RawDataEvent::Print(std::ostream & os) const {
@@ -63,7 +136,11 @@ namespace eudaq {
   void RawDataEvent::Serialize(Serializer & ser) const {
     Event::Serialize(ser);
     ser.write(m_type);
-    ser.write(m_blocks);
+    // the same layout as a std::vector of blocks
+    ser.write((unsigned)m_blocks.size());
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+      ser.write(m_blocks[i]);
+    }
   }
 
 }
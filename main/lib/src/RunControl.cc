@@ -295,8 +295,17 @@ namespace eudaq {
 
     // combine IP from connection with port number reported by data server
     m_dataaddr = dataip;  m_dataaddr += ":"; m_dataaddr += dataport;
+    // shared memory is named rather than addressed, producers must run on the data server's host
+    if (dsAddrReported.compare(0, 6, "shm://") == 0) m_dataaddr = dsAddrReported;
     std::cout << "DataServer responded: full server address determined to be  = '" << m_dataaddr << "'" << std::endl;
-    SendCommand("DATA", m_dataaddr);
+    // a shared memory server next to the main one is only for connections from the same host
+    m_shmaddr = status.GetTag("_SHMSERVER");
+    m_datahost = std::string(id.GetRemote(), 0, id.GetRemote().find(':'));
+    if (m_shmaddr != "") std::cout << "DataServer responded: shared memory server for producers on " << m_datahost << " = '" << m_shmaddr << "'" << std::endl;
+    for (size_t i = 0; i < NumConnections(); ++i) {
+      const ConnectionInfo & conn = GetConnection(i);
+      if (conn.GetState() > 0) SendCommand("DATA", DataAddress(conn), conn);
+    }
 
     if (m_ilog != (size_t)-1) {
       SendCommand("LOG", m_logaddr, id);
@@ -321,7 +330,7 @@ namespace eudaq {
     SendCommand("LOG", m_logaddr);
 
     if (m_idata != (size_t)-1) {
-      SendCommand("DATA", m_dataaddr, id);
+      SendCommand("DATA", DataAddress(id), id);
     }
   }
 
@@ -333,8 +342,15 @@ namespace eudaq {
     }
 
     if (m_idata != (size_t)-1) {
-      SendCommand("DATA", m_dataaddr, id);
+      SendCommand("DATA", DataAddress(id), id);
+    }
+  }
+
+  std::string RunControl::DataAddress(const ConnectionInfo & id) const {
+    if (m_shmaddr != "" && std::string(id.GetRemote(), 0, id.GetRemote().find(':')) == m_datahost) {
+      return m_shmaddr;
     }
+    return m_dataaddr;
   }
 
 }
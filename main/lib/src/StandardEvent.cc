@@ -1,10 +1,17 @@
 #include "eudaq/StandardEvent.hh"
+#include "eudaq/CompactPlane.hh"
 #include "eudaq/Exception.hh"
 
 namespace eudaq {
 
   EUDAQ_DEFINE_EVENT(StandardEvent, str2id("_STD"));
 
+  namespace {
+    /// Written in place of the length of the type string, which is never this long
+    static const unsigned COMPACTMARKER = 0xffffffff;
+    static const unsigned COMPACTVERSION = 2;
+  }
+
   StandardPlane::StandardPlane() : m_id(0), m_tluevent(0), m_xsize(0), m_ysize(0), m_flags(0), m_pivotpixel(0), m_result_pix(0), m_result_x(0), m_result_y(0) {}
 
   StandardPlane::StandardPlane(unsigned id, const std::string & type, const std::string & sensor)
@@ -13,7 +20,20 @@ namespace eudaq {
   {}
 
   StandardPlane::StandardPlane(Deserializer & ds) : m_result_pix(0), m_result_x(0), m_result_y(0) {
-    ds.read(m_type);
+    // the original layout starts with the length of the type, where the compact one has a marker
+    unsigned len = 0;
+    ds.read(len);
+    if (len == COMPACTMARKER) {
+      unsigned version = 0;
+      ds.read(version);
+      if (version != COMPACTVERSION) EUDAQ_THROW("Unknown StandardPlane version " + to_string(version));
+      CompactPlane(ds).ToStandardPlane(*this);
+      return;
+    }
+    m_type.resize(len);
+    for (unsigned i = 0; i < len; ++i) {
+      ds.read(m_type[i]);
+    }
     ds.read(m_sensor);
     ds.read(m_id);
     ds.read(m_tluevent);
@@ -29,6 +49,13 @@ namespace eudaq {
   }
 
   void StandardPlane::Serialize(Serializer & ser) const {
+    CompactPlane::CHARGE chargetype;
+    if (CompactPlane::Fits(*this, chargetype)) {
+      ser.write(COMPACTMARKER);
+      ser.write(COMPACTVERSION);
+      CompactPlane::Write(*this, chargetype, ser);
+      return;
+    }
     ser.write(m_type);
     ser.write(m_sensor);
     ser.write(m_id);
@@ -44,6 +71,20 @@ namespace eudaq {
     ser.write(m_mat);
   }
 
+  void StandardPlane::Reset(unsigned id, const std::string & type, const std::string & sensor) {
+    m_type = type;
+    m_sensor = sensor;
+    m_id = id;
+    m_tluevent = m_xsize = m_ysize = m_flags = m_pivotpixel = 0;
+    for (size_t i = 0; i < m_pix.size(); ++i) m_pix[i].clear();
+    for (size_t i = 0; i < m_x.size(); ++i) m_x[i].clear();
+    for (size_t i = 0; i < m_y.size(); ++i) m_y[i].clear();
+    for (size_t i = 0; i < m_pivot.size(); ++i) m_pivot[i].clear();
+    m_mat.clear();
+    m_result_pix = 0;
+    m_result_x = m_result_y = 0;
+  }
+
   // StandardPlane::StandardPlane(size_t pixels, size_t frames) 
   //   : m_pix(frames, std::vector<pixel_t>(pixels)), m_x(pixels), m_y(pixels), m_pivot(pixels)
   // {
@@ -89,6 +130,67 @@ namespace eudaq {
     //std::cout << "DBG: " << frame << ", " << x << ", " << y << ", " << p << ";" << m_pix[0].size() << ", " << m_pivot.size() << std::endl;
   }
 
+  void StandardPlane::SetRawPixels(size_t n, const unsigned short * x, const unsigned short * y,
+      const unsigned char * pivot, const short * const * frames) {
+    const size_t npix = m_xsize * m_ysize;
+    const size_t nframes = m_pix.size();
+    if (m_x.size() != 1 || m_pivot.size() != 1 || m_x[0].size() != npix) EUDAQ_THROW("SetRawPixels needs a raw plane with pivot flags");
+    m_result_pix = 0;
+    if (n == 0) return;
+    const bool cds = GetFlags(FLAG_NEEDCDS) && (nframes == 2 || nframes == 3) && n == npix;
+    if (cds) m_temp_pix.resize(npix);
+    coord_t * xs = &m_x[0][0], * ys = &m_y[0][0];
+    std::vector<bool> & pivots = m_pivot[0];
+    pixel_t * pix[3] = { 0, 0, 0 };
+    for (size_t f = 0; f < nframes && f < 3; ++f) pix[f] = &m_pix[f][0];
+    for (size_t k = 0; k < n; ++k) {
+      const size_t i = x[k] + y[k] * (size_t)m_xsize;
+      if (i >= npix) EUDAQ_THROW("Bad pixel (" + to_string(x[k]) + ", " + to_string(y[k]) + ") in SetRawPixels");
+      xs[i] = x[k];
+      ys[i] = y[k];
+      pivots[i] = pivot[k] != 0;
+      for (size_t f = 0; f < nframes; ++f) {
+        m_pix[f][i] = frames[f][k];
+      }
+      if (cds) {
+        // as in SetupResult
+        if (nframes == 2) {
+          m_temp_pix[i] = pix[1][i] - pix[0][i];
+        } else {
+          const int p = pivot[k] != 0;
+          m_temp_pix[i] = pix[0][i] * (p - 1) + pix[1][i] * (2 * p - 1) + pix[2][i] * p;
+        }
+      }
+    }
+    if (cds) {
+      m_result_pix = &m_temp_pix;
+      m_result_x = &m_x[0];
+      m_result_y = &m_y[0];
+    }
+  }
+
+  void StandardPlane::PushPixels(unsigned frame, size_t n, const unsigned short * x, const unsigned short * y,
+      double pix, const unsigned char * pivot) {
+    if (frame >= m_x.size() || frame >= m_pix.size()) EUDAQ_THROW("Bad frame number " + to_string(frame) + " in PushPixels");
+    std::vector<coord_t> & xs = m_x[frame], & ys = m_y[frame];
+    const size_t start = xs.size();
+    xs.resize(start + n);
+    ys.resize(start + n);
+    for (size_t i = 0; i < n; ++i) {
+      xs[start + i] = x[i];
+      ys[start + i] = y[i];
+    }
+    m_pix[frame].resize(m_pix[frame].size() + n, pix);
+    if (m_pivot.size()) {
+      std::vector<bool> & pivots = m_pivot[frame];
+      const size_t pstart = pivots.size();
+      pivots.resize(pstart + n);
+      for (size_t i = 0; pivot && i < n; ++i) {
+        pivots[pstart + i] = pivot[i] != 0;
+      }
+    }
+  }
+
   void StandardPlane::SetPixelHelper(unsigned index, unsigned x, unsigned y, double pix, bool pivot, unsigned frame) {
     if (frame >= m_pix.size()) EUDAQ_THROW("Bad frame number " + to_string(frame) + " in SetPixel");
     if (frame < m_x.size()) m_x.at(frame).at(index) = x;
@@ -325,12 +427,12 @@ namespace eudaq {
   template std::vector<double> StandardPlane::GetPixels<>() const;
 
   StandardEvent::StandardEvent(unsigned run, unsigned evnum, unsigned long long timestamp)
-    : Event(run, evnum, timestamp)
+    : Event(run, evnum, timestamp), m_numplanes(0)
   {
   }
 
   StandardEvent::StandardEvent(const Event & e)
-    : Event(e)
+    : Event(e), m_numplanes(0)
   {
   }
 
@@ -338,11 +440,21 @@ namespace eudaq {
     : Event(ds)
   {
     ds.read(m_planes);
+    m_numplanes = m_planes.size();
   }
 
   void StandardEvent::Serialize(Serializer & ser) const {
     Event::Serialize(ser);
-    ser.write(m_planes);
+    // the same layout as the vector of planes
+    ser.write((unsigned)m_numplanes);
+    for (size_t i = 0; i < m_numplanes; ++i) {
+      ser.write(m_planes[i]);
+    }
+  }
+
+  void StandardEvent::Reset(const Event & header) {
+    Event::operator = (header);
+    m_numplanes = 0;
   }
 
   void StandardEvent::SetTimestamp(unsigned long long val) {
@@ -351,14 +463,14 @@ namespace eudaq {
 
   void StandardEvent::Print(std::ostream & os) const {
     Event::Print(os);
-    os << ", " << m_planes.size() << " planes:\n";
-    for (size_t i = 0; i < m_planes.size(); ++i) {
+    os << ", " << m_numplanes << " planes:\n";
+    for (size_t i = 0; i < m_numplanes; ++i) {
       os << "  " << m_planes[i] << "\n";
     }
   }
 
   size_t StandardEvent::NumPlanes() const {
-    return m_planes.size();
+    return m_numplanes;
   }
 
   StandardPlane & StandardEvent::GetPlane(size_t i) {
@@ -370,8 +482,26 @@ namespace eudaq {
   }
 
   StandardPlane & StandardEvent::AddPlane(const StandardPlane & plane) {
-    m_planes.push_back(plane);
-    return m_planes.back();
+    if (m_numplanes < m_planes.size()) {
+      // assigning reuses the memory of the vectors already there
+      m_planes[m_numplanes] = plane;
+    } else {
+      m_planes.push_back(plane);
+    }
+    return m_planes[m_numplanes++];
+  }
+
+  StandardPlane & StandardEvent::NewPlane(unsigned id, const std::string & type, const std::string & sensor) {
+    if (m_numplanes < m_planes.size()) {
+      m_planes[m_numplanes].Reset(id, type, sensor);
+    } else {
+      m_planes.push_back(StandardPlane(id, type, sensor));
+    }
+    return m_planes[m_numplanes++];
+  }
+
+  void StandardEvent::PopPlane() {
+    if (m_numplanes) --m_numplanes;
   }
 
 }
@@ -17,6 +17,7 @@ namespace eudaq{
         result.SetTimestamp(source.GetTimestamp());
         return true;
       }
+      virtual bool IsThreadSafe() const { return true; }
       virtual unsigned GetTriggerID(const eudaq::Event & ev) const {
         return ev.GetEventNumber();
       }
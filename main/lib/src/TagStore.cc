@@ -0,0 +1,151 @@
+#include "eudaq/TagStore.hh"
+#include "eudaq/Mutex.hh"
+#include "eudaq/Atomic.hh"
+#include <set>
+
+namespace eudaq {
+
+  namespace {
+    /** The interned names. Names are only ever added, so the hash table
+     *  of them can be searched without a lock; the lock is only taken to
+     *  add a name. Once the table is half full, further names only go into
+     *  the set, which is then also searched (under the lock) for names not
+     *  in the table.
+     */
+    struct NameTable {
+      enum { SLOTS = 1024 };
+      NameTable() : used(0), overflow(0) {}
+      Mutex mutex;
+      std::set<std::string> names;
+      Atomic<TagStore::name_t> slots[SLOTS];
+      size_t used; ///< Filled slots, protected by mutex
+      Atomic<int> overflow; ///< Set once a name has gone into the set only
+    };
+
+    NameTable & GetNames() {
+      static NameTable table;
+      return table;
+    }
+
+    size_t Hash(const std::string & s) {
+      size_t h = 2166136261U;
+      for (size_t i = 0; i < s.size(); ++i) {
+        h = (h ^ (unsigned char)s[i]) * 16777619U;
+      }
+      return h;
+    }
+
+    /// The slot holding name, or the empty slot where it would go
+    size_t Probe(const NameTable & table, const std::string & name) {
+      size_t i = Hash(name) % NameTable::SLOTS;
+      for (;;) {
+        TagStore::name_t n = table.slots[i].load();
+        if (!n || *n == name) return i;
+        i = (i + 1) % NameTable::SLOTS;
+      }
+    }
+  }
+
+  std::string TagValue::Text() const {
+    switch (m_kind) {
+      case SIGNED: return to_string(m_num.s);
+      case UNSIGNED: return to_string(m_num.u);
+      case REAL: return to_string(m_num.d);
+      default: return m_text;
+    }
+  }
+
+  TagStore::name_t TagStore::Intern(const std::string & name) {
+    NameTable & table = GetNames();
+    if (name_t result = table.slots[Probe(table, name)].load()) return result;
+    table.mutex.Lock();
+    name_t result = 0;
+    try {
+      result = &*table.names.insert(name).first;
+      size_t slot = Probe(table, name);
+      if (table.slots[slot].load()) {
+        // added by another thread since the search above
+      } else if (table.used < NameTable::SLOTS / 2) {
+        table.slots[slot].store(result);
+        ++table.used;
+      } else {
+        table.overflow.store(1);
+      }
+    } catch (...) {
+      table.mutex.UnLock();
+      throw;
+    }
+    table.mutex.UnLock();
+    return result;
+  }
+
+  TagStore::name_t TagStore::Lookup(const std::string & name) {
+    NameTable & table = GetNames();
+    name_t result = table.slots[Probe(table, name)].load();
+    if (result || !table.overflow.load()) return result;
+    table.mutex.Lock();
+    std::set<std::string>::const_iterator it = table.names.find(name);
+    if (it != table.names.end()) result = &*it;
+    table.mutex.UnLock();
+    return result;
+  }
+
+  TagStore::TagStore(Deserializer & ds) {
+    unsigned len = 0;
+    ds.read(len);
+    for (size_t i = 0; i < len; ++i) {
+      std::string name = ds.read<std::string>();
+      std::string val = ds.read<std::string>();
+      Set(name, val);
+    }
+  }
+
+  void TagStore::Serialize(Serializer & ser) const {
+    ser.write((unsigned)m_tags.size());
+    for (size_t i = 0; i < m_tags.size(); ++i) {
+      ser.write(*m_tags[i].first);
+      ser.write(m_tags[i].second.Text());
+    }
+  }
+
+  size_t TagStore::Position(const std::string & name) const {
+    size_t lo = 0, hi = m_tags.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (*m_tags[mid].first < name) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  size_t TagStore::Position(name_t name) const {
+    // events have few tags, so a scan comparing pointers beats a binary search comparing strings
+    size_t pos = 0;
+    while (pos < m_tags.size() && m_tags[pos].first != name) ++pos;
+    return pos;
+  }
+
+  void TagStore::Set(const std::string & name, const TagValue & value) {
+    name_t key = Intern(name);
+    size_t pos = Position(key);
+    if (pos < m_tags.size()) {
+      m_tags[pos].second = value;
+      return;
+    }
+    // tags are mostly set (and read in) in order, so try the end first
+    if (pos > 0 && name < *m_tags[pos - 1].first) pos = Position(name);
+    m_tags.insert(m_tags.begin() + pos, tag_t(key, value));
+  }
+
+  const TagValue * TagStore::Find(const std::string & name) const {
+    if (m_tags.empty()) return 0;
+    name_t key = Lookup(name);
+    if (!key) return 0;
+    size_t pos = Position(key);
+    return pos < m_tags.size() ? &m_tags[pos].second : 0;
+  }
+
+}
@@ -6,6 +6,7 @@ namespace eudaq {
   // This class is only here to prevent a runtime errors
   class TestConverterPlugin : public DataConverterPlugin {
     TestConverterPlugin() : DataConverterPlugin("Test") {}
+    virtual bool IsThreadSafe() const { return true; }
     static TestConverterPlugin m_instance;
   };
 
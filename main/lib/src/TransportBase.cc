@@ -40,7 +40,8 @@ namespace eudaq {
       MutexLock m(m_mutex);
       if (m_events.empty()) break;
       //std::cout << "Got packet" << std::endl;
-      TransportEvent evt(m_events.front());
+      TransportEvent evt(m_events.front().etype, m_events.front().id);
+      evt.packet.swap(m_events.front().packet);
       m_events.pop();
       m.Release();
       m_callback(evt);
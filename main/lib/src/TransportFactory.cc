@@ -8,6 +8,7 @@
 // All transport header files must be included here
 #include "eudaq/TransportNULL.hh"
 #include "eudaq/TransportTCP.hh"
+#include "eudaq/TransportSHM.hh"
 
 namespace eudaq {
 
@@ -48,6 +49,10 @@ namespace eudaq {
         // All transports have to be registered here
         TransportFactory::Register(MakeTransportInfo<NULLServer, NULLClient>(NULLServer::name));
         TransportFactory::Register(MakeTransportInfo<TCPServer, TCPClient>(TCPServer::name));
+#if EUDAQ_PLATFORM_IS(LINUX)
+        TransportFactory::Register(MakeTransportInfo<EpollServer, TCPClient>(EpollServer::name));
+        TransportFactory::Register(MakeTransportInfo<SHMServer, SHMClient>(SHMServer::name));
+#endif
       }
       static map_t m;
       return m;
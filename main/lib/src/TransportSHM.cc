@@ -0,0 +1,504 @@
+#include "eudaq/TransportSHM.hh"
+
+#if EUDAQ_PLATFORM_IS(LINUX)
+
+#include "eudaq/Exception.hh"
+#include "eudaq/Utils.hh"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <cstring>
+#include <algorithm>
+#include <ostream>
+
+namespace eudaq {
+
+  namespace {
+
+    static const uint32_t SHM_MAGIC = 0x45534d31; // "ESM1"
+    static const unsigned SHM_SLOTS = 16;
+    /// Ring sizes must be powers of two, producer data goes up and commands come down
+    static const size_t UP_RING_SIZE = 1 << 22;
+    static const size_t DOWN_RING_SIZE = 1 << 16;
+    /// How long a blocked sender sleeps before checking that the other side is still there (ms)
+    static const int SEND_WAIT = 100;
+
+    enum SlotState {
+      SLOT_FREE,       ///< available to a new client
+      SLOT_CLAIMED,    ///< a client is setting it up
+      SLOT_CONNECTING, ///< waiting for the server to accept it
+      SLOT_CONNECTED,
+      SLOT_CLOSED,     ///< the client has gone, the server frees it once the data is read
+      SLOT_DROPPED     ///< the server has gone, the client frees it
+    };
+
+  }
+
+  /// Lets a process sleep until the other side has something for it
+  struct ShmWaiter {
+    uint32_t waiting;
+    sem_t sem;
+  };
+
+  /// Positions count all bytes ever written and read, each is only changed by one side
+  struct ShmRing {
+    uint64_t head;
+    char pad0[56];
+    uint64_t tail;
+    char pad1[56];
+    ShmWaiter space; ///< the writer waiting for the reader to make room
+  };
+
+  struct ShmSlot {
+    uint32_t state;
+    pid_t pid;
+    ShmWaiter client;
+    ShmRing up, down;
+    char updata[UP_RING_SIZE];
+    char downdata[DOWN_RING_SIZE];
+  };
+
+  struct ShmSegment {
+    uint32_t magic;
+    pid_t serverpid;
+    ShmWaiter server;
+    ShmSlot slots[SHM_SLOTS];
+  };
+
+  namespace {
+
+    static std::string segment_name(const std::string & name) {
+      return "/eudaq." + name;
+    }
+
+    static std::string LastSysErrorString(const std::string & msg) {
+      return msg + ": " + std::strerror(errno);
+    }
+
+    static uint32_t load(const uint32_t & v) {
+      return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+    }
+
+    static uint64_t load(const uint64_t & v) {
+      return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+    }
+
+    template <typename T>
+      static void store(T & v, T x) {
+        __atomic_store_n(&v, x, __ATOMIC_RELEASE);
+      }
+
+    static bool change_state(ShmSlot & slot, uint32_t from, uint32_t to) {
+      return __atomic_compare_exchange_n(&slot.state, &from, to, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+
+    static bool process_alive(pid_t pid) {
+      return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+    }
+
+    /// Wakes up the other side if it is sleeping in wait()
+    static void notify(ShmWaiter & w) {
+      if (__atomic_load_n(&w.waiting, __ATOMIC_SEQ_CST) &&
+          __atomic_exchange_n(&w.waiting, 0, __ATOMIC_SEQ_CST)) {
+        sem_post(&w.sem);
+      }
+    }
+
+    /// Announces that we are about to sleep, the condition must be checked again afterwards
+    static void arm(ShmWaiter & w) {
+      __atomic_store_n(&w.waiting, 1, __ATOMIC_SEQ_CST);
+    }
+
+    static void disarm(ShmWaiter & w) {
+      __atomic_store_n(&w.waiting, 0, __ATOMIC_SEQ_CST);
+    }
+
+    /// Sleeps after arm() until notified or until the time is up
+    static void wait(ShmWaiter & w, const Time & t) {
+      timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      timeval tv = t;
+      ts.tv_sec += tv.tv_sec;
+      ts.tv_nsec += tv.tv_usec * 1000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+      }
+      while (sem_timedwait(&w.sem, &ts) && errno == EINTR) {
+      }
+      disarm(w);
+    }
+
+    static void init_waiter(ShmWaiter & w) {
+      w.waiting = 0;
+      if (sem_init(&w.sem, 1, 0)) EUDAQ_THROW_NOLOG(LastSysErrorString("Failed to create semaphore"));
+    }
+
+    static void reset_ring(ShmRing & r) {
+      r.head = r.tail = 0;
+      r.space.waiting = 0;
+    }
+
+    /// Returns whether the other side can still read what is sent
+    static bool peer_alive(const ShmSlot & slot, pid_t peer) {
+      uint32_t state = load(slot.state);
+      return (state == SLOT_CONNECTING || state == SLOT_CONNECTED) && process_alive(peer);
+    }
+
+    /// Writes the data into the ring, waiting for the reader to make room as necessary
+    static void ring_write(ShmRing & r, char * buf, size_t size, ShmWaiter & reader,
+        const ShmSlot & slot, pid_t peer, const unsigned char * data, size_t len) {
+      uint64_t head = r.head;
+      while (len) {
+        size_t space = size - static_cast<size_t>(head - load(r.tail));
+        if (!space) {
+          arm(r.space);
+          if (size - static_cast<size_t>(head - load(r.tail)) == 0) {
+            wait(r.space, Time(0, SEND_WAIT * 1000));
+            if (size - static_cast<size_t>(head - load(r.tail)) == 0 && !peer_alive(slot, peer)) {
+              EUDAQ_THROW_NOLOG("Connection reset by peer");
+            }
+          } else {
+            disarm(r.space);
+          }
+          continue;
+        }
+        size_t pos = static_cast<size_t>(head) & (size - 1);
+        size_t n = std::min(std::min(space, len), size - pos);
+        std::memcpy(buf + pos, data, n);
+        data += n;
+        len -= n;
+        head += n;
+        store(r.head, head);
+        notify(reader);
+      }
+    }
+
+    static void send_packet(ShmRing & r, char * buf, size_t size, ShmWaiter & reader,
+        const ShmSlot & slot, pid_t peer, const unsigned char * data, size_t len) {
+      if (!peer_alive(slot, peer)) EUDAQ_THROW_NOLOG("Connection reset by peer");
+      unsigned char header[4];
+      for (int i = 0; i < 4; ++i) {
+        header[i] = static_cast<unsigned char>(len >> (8 * i));
+      }
+      ring_write(r, buf, size, reader, slot, peer, header, sizeof header);
+      ring_write(r, buf, size, reader, slot, peer, data, len);
+    }
+
+  } // anonymous namespace
+
+  const std::string SHMServer::name = "shm";
+
+  size_t ConnectionInfoSHM::receive(bool server, std::queue<TransportEvent> & events) {
+    ShmRing & r = server ? m_slot->up : m_slot->down;
+    const char * buf = server ? m_slot->updata : m_slot->downdata;
+    const size_t size = server ? UP_RING_SIZE : DOWN_RING_SIZE;
+    size_t packets = 0;
+    uint64_t tail = r.tail;
+    for (;;) {
+      uint64_t head = load(r.head);
+      if (head == tail) break;
+      while (tail != head) {
+        size_t pos = static_cast<size_t>(tail) & (size - 1);
+        size_t avail = std::min(static_cast<size_t>(head - tail), size - pos);
+        if (m_hdrfill < 4) {
+          size_t n = std::min(avail, 4 - m_hdrfill);
+          std::memcpy(m_hdr + m_hdrfill, buf + pos, n);
+          m_hdrfill += n;
+          tail += n;
+          if (m_hdrfill < 4) continue;
+          m_len = m_hdr[0] | (m_hdr[1] << 8) | (m_hdr[2] << 16) | (static_cast<size_t>(m_hdr[3]) << 24);
+          m_packet.assign(m_len, '\0');
+          m_fill = 0;
+        } else {
+          size_t n = std::min(avail, m_len - m_fill);
+          std::memcpy(&m_packet[m_fill], buf + pos, n);
+          m_fill += n;
+          tail += n;
+        }
+        if (m_fill == m_len) {
+          events.push(TransportEvent(TransportEvent::RECEIVE, *this));
+          events.back().packet.swap(m_packet);
+          m_hdrfill = 0;
+          ++packets;
+        }
+      }
+      store(r.tail, tail);
+      notify(r.space);
+    }
+    return packets;
+  }
+
+  void ConnectionInfoSHM::Disable() {
+    m_state = -1;
+    m_hdrfill = m_len = m_fill = 0;
+    std::string().swap(m_packet);
+  }
+
+  bool ConnectionInfoSHM::Matches(const ConnectionInfo & other) const {
+    const ConnectionInfoSHM * ptr = dynamic_cast<const ConnectionInfoSHM *>(&other);
+    return ptr && ptr->m_index == m_index && ptr->m_serial == m_serial;
+  }
+
+  void ConnectionInfoSHM::Print(std::ostream & os) const {
+    ConnectionInfo::Print(os);
+    os << " (" << m_host << ")";
+  }
+
+  ConnectionInfo * ConnectionInfoSHM::Clone() const {
+    // the copy only identifies the connection, so leave out the buffers
+    ConnectionInfoSHM * result = new ConnectionInfoSHM(m_slot, m_index, m_serial, m_host);
+    result->SetState(GetState());
+    result->SetType(GetType());
+    result->SetName(GetName());
+    result->SetHandle(GetHandle());
+    return result;
+  }
+
+  SHMServer::SHMServer(const std::string & param)
+    : m_name(param == "" ? "eudaq" : param), m_seg(0), m_serial(0),
+    m_active(SHM_SLOTS, (ConnectionInfoSHM *)0), m_lastcheck(Time::Current())
+  {
+    const std::string segname = segment_name(m_name);
+    int fd = shm_open(segname.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0 && errno == EEXIST) {
+      // left over from a server that did not shut down cleanly?
+      int oldfd = shm_open(segname.c_str(), O_RDONLY, 0);
+      if (oldfd >= 0) {
+        void * old = mmap(0, sizeof(ShmSegment), PROT_READ, MAP_SHARED, oldfd, 0);
+        close(oldfd);
+        if (old != MAP_FAILED) {
+          const ShmSegment * seg = static_cast<const ShmSegment *>(old);
+          bool inuse = load(seg->magic) == SHM_MAGIC && process_alive(seg->serverpid);
+          munmap(old, sizeof(ShmSegment));
+          if (inuse) EUDAQ_THROW_NOLOG("Shared memory " + m_name + " is already in use by another server");
+        }
+      }
+      shm_unlink(segname.c_str());
+      fd = shm_open(segname.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    }
+    if (fd < 0) EUDAQ_THROW_NOLOG(LastSysErrorString("Failed to create shared memory " + m_name));
+    if (ftruncate(fd, sizeof(ShmSegment))) {
+      close(fd);
+      shm_unlink(segname.c_str());
+      EUDAQ_THROW_NOLOG(LastSysErrorString("Failed to size shared memory " + m_name));
+    }
+    void * p = mmap(0, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      shm_unlink(segname.c_str());
+      EUDAQ_THROW_NOLOG(LastSysErrorString("Failed to map shared memory " + m_name));
+    }
+    // the new segment is all zeroes, so every slot starts out free
+    m_seg = static_cast<ShmSegment *>(p);
+    init_waiter(m_seg->server);
+    for (unsigned i = 0; i < SHM_SLOTS; ++i) {
+      init_waiter(m_seg->slots[i].client);
+      init_waiter(m_seg->slots[i].up.space);
+      init_waiter(m_seg->slots[i].down.space);
+    }
+    m_seg->serverpid = getpid();
+    store(m_seg->magic, SHM_MAGIC);
+  }
+
+  SHMServer::~SHMServer() {
+    for (unsigned i = 0; i < SHM_SLOTS; ++i) {
+      ShmSlot & slot = m_seg->slots[i];
+      if (change_state(slot, SLOT_CONNECTED, SLOT_DROPPED) || change_state(slot, SLOT_CONNECTING, SLOT_DROPPED)) {
+        notify(slot.client);
+        notify(slot.up.space);
+      }
+    }
+    store(m_seg->magic, 0U);
+    shm_unlink(segment_name(m_name).c_str());
+    munmap(m_seg, sizeof(ShmSegment));
+  }
+
+  void SHMServer::Disconnect(unsigned i) {
+    ConnectionInfoSHM * inf = m_active[i];
+    m_events.push(TransportEvent(TransportEvent::DISCONNECT, *inf));
+    inf->Disable();
+    m_active[i] = 0;
+    store(m_seg->slots[i].state, static_cast<uint32_t>(SLOT_FREE));
+  }
+
+  bool SHMServer::Poll() {
+    bool queued = false;
+    bool check = false;
+    if (Time::Current() - m_lastcheck > Time(1)) {
+      check = true;
+      m_lastcheck = Time::Current();
+    }
+    for (unsigned i = 0; i < SHM_SLOTS; ++i) {
+      ShmSlot & slot = m_seg->slots[i];
+      uint32_t state = load(slot.state);
+      if (state == SLOT_FREE || state == SLOT_CLAIMED) continue;
+      ConnectionInfoSHM * inf = m_active[i];
+      if (!inf) {
+        if (state == SLOT_CONNECTING) {
+          inf = new ConnectionInfoSHM(&slot, i, ++m_serial, "localhost, pid " + to_string(slot.pid));
+          counted_ptr<ConnectionInfo> ptr(inf);
+          bool inserted = false;
+          // entries may only be replaced while no queued events refer to them
+          for (size_t j = 0; m_events.empty() && !inserted && j < m_conn.size(); ++j) {
+            if (m_conn[j]->GetState() < 0) {
+              m_conn[j] = ptr;
+              inserted = true;
+            }
+          }
+          if (!inserted) m_conn.push_back(ptr);
+          m_active[i] = inf;
+          m_events.push(TransportEvent(TransportEvent::CONNECT, *inf));
+          queued = true;
+          if (!change_state(slot, SLOT_CONNECTING, SLOT_CONNECTED)) {
+            // closed again before it was accepted
+            state = load(slot.state);
+          }
+        } else if (state == SLOT_CLOSED || (check && !process_alive(slot.pid))) {
+          // nobody is left to look after it
+          store(slot.state, static_cast<uint32_t>(SLOT_FREE));
+          continue;
+        } else {
+          continue;
+        }
+      }
+      if (inf->receive(true, m_events)) queued = true;
+      if (state == SLOT_CLOSED || (check && !process_alive(slot.pid))) {
+        Disconnect(i);
+        queued = true;
+      }
+    }
+    return queued;
+  }
+
+  void SHMServer::Close(const ConnectionInfo & id) {
+    for (unsigned i = 0; i < SHM_SLOTS; ++i) {
+      ConnectionInfoSHM * inf = m_active[i];
+      if (inf && id.Matches(*inf)) {
+        ShmSlot & slot = m_seg->slots[i];
+        if (change_state(slot, SLOT_CONNECTED, SLOT_DROPPED)) {
+          notify(slot.client);
+          notify(slot.up.space);
+        } else {
+          // the client has already gone
+          store(slot.state, static_cast<uint32_t>(SLOT_FREE));
+        }
+        inf->Disable();
+        m_active[i] = 0;
+      }
+    }
+  }
+
+  void SHMServer::SendPacket(const unsigned char * data, size_t len, const ConnectionInfo & id, bool duringconnect) {
+    for (unsigned i = 0; i < SHM_SLOTS; ++i) {
+      ConnectionInfoSHM * inf = m_active[i];
+      if (inf && id.Matches(*inf) && inf->IsEnabled() && (inf->GetState() > 0 || duringconnect)) {
+        ShmSlot & slot = m_seg->slots[i];
+        send_packet(slot.down, slot.downdata, DOWN_RING_SIZE, slot.client, slot, slot.pid, data, len);
+      }
+    }
+  }
+
+  void SHMServer::ProcessEvents(int timeout) {
+    Time t_start = Time::Current();
+    Time t_remain = Time(0, timeout);
+    bool done = false;
+    do {
+      if (Poll()) {
+        done = true;
+      } else {
+        arm(m_seg->server);
+        if (Poll()) {
+          disarm(m_seg->server);
+          done = true;
+        } else {
+          wait(m_seg->server, t_remain);
+        }
+      }
+      t_remain = Time(0, timeout) + t_start - Time::Current();
+    } while (!done && t_remain > Time(0));
+  }
+
+  std::string SHMServer::ConnectionString() const {
+    return name + "://" + m_name;
+  }
+
+  SHMClient::SHMClient(const std::string & param)
+    : m_name(param == "" ? "eudaq" : param), m_seg(0), m_slot(0)
+  {
+    int fd = shm_open(segment_name(m_name).c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      EUDAQ_THROW_NOLOG(LastSysErrorString("Are you sure the server is running? - Error opening shared memory " + m_name));
+    }
+    void * p = mmap(0, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) EUDAQ_THROW_NOLOG(LastSysErrorString("Failed to map shared memory " + m_name));
+    m_seg = static_cast<ShmSegment *>(p);
+    if (load(m_seg->magic) != SHM_MAGIC || !process_alive(m_seg->serverpid)) {
+      munmap(m_seg, sizeof(ShmSegment));
+      EUDAQ_THROW_NOLOG("Are you sure the server is running? - Shared memory " + m_name + " is not served");
+    }
+    unsigned i = 0;
+    while (i < SHM_SLOTS && !change_state(m_seg->slots[i], SLOT_FREE, SLOT_CLAIMED)) ++i;
+    if (i == SHM_SLOTS) {
+      munmap(m_seg, sizeof(ShmSegment));
+      EUDAQ_THROW_NOLOG("No free connection in shared memory " + m_name);
+    }
+    m_slot = &m_seg->slots[i];
+    m_slot->pid = getpid();
+    disarm(m_slot->client);
+    reset_ring(m_slot->up);
+    reset_ring(m_slot->down);
+    m_buf = ConnectionInfoSHM(m_slot, i, 0, SHMServer::name + "://" + m_name);
+    store(m_slot->state, static_cast<uint32_t>(SLOT_CONNECTING));
+    notify(m_seg->server);
+  }
+
+  void SHMClient::SendPacket(const unsigned char * data, size_t len, const ConnectionInfo & id, bool) {
+    if (id.Matches(m_buf)) {
+      send_packet(m_slot->up, m_slot->updata, UP_RING_SIZE, m_seg->server, *m_slot, m_seg->serverpid, data, len);
+    }
+  }
+
+  void SHMClient::ProcessEvents(int timeout) {
+    Time t_start = Time::Current();
+    Time t_remain = Time(0, timeout);
+    bool done = false;
+    do {
+      if (m_buf.receive(false, m_events)) {
+        done = true;
+      } else if (!peer_alive(*m_slot, m_seg->serverpid)) {
+        EUDAQ_THROW_NOLOG("Connection closed by server");
+      } else {
+        arm(m_slot->client);
+        if (m_buf.receive(false, m_events)) {
+          disarm(m_slot->client);
+          done = true;
+        } else {
+          wait(m_slot->client, t_remain);
+        }
+      }
+      t_remain = Time(0, timeout) + t_start - Time::Current();
+    } while (!done && t_remain > Time(0));
+  }
+
+  SHMClient::~SHMClient() {
+    // everything sent is already in the ring, the server reads it before freeing the slot
+    if (change_state(*m_slot, SLOT_CONNECTED, SLOT_CLOSED) || change_state(*m_slot, SLOT_CONNECTING, SLOT_CLOSED)) {
+      notify(m_seg->server);
+    } else {
+      store(m_slot->state, static_cast<uint32_t>(SLOT_FREE));
+    }
+    munmap(m_seg, sizeof(ShmSegment));
+  }
+
+}
+
+#endif
@@ -170,6 +170,13 @@ at some places we have constructions like:
 
 #include <sys/types.h>
 #include <errno.h>
+#if EUDAQ_PLATFORM_IS(LINUX)
+# include <sys/epoll.h>
+#endif
+#if !(EUDAQ_PLATFORM_IS(WIN32) || EUDAQ_PLATFORM_IS(MINGW))
+# include <sys/uio.h>
+# include <poll.h>
+#endif
 //#include <unistd.h>
 
 #include <iostream>
@@ -179,11 +186,16 @@ at some places we have constructions like:
 namespace eudaq {
 
   const std::string TCPServer::name = "tcp";
+#if EUDAQ_PLATFORM_IS(LINUX)
+  const std::string EpollServer::name = "epoll";
+#endif
 
   namespace {
 
     static const int MAXPENDING = 16;
-    static const int MAX_BUFFER_SIZE = 10000;
+    /// Size of the per connection receive buffer, larger packets get a buffer of their own
+    static const size_t RECV_BUFFER_SIZE = 1 << 18;
+    static const int EPOLL_MAX_EVENTS = 64;
 
     static int to_int(char c) {
       return static_cast<unsigned char>(c);
@@ -207,51 +219,109 @@ namespace eudaq {
     }
 #endif
 
-    static void do_send_data(SOCKET sock, const unsigned char * data, size_t len) {
-      //if (len > 500000) std::cout << "Starting send" << std::endl;
-      size_t sent = 0;
-      do {
-        int result = send(sock,
-            reinterpret_cast<const char*>(data+sent),
-            static_cast<int>(len-sent),
-            FLAGS);
+    /// The most outgoing data kept per connection, beyond which sending waits for the socket
+    static const size_t MAX_SEND_QUEUE = 1 << 20;
 
+    /// Waits for the mutex, where MutexLock would fail if it is taken
+    class BlockingLock {
+      public:
+        BlockingLock(Mutex & m) : m_mutex(m) { m_mutex.Lock(); }
+        ~BlockingLock() { m_mutex.UnLock(); }
+      private:
+        Mutex & m_mutex;
+    };
 
-        if (result > 0) {
-          sent += result;
-        } else if (result < 0 && (LastSockError() == EUDAQ_ERROR_Resource_temp_unavailable || LastSockError() == EUDAQ_ERROR_Interrupted_function_call)) {
-          // continue
-        } else if (result == 0) {
-          EUDAQ_THROW_NOLOG("Connection reset by peer");
-        } else if (result < 0) {
-          EUDAQ_THROW_NOLOG(LastSockErrorString("Error sending data"));
+    /// Waits until the socket can take more data (or has an error, which the next send will report)
+    static void wait_writable(SOCKET sock) {
+#if EUDAQ_PLATFORM_IS(WIN32) || EUDAQ_PLATFORM_IS(MINGW)
+      fd_set writeset;
+      FD_ZERO(&writeset);
+      FD_SET(sock, &writeset);
+      timeval timeout = Time(1);
+      select(static_cast<int>(sock + 1), NULL, &writeset, NULL, &timeout);
+#else
+      pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      poll(&pfd, 1, 1000);
+#endif
+    }
+
+    /// Checks the result of a send, returns true if the socket just could not take any data
+    static bool send_would_block(int result) {
+      if (result == 0) {
+        EUDAQ_THROW_NOLOG("Connection reset by peer");
+      } else if (result < 0 && (LastSockError() == EUDAQ_ERROR_Resource_temp_unavailable || LastSockError() == EUDAQ_ERROR_Interrupted_function_call)) {
+        return true;
+      } else if (result < 0) {
+        EUDAQ_THROW_NOLOG(LastSockErrorString("Error sending data"));
+      }
+      return false;
+    }
+
+    /** Sends the header followed by the data from position sent (counting the header) on,
+     *  in as few calls as possible, until the socket would block.
+     *  Returns the position reached.
+     */
+    static size_t send_packet_data(SOCKET sock, const unsigned char * header, const unsigned char * data, size_t len, size_t sent) {
+      const size_t total = len + 4;
+      while (sent < total) {
+        int result;
+#if EUDAQ_PLATFORM_IS(WIN32) || EUDAQ_PLATFORM_IS(MINGW)
+        if (sent < 4) {
+          result = send(sock, reinterpret_cast<const char*>(header + sent), static_cast<int>(4 - sent), FLAGS);
+        } else {
+          result = send(sock, reinterpret_cast<const char*>(data + sent - 4), static_cast<int>(total - sent), FLAGS);
         }
-      } while (sent < len);
-      //if (len > 500000) std::cout << "Done send" << std::endl;
-    }
-
-    static void do_send_packet(SOCKET sock, const unsigned char * data, size_t length) {
-      //if (length > 500000) std::cout << "Starting send packet" << std::endl;
-      if (length < 1020) {
-        size_t len = length;
-        std::string buffer(len+4, '\0');
-        for (int i = 0; i < 4; ++i) {
-          buffer[i] =  static_cast<char>(len & 0xff);
-          len >>= 8;
+#else
+        iovec iov[2];
+        msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = iov;
+        if (sent < 4) {
+          iov[0].iov_base = const_cast<unsigned char *>(header + sent);
+          iov[0].iov_len = 4 - sent;
+          iov[1].iov_base = const_cast<unsigned char *>(data);
+          iov[1].iov_len = len;
+          msg.msg_iovlen = len ? 2 : 1;
+        } else {
+          iov[0].iov_base = const_cast<unsigned char *>(data + sent - 4);
+          iov[0].iov_len = total - sent;
+          msg.msg_iovlen = 1;
         }
-        std::copy(data, data+length, &buffer[4]);
-        do_send_data(sock, reinterpret_cast<const unsigned char *>(&buffer[0]), buffer.length());
-      } else {
-        size_t len = length;
-        unsigned char buffer[4] = {0};
-        for (int i = 0; i < 4; ++i) {
-          buffer[i] = static_cast<unsigned char>(len & 0xff);
-          len >>= 8;
+        result = static_cast<int>(sendmsg(sock, &msg, FLAGS));
+#endif
+        if (result > 0) {
+          sent += result;
+        } else if (send_would_block(result) && LastSockError() != EUDAQ_ERROR_Interrupted_function_call) {
+          break;
         }
-        do_send_data(sock, buffer, 4);
-        do_send_data(sock, data, length);
       }
-      //if (length > 500000) std::cout << "Done send packet" << std::endl;
+      return sent;
+    }
+
+    static SOCKET listen_socket(int port, const std::string & param) {
+      SOCKET sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+      if (sock == (SOCKET)-1) EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to create socket"));  //$$ check if (SOCKET)-1 is correct
+      setup_signal();
+      setup_socket(sock);
+
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof addr);
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(port);
+
+      if (bind(sock, (sockaddr *) &addr, sizeof addr)) {
+        closesocket(sock);
+        EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to bind socket: " + param));
+      }
+      if (listen(sock, MAXPENDING)) {
+        closesocket(sock);
+        EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to listen on socket: " + param));
+      }
+      return sock;
     }
 
     //     static void send_data(SOCKET sock, unsigned long data) {
@@ -277,69 +347,185 @@ namespace eudaq {
     os << " (" /*<< m_fd << ","*/ << m_host << ")";
   }
 
+  ConnectionInfo * ConnectionInfoTCP::Clone() const {
+    // the copy only identifies the connection, so leave out the buffers
+    ConnectionInfoTCP * result = new ConnectionInfoTCP(m_fd, m_host);
+    result->SetState(GetState());
+    result->SetType(GetType());
+    result->SetName(GetName());
+    result->SetHandle(GetHandle());
+    return result;
+  }
+
+  void ConnectionInfoTCP::Disable() {
+    m_state = -1;
+    m_len = 0;
+    m_havelen = false;
+    std::string().swap(m_buf);
+    m_pos = m_end = 0;
+    std::string().swap(m_big);
+    m_inbig = false;
+    m_bigfill = 0;
+    BlockingLock lock(m_send->lock);
+    std::string().swap(m_send->buf);
+    m_send->pos = 0;
+  }
+
+  void ConnectionInfoTCP::sendpacket(const unsigned char * data, size_t len) {
+    unsigned char header[4];
+    size_t length = len;
+    for (int i = 0; i < 4; ++i) {
+      header[i] = static_cast<unsigned char>(length & 0xff);
+      length >>= 8;
+    }
+    const size_t total = len + 4;
+    SendQueue & q = *m_send;
+    BlockingLock lock(q.lock);
+    // wait only until the packet fits behind what is queued, or for all of it if it never would
+    if (!sendqueued(total <= MAX_SEND_QUEUE ? MAX_SEND_QUEUE - total : 0)) {
+      // keep the order: the packet goes behind the data already waiting
+      q.buf.append(reinterpret_cast<const char *>(header), 4);
+      q.buf.append(reinterpret_cast<const char *>(data), len);
+      return;
+    }
+    size_t sent = send_packet_data(m_fd, header, data, len, 0);
+    while (total - sent > MAX_SEND_QUEUE) {
+      // only wait for the part that does not fit into the queue
+      wait_writable(m_fd);
+      sent = send_packet_data(m_fd, header, data, len, sent);
+    }
+    if (sent == total) return;
+    q.buf.clear();
+    q.pos = 0;
+    if (sent < 4) q.buf.append(reinterpret_cast<const char *>(header + sent), 4 - sent);
+    size_t offset = sent < 4 ? 0 : sent - 4;
+    q.buf.append(reinterpret_cast<const char *>(data + offset), len - offset);
+  }
+
+  bool ConnectionInfoTCP::flush(bool wait) {
+    BlockingLock lock(m_send->lock);
+    return sendqueued(wait ? 0 : (size_t)-1);
+  }
+
+  bool ConnectionInfoTCP::havequeued() const {
+    BlockingLock lock(m_send->lock);
+    return m_send->pos < m_send->buf.size();
+  }
+
+  bool ConnectionInfoTCP::sendqueued(size_t keep) {
+    SendQueue & q = *m_send;
+    while (q.pos < q.buf.size()) {
+      int result = send(m_fd, q.buf.data() + q.pos, static_cast<int>(q.buf.size() - q.pos), FLAGS);
+      if (result > 0) {
+        q.pos += result;
+      } else if (send_would_block(result) && LastSockError() != EUDAQ_ERROR_Interrupted_function_call) {
+        if (q.buf.size() - q.pos <= keep) break;
+        wait_writable(m_fd);
+      }
+    }
+    if (q.pos == q.buf.size()) {
+      q.buf.clear();
+      q.pos = 0;
+    } else if (q.pos > q.buf.size() / 2) {
+      // drop the data already sent once it is more than what is left
+      q.buf.erase(0, q.pos);
+      q.pos = 0;
+    }
+    return q.pos == q.buf.size();
+  }
+
   void ConnectionInfoTCP::append(size_t length, const char * data) {
-    m_buf += std::string(data, length);
-    update_length();
-    //std::cout << *this << " - append: " << m_len << ", " << m_buf.size() << std::endl;
+    while (length > 0) {
+      size_t len = length;
+      char * dest = getspace(len);
+      if (len == 0) EUDAQ_THROW_NOLOG("BUG: receive buffer full");
+      if (len > length) len = length;
+      std::copy(data, data + len, dest);
+      received(len);
+      data += len;
+      length -= len;
+    }
+  }
+
+  char * ConnectionInfoTCP::getspace(size_t & len) {
+    if (m_inbig) {
+      // only ask for the rest of the packet, so that it ends up alone in m_big
+      len = m_len - m_bigfill;
+      return &m_big[m_bigfill];
+    }
+    if (m_buf.size() < RECV_BUFFER_SIZE) {
+      m_buf.resize(RECV_BUFFER_SIZE);
+    }
+    if (m_end == m_buf.size() && m_pos > 0) {
+      // only move the data when the buffer is full, so the cost is amortised
+      std::copy(&m_buf[m_pos], &m_buf[0] + m_end, &m_buf[0]);
+      m_end -= m_pos;
+      m_pos = 0;
+    }
+    len = m_buf.size() - m_end;
+    return &m_buf[0] + m_end;
+  }
+
+  void ConnectionInfoTCP::received(size_t length) {
+    if (m_inbig) {
+      m_bigfill += length;
+    } else {
+      m_end += length;
+      update_length();
+    }
   }
 
   bool ConnectionInfoTCP::havepacket() const {
-    return m_buf.length() >= m_len + 4;
+    if (m_inbig) return m_bigfill == m_len;
+    return m_havelen && m_end - m_pos >= m_len + 4;
   }
 
   std::string ConnectionInfoTCP::getpacket() {
-    if (!havepacket()) EUDAQ_THROW_NOLOG("No packet available");
-    std::string packet(m_buf, 4, m_len);
-    m_buf.erase(0, m_len+4);
-    update_length(true);
-    //std::cout << *this << " - getpacket: " << m_len << ", " << m_buf.size() << std::endl;
+    std::string packet;
+    getpacket(packet);
     return packet;
   }
 
-  void ConnectionInfoTCP::update_length(bool force) {
-    //std::cout << "DBG: len=" << m_len << ", buf=" << m_buf.length();
-    if (force || m_len == 0) {
-      m_len = 0;
-      if (m_buf.length() >= 4) {
-        for (int i = 0; i < 4; ++i) {
-          m_len |= to_int(m_buf[i]) << (8*i);
-        }
-        //         std::cout << " (" << to_hex(m_buf[3], 2)
-        //                   << " " << to_hex(m_buf[2], 2)
-        //                   << " " << to_hex(m_buf[1], 2)
-        //                   << " " << to_hex(m_buf[0], 2)
-        //                   << ")";
-      }
+  void ConnectionInfoTCP::getpacket(std::string & packet) {
+    if (!havepacket()) EUDAQ_THROW_NOLOG("No packet available");
+    if (m_inbig) {
+      packet.swap(m_big);
+      std::string().swap(m_big);
+      m_inbig = false;
+      m_bigfill = 0;
+    } else {
+      packet.assign(&m_buf[m_pos + 4], m_len);
+      m_pos += m_len + 4;
+      if (m_pos == m_end) m_pos = m_end = 0;
+    }
+    m_havelen = false;
+    update_length();
+  }
+
+  void ConnectionInfoTCP::update_length() {
+    if (m_havelen || m_end - m_pos < 4) return;
+    m_len = 0;
+    for (int i = 0; i < 4; ++i) {
+      m_len |= to_int(m_buf[m_pos + i]) << (8*i);
+    }
+    m_havelen = true;
+    if (m_len + 4 > m_buf.size()) {
+      // too large for the buffer: move what we have of it into a string of its own
+      m_big.resize(m_len);
+      m_bigfill = m_end - m_pos - 4;
+      std::copy(&m_buf[m_pos + 4], &m_buf[0] + m_end, &m_big[0]);
+      m_pos = m_end = 0;
+      m_inbig = true;
     }
-    //std::cout << ", len=" << m_len << std::endl;
   }
 
   TCPServer::TCPServer(const std::string & param)
     : m_port(from_string(param, 44000)),
-    m_srvsock(socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)),
+    m_srvsock(listen_socket(m_port, param)),
     m_maxfd(m_srvsock)
   {
-    if (m_srvsock == (SOCKET)-1) EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to create socket"));  //$$ check if (SOCKET)-1 is correct
-    setup_signal();
     FD_ZERO(&m_fdset);
     FD_SET(m_srvsock, &m_fdset);
-
-    setup_socket(m_srvsock);
-
-    sockaddr_in addr;
-    memset(&addr, 0, sizeof addr);
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(m_port);
-
-    if (bind(m_srvsock, (sockaddr *) &addr, sizeof addr)) {
-      closesocket(m_srvsock);
-      EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to bind socket: " + param));
-    }
-    if (listen(m_srvsock, MAXPENDING)) {
-      closesocket(m_srvsock);
-      EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to listen on socket: " + param));
-    }
   }
 
   TCPServer::~TCPServer() {
@@ -389,7 +575,7 @@ namespace eudaq {
           dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
         if (inf && inf->IsEnabled() && (inf->GetState() > 0 || duringconnect)) {
           //std::cout << " ok" << std::endl;
-          do_send_packet(inf->GetFd(), data, len);
+          inf->sendpacket(data, len);
         } //else std::cout << " not quite" << std::endl;
       } //else std::cout << " nope" << std::endl;
     }
@@ -405,9 +591,21 @@ namespace eudaq {
     do {
       fd_set tempset;
       memcpy(&tempset, &m_fdset, sizeof(tempset));
+      // also wait for connections with queued outgoing data to become writable
+      fd_set writeset;
+      FD_ZERO(&writeset);
+      bool writing = false;
+      for (size_t i = 0; i < m_conn.size(); ++i) {
+        ConnectionInfoTCP * inf =
+          dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+        if (inf && inf->IsEnabled() && inf->havequeued()) {
+          FD_SET(inf->GetFd(), &writeset);
+          writing = true;
+        }
+      }
       //std::cout << "select timeout=" << t_remain << std::endl;
       timeval timeremain = t_remain;
-      int result = select(static_cast<int>(m_maxfd + 1), &tempset, NULL, NULL, &timeremain);
+      int result = select(static_cast<int>(m_maxfd + 1), &tempset, writing ? &writeset : NULL, NULL, &timeremain);
 
 
       //std::cout << "select done" << std::endl;
@@ -418,6 +616,18 @@ namespace eudaq {
         std::cout << LastSockErrorString("Error in select()") << std::endl;
       } else if (result > 0) {
 
+        for (size_t i = 0; writing && i < m_conn.size(); ++i) {
+          ConnectionInfoTCP * inf =
+            dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+          if (inf && inf->IsEnabled() && FD_ISSET(inf->GetFd(), &writeset)) {
+            try {
+              inf->flush();
+            } catch (const Exception &) {
+              // a lost connection will be noticed when reading from it
+            }
+          }
+        }
+
         if (FD_ISSET(m_srvsock, &tempset)) {
           sockaddr_in addr;
           socklen_t len = sizeof(addr);
@@ -446,24 +656,24 @@ namespace eudaq {
         }
         for (SOCKET j=0; j < m_maxfd+1; j++) {
           if (FD_ISSET(j, &tempset)) {
-            char buffer[MAX_BUFFER_SIZE+1];
+            ConnectionInfoTCP & m = GetInfo(j);
+            size_t len = 0;
+            char * buffer = m.getspace(len);
 
             do {
-              result = recv(j, buffer, MAX_BUFFER_SIZE, 0);
+              result = recv(j, buffer, static_cast<int>(len), 0);
             } while (result == EUDAQ_ERROR_NO_DATA_RECEIVED && LastSockError() == EUDAQ_ERROR_Interrupted_function_call);
 
             if (result > 0) {
-              buffer[result] = 0;
-              ConnectionInfoTCP & m = GetInfo(j);
-              m.append(result, buffer);
+              m.received(result);
               while (m.havepacket()) {
                 done = true;
-                m_events.push(TransportEvent(TransportEvent::RECEIVE, m, m.getpacket()));
+                m_events.push(TransportEvent(TransportEvent::RECEIVE, m));
+                m.getpacket(m_events.back().packet);
               }
             } //else /*if (result == 0)*/ {
             else if (result == 0){
               debug_transport( "Server #%d, return=%d, WSAError:%d (%s) Disconnected.\n", j, result, errno, strerror(errno));
-              ConnectionInfoTCP & m = GetInfo(j);
               m_events.push(TransportEvent(TransportEvent::DISCONNECT, m));
               m.Disable();
               closesocket(j);
@@ -488,6 +698,14 @@ namespace eudaq {
       } while (!done && t_remain > Time(0));
     }
 
+    void TCPServer::Flush() {
+      for (size_t i = 0; i < m_conn.size(); ++i) {
+        ConnectionInfoTCP * inf =
+          dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+        if (inf && inf->IsEnabled()) inf->flush(true);
+      }
+    }
+
     std::string TCPServer::ConnectionString() const {
       const char * host = getenv("HOSTNAME");
       if (!host) host = "localhost";
@@ -495,6 +713,218 @@ namespace eudaq {
       return name + "://" + host + ":" + to_string(m_port);
     }
 
+#if EUDAQ_PLATFORM_IS(LINUX)
+    EpollServer::EpollServer(const std::string & param)
+      : m_port(from_string(param, 44000)),
+      m_srvsock(listen_socket(m_port, param)),
+      m_epfd(epoll_create(EPOLL_MAX_EVENTS))
+    {
+      if (m_epfd < 0) {
+        closesocket(m_srvsock);
+        EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to create epoll instance"));
+      }
+      epoll_event ev;
+      memset(&ev, 0, sizeof ev);
+      ev.events = EPOLLIN;
+      ev.data.ptr = 0; // a null connection stands for the listening socket
+      if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_srvsock, &ev)) {
+        close(m_epfd);
+        closesocket(m_srvsock);
+        EUDAQ_THROW_NOLOG(LastSockErrorString("Failed to watch socket: " + param));
+      }
+    }
+
+    EpollServer::~EpollServer() {
+      for (size_t i = 0; i < m_conn.size(); ++i) {
+        ConnectionInfoTCP * inf =
+          dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+        if (inf && inf->IsEnabled()) {
+          closesocket(inf->GetFd());
+        }
+      }
+      close(m_epfd);
+      closesocket(m_srvsock);
+    }
+
+    void EpollServer::Close(const ConnectionInfo & id) {
+      for (size_t i = 0; i < m_conn.size(); ++i) {
+        if (id.Matches(*m_conn[i])) {
+          ConnectionInfoTCP * inf =
+            dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+          if (inf && inf->IsEnabled()) {
+            SOCKET fd = inf->GetFd();
+            inf->Disable();
+            epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, 0);
+            closesocket(fd);
+          }
+        }
+      }
+    }
+
+    void EpollServer::SendPacket(const unsigned char * data, size_t len, const ConnectionInfo & id, bool duringconnect) {
+      for (size_t i = 0; i < m_conn.size(); ++i) {
+        if (id.Matches(*m_conn[i])) {
+          ConnectionInfoTCP * inf =
+            dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+          if (inf && inf->IsEnabled() && (inf->GetState() > 0 || duringconnect)) {
+            inf->sendpacket(data, len);
+            if (inf->havequeued()) Watch(*inf, true);
+          }
+        }
+      }
+    }
+
+    void EpollServer::Flush() {
+      for (size_t i = 0; i < m_conn.size(); ++i) {
+        ConnectionInfoTCP * inf =
+          dynamic_cast<ConnectionInfoTCP *>(m_conn[i].get());
+        if (inf && inf->IsEnabled()) inf->flush(true);
+      }
+    }
+
+    void EpollServer::Accept() {
+      for (;;) {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        SOCKET peersock = accept(m_srvsock, (sockaddr*)&addr, &len);
+        if (peersock == INVALID_SOCKET) {
+          if (LastSockError() == EUDAQ_ERROR_Interrupted_function_call) continue;
+          if (LastSockError() != EUDAQ_ERROR_Resource_temp_unavailable) {
+            std::cout << LastSockErrorString("Error in accept()") << std::endl;
+          }
+          break;
+        }
+        setup_socket(peersock);
+        std::string host = inet_ntoa(addr.sin_addr);
+        host += ":" + to_string(ntohs(addr.sin_port));
+        ConnectionInfoTCP * inf = new ConnectionInfoTCP(peersock, host);
+        counted_ptr<ConnectionInfo> ptr(inf);
+
+        epoll_event ev;
+        memset(&ev, 0, sizeof ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = inf;
+        if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, peersock, &ev)) {
+          std::cout << LastSockErrorString("Error in epoll_ctl()") << std::endl;
+          closesocket(peersock);
+          continue;
+        }
+
+        bool inserted = false;
+        for (size_t i = 0; i < m_conn.size(); ++i) {
+          if (m_conn[i]->GetState() < 0) {
+            m_retired.push_back(m_conn[i]);
+            m_conn[i] = ptr;
+            inserted = true;
+            break;
+          }
+        }
+        if (!inserted) m_conn.push_back(ptr);
+        m_events.push(TransportEvent(TransportEvent::CONNECT, *ptr));
+      }
+    }
+
+    void EpollServer::Watch(ConnectionInfoTCP & m, bool output) {
+      epoll_event ev;
+      memset(&ev, 0, sizeof ev);
+      ev.events = output ? EPOLLIN | EPOLLOUT : EPOLLIN;
+      ev.data.ptr = &m;
+      epoll_ctl(m_epfd, EPOLL_CTL_MOD, m.GetFd(), &ev);
+    }
+
+    void EpollServer::Disconnect(ConnectionInfoTCP & m) {
+      SOCKET fd = m.GetFd();
+      m_events.push(TransportEvent(TransportEvent::DISCONNECT, m));
+      m.Disable();
+      epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, 0);
+      closesocket(fd);
+    }
+
+    bool EpollServer::Receive(ConnectionInfoTCP & m) {
+      bool received = false;
+      for (;;) {
+        size_t len = 0;
+        char * buffer = m.getspace(len);
+        ssize_t result = recv(m.GetFd(), buffer, len, 0);
+        if (result > 0) {
+          m.received(result);
+          while (m.havepacket()) {
+            received = true;
+            m_events.push(TransportEvent(TransportEvent::RECEIVE, m));
+            m.getpacket(m_events.back().packet);
+          }
+          // a short read means the socket has been drained
+          if ((size_t)result < len) break;
+        } else if (result == 0) {
+          debug_transport("Server #%d, return=%d, WSAError:%d (%s) Disconnected.\n", m.GetFd(), (int)result, errno, strerror(errno));
+          Disconnect(m);
+          break;
+        } else if (LastSockError() == EUDAQ_ERROR_Interrupted_function_call) {
+          // try again
+        } else if (LastSockError() == EUDAQ_ERROR_Resource_temp_unavailable) {
+          break;
+        } else {
+          // the socket would keep being reported as ready, so give up on it
+          debug_transport("Server #%d, return=%d, WSAError:%d (%s) \n", m.GetFd(), (int)result, errno, strerror(errno));
+          Disconnect(m);
+          break;
+        }
+      }
+      return received;
+    }
+
+    void EpollServer::ProcessEvents(int timeout) {
+      if (m_events.empty()) m_retired.clear();
+#if DEBUG_NOTIMEOUT == 0
+      Time t_start = Time::Current();
+#endif
+      Time t_remain = Time(0, timeout);
+      bool done = false;
+      epoll_event events[EPOLL_MAX_EVENTS];
+      do {
+        timeval timeremain = t_remain;
+        int ms = static_cast<int>(timeremain.tv_sec * 1000 + (timeremain.tv_usec + 999) / 1000);
+        int result = epoll_wait(m_epfd, events, EPOLL_MAX_EVENTS, ms < 0 ? 0 : ms);
+        if (result < 0 && LastSockError() != EUDAQ_ERROR_Interrupted_function_call) {
+          std::cout << LastSockErrorString("Error in epoll_wait()") << std::endl;
+        }
+        for (int i = 0; i < result; ++i) {
+          ConnectionInfoTCP * inf = static_cast<ConnectionInfoTCP *>(events[i].data.ptr);
+          if (!inf) {
+            Accept();
+            continue;
+          }
+          if ((events[i].events & EPOLLOUT) && inf->IsEnabled()) {
+            try {
+              if (inf->flush()) {
+                Watch(*inf, false);
+                // another thread may have queued more in the meantime
+                if (inf->havequeued()) Watch(*inf, true);
+              }
+            } catch (const Exception &) {
+              // a lost connection will be noticed when reading from it
+            }
+          }
+          if ((events[i].events & ~EPOLLOUT) && inf->IsEnabled() && Receive(*inf)) {
+            done = true;
+          }
+        }
+
+#if DEBUG_NOTIMEOUT
+        t_remain = Time(0, timeout);
+#else
+        t_remain = Time(0, timeout) + t_start - Time::Current();
+#endif
+      } while (!done && t_remain > Time(0));
+    }
+
+    std::string EpollServer::ConnectionString() const {
+      const char * host = getenv("HOSTNAME");
+      if (!host) host = "localhost";
+      return name + "://" + host + ":" + to_string(m_port);
+    }
+#endif
+
     TCPClient::TCPClient(const std::string & param)
       : m_server(param),
       m_port(44000),
@@ -539,7 +969,7 @@ namespace eudaq {
       //std::cout << "Sending packet to " << id << std::endl;
       if (id.Matches(m_buf)) {
         //std::cout << " ok" << std::endl;
-        do_send_packet(m_buf.GetFd(), data, len);
+        m_buf.sendpacket(data, len);
       }
       //std::cout << "Sent" << std::endl;
     }
@@ -555,11 +985,16 @@ namespace eudaq {
         fd_set tempset;
         FD_ZERO(&tempset);
         FD_SET(m_sock, &tempset);
+        // send on what is queued, and wake up when the socket can take the rest
+        fd_set writeset;
+        FD_ZERO(&writeset);
+        const bool writing = !m_buf.flush();
+        if (writing) FD_SET(m_sock, &writeset);
         timeval timeremain = t_remain;
 #ifdef WIN32
-		int result = select(static_cast<int>(m_sock+1), &tempset, NULL, NULL, &timeremain);
+		int result = select(static_cast<int>(m_sock+1), &tempset, writing ? &writeset : NULL, NULL, &timeremain);
 #else
-		SOCKET result = select(static_cast<int>(m_sock+1), &tempset, NULL, NULL, &timeremain);  
+		SOCKET result = select(static_cast<int>(m_sock+1), &tempset, writing ? &writeset : NULL, NULL, &timeremain);  
 #endif
 
 
@@ -567,10 +1002,11 @@ namespace eudaq {
 
         bool donereading = false;
         do {
-          char buffer[MAX_BUFFER_SIZE+1];
+          size_t len = 0;
+          char * buffer = m_buf.getspace(len);
 
           do {
-            result = recv(m_sock, buffer, MAX_BUFFER_SIZE, 0);
+            result = recv(m_sock, buffer, static_cast<int>(len), 0);
           } while (result == EUDAQ_ERROR_NO_DATA_RECEIVED && LastSockError() == EUDAQ_ERROR_Interrupted_function_call);
 
           if (result == EUDAQ_ERROR_NO_DATA_RECEIVED && LastSockError() == EUDAQ_ERROR_Resource_temp_unavailable) {
@@ -586,9 +1022,10 @@ namespace eudaq {
             EUDAQ_THROW_NOLOG(LastSockErrorString("SocketClient Error (" + to_string(LastSockError()) + ")"));
           }
           else if (result > 0){
-            m_buf.append(result, buffer);
+            m_buf.received(result);
             while (m_buf.havepacket()) {
-              m_events.push(TransportEvent(TransportEvent::RECEIVE, m_buf, m_buf.getpacket()));
+              m_events.push(TransportEvent(TransportEvent::RECEIVE, m_buf));
+              m_buf.getpacket(m_events.back().packet);
               done = true;
             }
           }
@@ -608,7 +1045,17 @@ namespace eudaq {
       //std::cout << "done" << std::endl;
     }
 
+    void TCPClient::Flush() {
+      m_buf.flush(true);
+    }
+
     TCPClient::~TCPClient() {
+      try {
+        // do not lose the last packets that are still queued
+        m_buf.flush(true);
+      } catch (const Exception &) {
+        // the connection is gone, nothing more can be sent
+      }
       closesocket(m_sock);
     }
 
@@ -89,6 +89,28 @@ namespace eudaq {
 #endif
   }
 
+  unsigned NumProcessors() {
+    long cpus = 1;
+#if EUDAQ_PLATFORM_IS(WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    cpus = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return cpus > 1 ? (unsigned)cpus : 1U;
+  }
+
+  bool CpuHasAVX2() {
+#ifdef EUDAQ_TARGET_AVX2
+    // may be called from a static initializer, before libgcc has set up what it checks
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+  }
+
   template<>
     long from_string(const std::string & x, const long & def) {
       if (x == "") return def;
@@ -104,7 +104,7 @@ class RootMonitor : private eudaq::Holder<int>,
       virtual void OnStartRun(unsigned param);
       virtual void OnEvent(const eudaq::StandardEvent & ev);
 
-      virtual void OnBadEvent(counted_ptr<eudaq::Event> ev) {
+      virtual void OnBadEvent(eudaq::EventPtr<eudaq::Event> ev) {
         EUDAQ_ERROR("Bad event type found in data file");
         std::cout << "Bad Event: " << *ev << std::endl;
       }
@@ -85,7 +85,7 @@ public:
     int Nmod, Kmod;
     unsigned int itrg, itrg_old = -1;
     //eudaq::DEPFETEvent ev(m_run, m_evt+1);
-    counted_ptr<eudaq::RawDataEvent> ev;
+    eudaq::EventPtr<eudaq::RawDataEvent> ev;
     unsigned id = m_idoffset;
     do {   //--- modules of one event loop
       lenevent = BUFSIZE;
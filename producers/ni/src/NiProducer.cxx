@@ -37,8 +37,8 @@ public:
 				mimosa_data_1 = ni_control->DataTransportClientSocket_ReadData(datalength2);
 
 				eudaq::RawDataEvent ev("NI", m_run, m_ev++);
-				ev.AddBlock(0, mimosa_data_0);
-				ev.AddBlock(1, mimosa_data_1);
+				ev.TakeBlock(0, mimosa_data_0);
+				ev.TakeBlock(1, mimosa_data_1);
 				SendEvent(ev);
 			}
 